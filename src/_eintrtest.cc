@@ -0,0 +1,160 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/eintr.h"
+#include "ert/timekeeping.h"
+
+#include "gtest/gtest.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static ssize_t
+readFd(int aFd, void *aBuf, size_t aLen)
+{
+    ssize_t rc = -1;
+
+    while (1)
+    {
+        rc = read(aFd, aBuf, aLen);
+
+        if (-1 != rc || EINTR != errno)
+            break;
+    }
+
+    return rc;
+}
+
+static ssize_t
+writeFd(int aFd, const void *aBuf, size_t aLen)
+{
+    ssize_t rc = -1;
+
+    while (1)
+    {
+        rc = write(aFd, aBuf, aLen);
+
+        if (-1 != rc || EINTR != errno)
+            break;
+    }
+
+    return rc;
+}
+
+TEST(EintrTest, SystemCallStatistics)
+{
+    int fd[2];
+    EXPECT_EQ(0, pipe(fd));
+
+    struct Ert_SystemCallStatistics before;
+    EXPECT_EQ(0, ert_fetchSystemCallStatistics("read", &before));
+
+    ert_enableSystemCallStatistics();
+
+    char buf[65536];
+
+    EXPECT_EQ(1, writeFd(fd[1], "x", 1));
+    EXPECT_EQ(1, readFd(fd[0], buf, sizeof(buf)));
+    EXPECT_EQ(-1, readFd(-1, buf, sizeof(buf)));
+    EXPECT_EQ(EBADF, errno);
+
+    ert_disableSystemCallStatistics();
+
+    struct Ert_SystemCallStatistics after;
+    EXPECT_EQ(0, ert_fetchSystemCallStatistics("read", &after));
+
+    /* Interrupted calls are retried, and other threads might also be
+     * reading, so the statistics can only be bounded from below. */
+
+    EXPECT_LE(before.mCalls + 2, after.mCalls);
+    EXPECT_LE(before.mErrors + 1, after.mErrors);
+    EXPECT_LE(before.mInterrupts, after.mInterrupts);
+    EXPECT_EQ(after.mCalls, after.mLatency.mCount);
+
+    errno = 0;
+    EXPECT_EQ(-1, ert_fetchSystemCallStatistics("unknown", &after));
+    EXPECT_EQ(ENOENT, errno);
+
+    int out[2];
+    EXPECT_EQ(0, pipe(out));
+
+    EXPECT_EQ(0, ert_printSystemCallStatistics(out[1]));
+    EXPECT_EQ(0, close(out[1]));
+
+    ssize_t len = readFd(out[0], buf, sizeof(buf)-1);
+    EXPECT_LT(0, len);
+    EXPECT_EQ(0, close(out[0]));
+
+    buf[len > 0 ? len : 0] = 0;
+
+    EXPECT_TRUE(strstr(buf, "read calls "));
+    EXPECT_TRUE(strstr(buf, "write calls "));
+
+    EXPECT_EQ(0, close(fd[0]));
+    EXPECT_EQ(0, close(fd[1]));
+}
+
+TEST(EintrTest, Overhead)
+{
+    /* Compare the cost of an interposed system call with statistics
+     * disabled, and with statistics enabled. */
+
+    static const unsigned rounds = 100000;
+
+    struct Ert_MonotonicTime since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_EQ(-1, read(-1, 0, 0));
+
+    struct Ert_MonotonicTime until = ert_monotonicTime();
+
+    double disabledNs =
+        (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    ert_enableSystemCallStatistics();
+
+    since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_EQ(-1, read(-1, 0, 0));
+
+    until = ert_monotonicTime();
+
+    ert_disableSystemCallStatistics();
+
+    double enabledNs =
+        (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    fprintf(stderr,
+            "read ns disabled %.1f enabled %.1f\n", disabledNs, enabledNs);
+}
+
+#include "_test_.h"
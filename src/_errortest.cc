@@ -32,7 +32,9 @@
 #include "ert/file.h"
 #include "ert/void.h"
 #include "ert/process.h"
+#include "ert/thread.h"
 
+#include <string.h>
 #include <unistd.h>
 
 #include "gtest/gtest.h"
@@ -259,6 +261,34 @@ Ert_Finally:
     return rc;
 }
 
+TEST_F(ErrorTest, FrameSite)
+{
+    ert_restartErrorFrameSequence_();
+
+    EXPECT_EQ(-1, testFinallyIfFail_1());
+    EXPECT_EQ(1u, ert_ownErrorFrameOffset_());
+
+    const struct Ert_ErrorFrame *frame =
+        ert_ownErrorFrame_(Ert_ErrorFrameStackThread, 0);
+
+    EXPECT_TRUE(frame);
+    EXPECT_EQ(-1, frame->mErrno);
+    EXPECT_EQ(0, strcmp(__FILE__, frame->mSite->mFile));
+    EXPECT_EQ(0, strcmp("testFinallyIfFail_1", frame->mSite->mName));
+    EXPECT_EQ(0, strcmp("fail()", frame->mSite->mText));
+
+    /* Repeated errors from the same site refer to the same descriptor. */
+
+    const struct Ert_ErrorFrameSite *site = frame->mSite;
+
+    ert_restartErrorFrameSequence_();
+
+    EXPECT_EQ(-1, testFinallyIfFail_1());
+    EXPECT_EQ(site, ert_ownErrorFrame_(Ert_ErrorFrameStackThread, 0)->mSite);
+
+    ert_restartErrorFrameSequence_();
+}
+
 TEST_F(ErrorTest, OffsetCounting)
 {
     EXPECT_EQ(-1, testFinallyIfFail_1());
@@ -388,4 +418,96 @@ TEST_F(ErrorTest, ChildError)
     ert_logErrorFrameSequence(0);
 }
 
+TEST_F(ErrorTest, LogSink)
+{
+    FILE *logFile = tmpfile();
+    EXPECT_TRUE(logFile);
+
+    int stdErr = dup(STDERR_FILENO);
+    EXPECT_NE(-1, stdErr);
+    EXPECT_EQ(STDERR_FILENO, dup2(fileno(logFile), STDERR_FILENO));
+
+    EXPECT_EQ(0, ert_enableErrorLogSink());
+
+    for (unsigned ix = 0; 1000 > ix; ++ix)
+        Ert_Error_warn_(0, "Log sink line %u", ix);
+
+    EXPECT_EQ(0, ert_disableErrorLogSink());
+
+    EXPECT_EQ(STDERR_FILENO, dup2(stdErr, STDERR_FILENO));
+    EXPECT_EQ(0, close(stdErr));
+
+    char   *line    = 0;
+    size_t  lineLen = 0;
+    unsigned numLines = 0;
+
+    rewind(logFile);
+
+    while (-1 != getline(&line, &lineLen, logFile))
+    {
+        char text[32];
+
+        snprintf(text, sizeof(text), "Log sink line %u\n", numLines);
+
+        if (strstr(line, text))
+            ++numLines;
+    }
+
+    free(line);
+
+    EXPECT_EQ(1000u, numLines);
+    EXPECT_EQ(0, fclose(logFile));
+}
+
+static void
+runErrorFrameChunkThread_(void)
+{
+    struct Ert_Thread thread_;
+    struct Ert_Thread *thread =
+        ert_createThread(
+            &thread_,
+            0,
+            0,
+            Ert_ThreadMethod(
+                ert_Void(),
+                ERT_LAMBDA(
+                    int, (struct Ert_Void *self_),
+                    {
+                        ert_restartErrorFrameSequence_();
+
+                        return 0;
+                    })));
+
+    EXPECT_TRUE(thread);
+    EXPECT_FALSE(ert_closeThread(thread));
+}
+
+TEST_F(ErrorTest, ChunkPool)
+{
+    unsigned limit =
+        ert_setErrorFrameChunkPoolLimit(ERT_ERROR_FRAME_CHUNK_POOL_LIMIT);
+
+    unsigned poolSize = ert_ownErrorFrameChunkPoolSize_();
+    EXPECT_LT(0u, poolSize);
+
+    /* Chunks used by a terminated thread are returned to the pool
+     * for reuse by subsequent threads. */
+
+    runErrorFrameChunkThread_();
+    EXPECT_LE(poolSize, ert_ownErrorFrameChunkPoolSize_());
+
+    poolSize = ert_ownErrorFrameChunkPoolSize_();
+    runErrorFrameChunkThread_();
+    EXPECT_EQ(poolSize, ert_ownErrorFrameChunkPoolSize_());
+
+    /* Chunks beyond the high water mark are returned to the system. */
+
+    ert_setErrorFrameChunkPoolLimit(0);
+
+    runErrorFrameChunkThread_();
+    EXPECT_GT(poolSize, ert_ownErrorFrameChunkPoolSize_());
+
+    ert_setErrorFrameChunkPoolLimit(limit);
+}
+
 #include "_test_.h"
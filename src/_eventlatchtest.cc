@@ -30,6 +30,7 @@
 #include "ert/eventlatch.h"
 #include "ert/eventpipe.h"
 #include "ert/timekeeping.h"
+#include "ert/macros.h"
 
 #include "gtest/gtest.h"
 
@@ -346,4 +347,167 @@ TEST(EventLatchTest, PipePolling)
     eventPipe = ert_closeEventPipe(eventPipe);
 }
 
+struct PipeReadyList
+{
+    static unsigned Order[8];
+    static unsigned Count;
+
+    unsigned mIndex;
+
+    static int recordPoll(struct PipeReadyList            *self,
+                          bool                             aEnabled,
+                          const struct Ert_EventClockTime *aPollTime_)
+    {
+        Order[Count++] = self->mIndex;
+        return 0;
+    }
+};
+
+unsigned PipeReadyList::Order[8];
+unsigned PipeReadyList::Count;
+
+TEST(EventLatchTest, PipeReadyList)
+{
+    /* Bind many latches to the pipe, and verify that polling the pipe
+     * only visits those latches that were signalled, in the order in
+     * which they were signalled. */
+
+    struct Ert_EventLatch eventLatch[8];
+    struct PipeReadyList  pipeReadyList[8];
+
+    struct Ert_EventPipe  eventPipe_;
+    struct Ert_EventPipe *eventPipe = 0;
+
+    EXPECT_EQ(0, ert_createEventPipe(&eventPipe_, 0));
+    eventPipe = &eventPipe_;
+
+    for (unsigned ix = 0; ERT_NUMBEROF(eventLatch) > ix; ++ix)
+    {
+        pipeReadyList[ix].mIndex = ix;
+
+        EXPECT_EQ(0, ert_createEventLatch(&eventLatch[ix], "test"));
+        EXPECT_EQ(Ert_EventLatchSettingOff,
+                  ert_bindEventLatchPipe(&eventLatch[ix], eventPipe,
+                                     Ert_EventLatchMethod(
+                                         &pipeReadyList[ix],
+                                         PipeReadyList::recordPoll)));
+    }
+
+    struct Ert_EventClockTime  pollTime_ = ert_eventclockTime();
+    struct Ert_EventClockTime *pollTime = &pollTime_;
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setEventLatch(&eventLatch[5]));
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setEventLatch(&eventLatch[2]));
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_setEventLatch(&eventLatch[5]));
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_disableEventLatch(&eventLatch[7]));
+
+    PipeReadyList::Count = 0;
+    EXPECT_EQ(3, pollEventPipe(eventPipe, pollTime));
+    EXPECT_EQ(3u, PipeReadyList::Count);
+    EXPECT_EQ(5u, PipeReadyList::Order[0]);
+    EXPECT_EQ(2u, PipeReadyList::Order[1]);
+    EXPECT_EQ(7u, PipeReadyList::Order[2]);
+
+    PipeReadyList::Count = 0;
+    EXPECT_EQ(0, pollEventPipe(eventPipe, pollTime));
+    EXPECT_EQ(0u, PipeReadyList::Count);
+
+    /* A latch that is unbound while on the ready list is no longer
+     * polled, but the remaining latches are. */
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setEventLatch(&eventLatch[1]));
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setEventLatch(&eventLatch[3]));
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setEventLatch(&eventLatch[4]));
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_unbindEventLatchPipe(&eventLatch[3]));
+
+    PipeReadyList::Count = 0;
+    EXPECT_EQ(2, pollEventPipe(eventPipe, pollTime));
+    EXPECT_EQ(2u, PipeReadyList::Count);
+    EXPECT_EQ(1u, PipeReadyList::Order[0]);
+    EXPECT_EQ(4u, PipeReadyList::Order[1]);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(eventLatch) > ix; ++ix)
+        EXPECT_FALSE(ert_closeEventLatch(&eventLatch[ix]));
+
+    eventPipe = ert_closeEventPipe(eventPipe);
+}
+
+TEST(EventLatchTest, SetConcurrently)
+{
+    /* Set a bound latch from several threads at once, and verify that
+     * exactly one of them observes the latch as off, and that the event
+     * pipe is signalled exactly once. */
+
+    struct Ert_EventLatch  eventLatch_;
+    struct Ert_EventLatch *eventLatch = 0;
+
+    struct Ert_EventPipe  eventPipe_;
+    struct Ert_EventPipe *eventPipe = 0;
+
+    EXPECT_EQ(0, ert_createEventPipe(&eventPipe_, 0));
+    eventPipe = &eventPipe_;
+
+    EXPECT_EQ(0, ert_createEventLatch(&eventLatch_, "test"));
+    eventLatch = &eventLatch_;
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_bindEventLatchPipe(eventLatch, eventPipe,
+                                 Ert_EventLatchMethodNil()));
+
+    static int offCount_;
+
+    offCount_ = 0;
+
+    struct Ert_Thread thread[4];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_TRUE(
+            ert_createThread(
+                &thread[ix],
+                0,
+                0,
+                Ert_ThreadMethod(
+                    eventLatch,
+                    ERT_LAMBDA(
+                        int, (struct Ert_EventLatch *self_),
+                        {
+                            for (unsigned jx = 0; 10000 > jx; ++jx)
+                            {
+                                enum Ert_EventLatchSetting setting =
+                                    ert_setEventLatch(self_);
+
+                                if (Ert_EventLatchSettingError == setting)
+                                    return -1;
+
+                                if (Ert_EventLatchSettingOff == setting)
+                                    __sync_add_and_fetch(&offCount_, 1);
+                            }
+
+                            return 0;
+                        }))));
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_FALSE(ert_closeThread(&thread[ix]));
+
+    EXPECT_EQ(1, offCount_);
+    EXPECT_EQ(1, resetEventPipe(eventPipe));
+    EXPECT_EQ(0, resetEventPipe(eventPipe));
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_resetEventLatch(eventLatch));
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_unbindEventLatchPipe(eventLatch));
+
+    eventLatch = ert_closeEventLatch(eventLatch);
+    eventPipe  = ert_closeEventPipe(eventPipe);
+}
+
 #include "_test_.h"
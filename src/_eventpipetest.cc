@@ -32,6 +32,8 @@
 
 #include "gtest/gtest.h"
 
+#include <fcntl.h>
+
 static int
 setEventPipe(struct Ert_EventPipe *aPipe)
 {
@@ -197,4 +199,65 @@ TEST(EventPipeTest, SetOnceResetOnceSetOnce)
     eventPipe = ert_closeEventPipe(eventPipe);
 }
 
+TEST(EventPipeTest, EventFdSetTwice)
+{
+    struct Ert_EventPipe  eventPipe_;
+    struct Ert_EventPipe *eventPipe = 0;
+
+    EXPECT_EQ(0, ert_createEventPipe(&eventPipe_, ERT_EVENTPIPE_EVENTFD));
+    eventPipe = &eventPipe_;
+
+    EXPECT_FALSE(eventPipe->mPipe);
+
+    EXPECT_EQ(1, setEventPipe(eventPipe));
+    EXPECT_EQ(0, setEventPipe(eventPipe));
+
+    EXPECT_EQ(
+        1,
+        ert_waitFileReadReady(eventPipe->mFile, &Ert_ZeroDuration));
+
+    uint64_t count;
+    EXPECT_EQ(
+        static_cast<ssize_t>(sizeof(count)),
+        ert_readFile(
+            eventPipe->mFile,
+            reinterpret_cast<char *>(&count), sizeof(count), 0));
+    EXPECT_EQ(1u, count);
+
+    EXPECT_EQ(
+        0,
+        ert_waitFileReadReady(eventPipe->mFile, &Ert_ZeroDuration));
+
+    eventPipe = ert_closeEventPipe(eventPipe);
+}
+
+TEST(EventPipeTest, EventFdSetOnceResetOnceSetOnce)
+{
+    struct Ert_EventPipe  eventPipe_;
+    struct Ert_EventPipe *eventPipe = 0;
+
+    EXPECT_EQ(0, ert_createEventPipe(
+                  &eventPipe_, ERT_EVENTPIPE_EVENTFD | O_CLOEXEC));
+    eventPipe = &eventPipe_;
+
+    EXPECT_EQ(0, resetEventPipe(eventPipe));
+    EXPECT_EQ(1, setEventPipe(eventPipe));
+    EXPECT_EQ(1, resetEventPipe(eventPipe));
+
+    EXPECT_EQ(
+        0,
+        ert_waitFileReadReady(eventPipe->mFile, &Ert_ZeroDuration));
+
+    EXPECT_EQ(1, setEventPipe(eventPipe));
+
+    EXPECT_EQ(
+        1,
+        ert_waitFileReadReady(eventPipe->mFile, &Ert_ZeroDuration));
+
+    EXPECT_EQ(1, resetEventPipe(eventPipe));
+    EXPECT_EQ(0, resetEventPipe(eventPipe));
+
+    eventPipe = ert_closeEventPipe(eventPipe);
+}
+
 #include "_test_.h"
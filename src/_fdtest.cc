@@ -32,11 +32,13 @@
 #include "ert/fdset.h"
 #include "ert/pid.h"
 #include "ert/process.h"
+#include "ert/timekeeping.h"
 
 #include "gtest/gtest.h"
 
 #include <limits.h>
 #include <fcntl.h>
+#include <stdio.h>
 
 #include <sys/resource.h>
 
@@ -709,4 +711,42 @@ TEST(FdTest, OpenStdFds)
     EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
 }
 
+TEST(FdTest, Overhead)
+{
+    /* Compare the cost of a wrapper whose success path passes through
+     * ERT_ERROR_IF() with the cost of the underlying system call. Build
+     * with configure --disable-test-hooks to measure the production
+     * configuration. */
+
+    static const unsigned rounds = 100000;
+
+    int fd = STDIN_FILENO;
+
+    struct Ert_MonotonicTime since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_NE(-1, fcntl(fd, F_GETFL));
+
+    struct Ert_MonotonicTime until = ert_monotonicTime();
+
+    double rawNs = (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_NE(-1, ert_ownFdNonBlocking(fd));
+
+    until = ert_monotonicTime();
+
+    double wrapNs = (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    fprintf(stderr,
+            "fcntl ns raw %.1f wrapper %.1f\n", rawNs, wrapNs);
+
+    /* Timing is noisy, so only bound gross regressions, such as the
+     * success path doing work comparable to another system call. */
+
+    EXPECT_GT(3 * rawNs, wrapNs);
+}
+
 #include "_test_.h"
@@ -29,11 +29,19 @@
 
 #include "ert/fileeventqueue.h"
 #include "ert/bellsocketpair.h"
+#include "ert/pipe.h"
+#include "ert/sharedlatch.h"
 #include "ert/timescale.h"
+#include "ert/deadline.h"
+#include "ert/timekeeping.h"
 #include "ert/macros.h"
 
 #include "gtest/gtest.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+
 static int eventCount_;
 
 static int
@@ -52,11 +60,105 @@ armTestFileQueueActivity(struct Ert_FileEventQueueActivity *aActivity)
                 })));
 }
 
+static int
+armPersistentTestFileQueueActivity(
+    struct Ert_FileEventQueueActivity *aActivity,
+    enum Ert_FileEventQueueArmMode     aMode)
+{
+    return ert_armFileEventQueueActivityMode(
+        aActivity,
+        Ert_FileEventQueuePollRead,
+        aMode,
+        Ert_FileEventQueueActivityMethod(
+            (char *) 0,
+            ERT_LAMBDA(
+                int, (char *self_),
+                {
+                    ++eventCount_;
+                    return 0;
+                })));
+}
+
+static void
+checkFileEventQueueTimers(struct Ert_FileEventQueue *aQueue)
+{
+    /* Arm timers out of order, disarm one of them, and verify that the
+     * remainder are dispatched in the order of their deadlines. */
+
+    struct Ert_FileEventQueueTimer timer[4];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(timer) > ix; ++ix)
+        EXPECT_EQ(0, ert_createFileEventQueueTimer(&timer[ix], aQueue));
+
+    int order[ERT_NUMBEROF(timer)];
+    int fired = 0;
+
+    struct Ert_FileEventQueueActivityMethod method[ERT_NUMBEROF(timer)];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(timer) > ix; ++ix)
+        method[ix] = Ert_FileEventQueueActivityMethod(
+            &order[ix],
+            ERT_LAMBDA(
+                int, (int *self_),
+                {
+                    *self_ = ++eventCount_;
+                    return 0;
+                }));
+
+    struct Ert_Deadline deadline;
+
+    struct Ert_Duration deadlineDuration =
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(20)));
+
+    EXPECT_EQ(0, ert_createDeadline(&deadline, &deadlineDuration));
+
+    eventCount_ = 0;
+    for (unsigned ix = 0; ERT_NUMBEROF(timer) > ix; ++ix)
+        order[ix] = 0;
+
+    EXPECT_EQ(0, ert_armFileEventQueueTimer(
+                  &timer[0],
+                  Ert_Duration(ERT_NSECS(Ert_MilliSeconds(30))), method[0]));
+    EXPECT_EQ(0, ert_armFileEventQueueTimer(
+                  &timer[1],
+                  Ert_Duration(ERT_NSECS(Ert_MilliSeconds(10))), method[1]));
+    EXPECT_EQ(0, ert_armFileEventQueueTimer(
+                  &timer[2],
+                  Ert_Duration(ERT_NSECS(Ert_MilliSeconds(0))), method[2]));
+    EXPECT_EQ(0, ert_armFileEventQueueTimerDeadline(
+                  &timer[3], &deadline, method[3]));
+
+    ert_disarmFileEventQueueTimer(&timer[1]);
+
+    struct Ert_Duration timeout =
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1000)));
+
+    while (3 > eventCount_ && 10 > fired++)
+        EXPECT_EQ(0, ert_pollFileEventQueueActivity(aQueue, &timeout));
+
+    EXPECT_EQ(3, eventCount_);
+    EXPECT_EQ(3, order[0]);
+    EXPECT_EQ(0, order[1]);
+    EXPECT_EQ(1, order[2]);
+    EXPECT_EQ(2, order[3]);
+
+    EXPECT_EQ(0, ert_pollFileEventQueueActivity(aQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(3, eventCount_);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(timer) > ix; ++ix)
+        EXPECT_FALSE(ert_closeFileEventQueueTimer(&timer[ix]));
+
+    EXPECT_FALSE(ert_closeDeadline(&deadline));
+}
+
 class FileEventQueueTest : public ::testing::Test
 {
+protected:
+
     void SetUp()
     {
-        ASSERT_EQ(0, ert_createFileEventQueue(&mEventQueue_, 2));
+        ASSERT_EQ(0, ert_createFileEventQueueEngine(
+                      &mEventQueue_, 2, mEngine));
         mEventQueue = &mEventQueue_;
 
         ASSERT_EQ(0, ert_createBellSocketPair(&mTestSocket_, 0));
@@ -73,7 +175,12 @@ class FileEventQueueTest : public ::testing::Test
         mEventQueue = ert_closeFileEventQueue(mEventQueue);
     }
 
-protected:
+    FileEventQueueTest(
+        enum Ert_FileEventQueueEngine aEngine = Ert_FileEventQueueEpollEngine)
+    : mEngine(aEngine)
+    { }
+
+    enum Ert_FileEventQueueEngine mEngine;
 
     struct Ert_FileEventQueue  mEventQueue_;
     struct Ert_FileEventQueue *mEventQueue;
@@ -340,4 +447,451 @@ TEST_F(FileEventQueueTest, ReadyClose)
     EXPECT_EQ(0, eventCount_);
 }
 
+TEST_F(FileEventQueueTest, PersistentLevelTriggered)
+{
+    /* A level-triggered persistent activity remains armed, and fires
+     * each time the queue is polled while the event file is ready. */
+
+    EXPECT_EQ(0, ert_createFileEventQueueActivity(
+                  &mEventActivity_,
+                  mEventQueue,
+                  mTestSocket->mSocketPair->mParentSocket->mSocket->mFile));
+    mEventActivity = &mEventActivity_;
+
+    EXPECT_EQ(0, armPersistentTestFileQueueActivity(
+                  mEventActivity, Ert_FileEventQueueArmLevelTriggered));
+    EXPECT_EQ(1, mEventQueue->mNumArmed);
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(2, eventCount_);
+    EXPECT_EQ(1, mEventQueue->mNumArmed);
+    EXPECT_EQ(0, mEventQueue->mNumPending);
+
+    EXPECT_EQ(0, ert_waitBellSocketPairParent(mTestSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+
+    /* Once disarmed, the activity no longer fires. */
+
+    ert_disarmFileEventQueueActivity(mEventActivity);
+    EXPECT_EQ(0, mEventQueue->mNumArmed);
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+
+    mEventActivity = ert_closeFileEventQueueActivity(mEventActivity);
+}
+
+TEST_F(FileEventQueueTest, PersistentEdgeTriggered)
+{
+    /* An edge-triggered persistent activity remains armed, but only
+     * fires when the event file becomes ready again. */
+
+    EXPECT_EQ(0, ert_createFileEventQueueActivity(
+                  &mEventActivity_,
+                  mEventQueue,
+                  mTestSocket->mSocketPair->mParentSocket->mSocket->mFile));
+    mEventActivity = &mEventActivity_;
+
+    EXPECT_EQ(0, armPersistentTestFileQueueActivity(
+                  mEventActivity, Ert_FileEventQueueArmEdgeTriggered));
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(1, eventCount_);
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(1, eventCount_);
+    EXPECT_EQ(1, mEventQueue->mNumArmed);
+
+    mEventActivity = ert_closeFileEventQueueActivity(mEventActivity);
+    EXPECT_EQ(0, mEventQueue->mNumArmed);
+}
+
+TEST_F(FileEventQueueTest, GrowQueue)
+{
+    /* Make more activities ready than the event buffer can hold, and
+     * verify that the event buffer grows to accommodate them. */
+
+    struct Ert_Pipe                   pipes[8];
+    struct Ert_FileEventQueueActivity activities[ERT_NUMBEROF(pipes)];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(pipes) > ix; ++ix)
+    {
+        ASSERT_EQ(0, ert_createPipe(&pipes[ix], 0));
+        ASSERT_EQ(0, ert_createFileEventQueueActivity(
+                      &activities[ix], mEventQueue, pipes[ix].mRdFile));
+        EXPECT_EQ(1, ert_writeFile(pipes[ix].mWrFile, "x", 1, 0));
+    }
+
+    for (unsigned round = 0; 2 > round; ++round)
+    {
+        for (unsigned ix = 0; ERT_NUMBEROF(pipes) > ix; ++ix)
+            EXPECT_EQ(0, armTestFileQueueActivity(&activities[ix]));
+
+        eventCount_ = 0;
+        while (ERT_NUMBEROF(pipes) > static_cast<unsigned>(eventCount_))
+            EXPECT_EQ(
+                0,
+                ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    }
+
+    const struct Ert_FileEventQueueStatistics *statistics =
+        ert_ownFileEventQueueStatistics(mEventQueue);
+
+    EXPECT_LT(2, mEventQueue->mQueueSize);
+    EXPECT_LT(0u, statistics->mGrowths);
+    EXPECT_LT(0u, statistics->mFullPolls);
+    EXPECT_EQ(ERT_NUMBEROF(pipes), statistics->mOccupancy.mMax);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(pipes) > ix; ++ix)
+    {
+        EXPECT_FALSE(ert_closeFileEventQueueActivity(&activities[ix]));
+        EXPECT_FALSE(ert_closePipe(&pipes[ix]));
+    }
+}
+
+struct WorkerPoolTestActivity
+{
+    struct Ert_Pipe                   mPipe;
+    struct Ert_FileEventQueueActivity mActivity;
+    int                               mBusy;
+};
+
+static int                     workerPoolOverlap_;
+static int                     workerPoolEvents_;
+static struct Ert_SharedLatch *workerPoolLatch_;
+
+TEST_F(FileEventQueueTest, WorkerPool)
+{
+    /* Serve persistent activities using a pool of workers, and verify
+     * that every event is dispatched, and that no activity is ever
+     * dispatched concurrently with itself. The activities are armed and
+     * disarmed from this thread while the pool is running. */
+
+    struct WorkerPoolTestActivity activities[8];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(activities) > ix; ++ix)
+    {
+        activities[ix].mBusy = 0;
+        ASSERT_EQ(0, ert_createPipe(&activities[ix].mPipe, O_NONBLOCK));
+        ASSERT_EQ(0, ert_createFileEventQueueActivity(
+                      &activities[ix].mActivity,
+                      mEventQueue,
+                      activities[ix].mPipe.mRdFile));
+    }
+
+    struct Ert_FileEventQueuePool  workerPool_;
+    struct Ert_FileEventQueuePool *workerPool = 0;
+
+    struct Ert_SharedLatch  workerPoolLatch;
+
+    ASSERT_EQ(0, ert_createSharedLatch(&workerPoolLatch, 0, 0));
+    workerPoolLatch_ = &workerPoolLatch;
+
+    ASSERT_EQ(0, ert_createFileEventQueuePool(&workerPool_, mEventQueue, 4));
+    workerPool = &workerPool_;
+
+    const int numEvents = 4 * ERT_NUMBEROF(activities);
+
+    eventCount_        = 0;
+    workerPoolOverlap_ = 0;
+    workerPoolEvents_  = numEvents;
+
+    for (unsigned ix = 0; ERT_NUMBEROF(activities) > ix; ++ix)
+        EXPECT_EQ(0, ert_armFileEventQueueActivityMode(
+                      &activities[ix].mActivity,
+                      Ert_FileEventQueuePollRead,
+                      Ert_FileEventQueueArmLevelTriggered,
+                      Ert_FileEventQueueActivityMethod(
+                          &activities[ix],
+                          ERT_LAMBDA(
+                              int, (struct WorkerPoolTestActivity *self_),
+                              {
+                                  if (1 != __sync_add_and_fetch(
+                                          &self_->mBusy, 1))
+                                      __sync_add_and_fetch(
+                                          &workerPoolOverlap_, 1);
+
+                                  char buf[1];
+
+                                  if (1 == ert_readFile(
+                                          self_->mPipe.mRdFile,
+                                          buf, sizeof(buf), 0) &&
+                                      workerPoolEvents_ ==
+                                          __sync_add_and_fetch(
+                                              &eventCount_, 1))
+                                      ERT_ABORT_IF(
+                                          Ert_EventLatchSettingError ==
+                                          ert_setSharedLatch(
+                                              workerPoolLatch_));
+
+                                  ert_monotonicSleep(
+                                      Ert_Duration(
+                                          ERT_NSECS(Ert_MilliSeconds(1))));
+
+                                  __sync_sub_and_fetch(&self_->mBusy, 1);
+
+                                  return 0;
+                              }))));
+
+    for (int ix = 0; numEvents > ix; ++ix)
+        EXPECT_EQ(1, ert_writeFile(
+                      activities[ix % ERT_NUMBEROF(activities)].mPipe.mWrFile,
+                      "x", 1, 0));
+
+    struct Ert_Duration timeout = Ert_Duration(ERT_NSECS(Ert_Seconds(10)));
+
+    EXPECT_EQ(1, ert_waitSharedLatch(workerPoolLatch_, &timeout));
+
+    /* Disarming does not wait for the methods that are still running,
+     * but closing the pool does. */
+
+    for (unsigned ix = 0; ERT_NUMBEROF(activities) > ix; ++ix)
+        ert_disarmFileEventQueueActivity(&activities[ix].mActivity);
+
+    workerPool = ert_closeFileEventQueuePool(workerPool);
+
+    EXPECT_EQ(numEvents, eventCount_);
+    EXPECT_EQ(0, workerPoolOverlap_);
+
+    EXPECT_FALSE(ert_closeSharedLatch(workerPoolLatch_));
+    workerPoolLatch_ = 0;
+
+    for (unsigned ix = 0; ERT_NUMBEROF(activities) > ix; ++ix)
+    {
+        EXPECT_FALSE(ert_closeFileEventQueueActivity(
+                         &activities[ix].mActivity));
+        EXPECT_FALSE(ert_closePipe(&activities[ix].mPipe));
+    }
+}
+
+TEST_F(FileEventQueueTest, WorkerPoolMethodError)
+{
+    /* A method that fails in a worker must not stop the worker, nor
+     * leave the activity without a poller. */
+
+    struct WorkerPoolTestActivity activity;
+
+    activity.mBusy = 0;
+    ASSERT_EQ(0, ert_createPipe(&activity.mPipe, O_NONBLOCK));
+    ASSERT_EQ(0, ert_createFileEventQueueActivity(
+                  &activity.mActivity,
+                  mEventQueue,
+                  activity.mPipe.mRdFile));
+
+    struct Ert_FileEventQueuePool  workerPool_;
+    struct Ert_FileEventQueuePool *workerPool = 0;
+
+    struct Ert_SharedLatch  workerPoolLatch;
+
+    ASSERT_EQ(0, ert_createSharedLatch(&workerPoolLatch, 0, 0));
+    workerPoolLatch_ = &workerPoolLatch;
+
+    ASSERT_EQ(0, ert_createFileEventQueuePool(&workerPool_, mEventQueue, 1));
+    workerPool = &workerPool_;
+
+    const int numEvents = 4;
+
+    eventCount_       = 0;
+    workerPoolEvents_ = numEvents;
+
+    EXPECT_EQ(0, ert_armFileEventQueueActivityMode(
+                  &activity.mActivity,
+                  Ert_FileEventQueuePollRead,
+                  Ert_FileEventQueueArmLevelTriggered,
+                  Ert_FileEventQueueActivityMethod(
+                      &activity,
+                      ERT_LAMBDA(
+                          int, (struct WorkerPoolTestActivity *self_),
+                          {
+                              char buf[1];
+
+                              if (1 == ert_readFile(
+                                      self_->mPipe.mRdFile,
+                                      buf, sizeof(buf), 0) &&
+                                  workerPoolEvents_ ==
+                                      __sync_add_and_fetch(&eventCount_, 1))
+                                  ERT_ABORT_IF(
+                                      Ert_EventLatchSettingError ==
+                                      ert_setSharedLatch(workerPoolLatch_));
+
+                              errno = EPERM;
+                              return -1;
+                          }))));
+
+    for (int ix = 0; numEvents > ix; ++ix)
+    {
+        EXPECT_EQ(1, ert_writeFile(activity.mPipe.mWrFile, "x", 1, 0));
+
+        ert_monotonicSleep(
+            Ert_Duration(ERT_NSECS(Ert_MilliSeconds(10))));
+    }
+
+    struct Ert_Duration timeout = Ert_Duration(ERT_NSECS(Ert_Seconds(10)));
+
+    EXPECT_EQ(1, ert_waitSharedLatch(workerPoolLatch_, &timeout));
+
+    ert_disarmFileEventQueueActivity(&activity.mActivity);
+
+    workerPool = ert_closeFileEventQueuePool(workerPool);
+
+    EXPECT_EQ(numEvents, eventCount_);
+
+    EXPECT_FALSE(ert_closeSharedLatch(workerPoolLatch_));
+    workerPoolLatch_ = 0;
+
+    EXPECT_FALSE(ert_closeFileEventQueueActivity(&activity.mActivity));
+    EXPECT_FALSE(ert_closePipe(&activity.mPipe));
+}
+
+class FileEventQueueUringTest : public FileEventQueueTest
+{
+protected:
+
+    FileEventQueueUringTest()
+    : FileEventQueueTest(Ert_FileEventQueueUringEngine)
+    { }
+
+    bool uringUnavailable()
+    {
+        /* The io_uring engine falls back to the epoll engine if io_uring
+         * is not available, in which case there is nothing to test. */
+
+        bool unavailable =
+            Ert_FileEventQueueUringEngine != mEventQueue->mEngine;
+
+        if (unavailable)
+            fprintf(stderr, "io_uring is not available\n");
+
+        return unavailable;
+    }
+};
+
+TEST_F(FileEventQueueUringTest, ArmReadyPollClose)
+{
+    if (uringUnavailable())
+        return;
+
+    /* Run the expected life cycle of the event file using the io_uring
+     * engine. */
+
+    EXPECT_EQ(0, ert_createFileEventQueueActivity(
+                  &mEventActivity_,
+                  mEventQueue,
+                  mTestSocket->mSocketPair->mParentSocket->mSocket->mFile));
+    mEventActivity = &mEventActivity_;
+
+    EXPECT_EQ(0, armTestFileQueueActivity(mEventActivity));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(1, eventCount_);
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+
+    EXPECT_EQ(0, armTestFileQueueActivity(mEventActivity));
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(1, eventCount_);
+
+    mEventActivity = ert_closeFileEventQueueActivity(mEventActivity);
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+}
+
+TEST_F(FileEventQueueUringTest, ArmCloseReady)
+{
+    if (uringUnavailable())
+        return;
+
+    /* Close an armed event file before making it ready, to verify that
+     * the outstanding poll request is discarded. */
+
+    EXPECT_EQ(0, ert_createFileEventQueueActivity(
+                  &mEventActivity_,
+                  mEventQueue,
+                  mTestSocket->mSocketPair->mParentSocket->mSocket->mFile));
+    mEventActivity = &mEventActivity_;
+
+    EXPECT_EQ(0, armTestFileQueueActivity(mEventActivity));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+
+    mEventActivity = ert_closeFileEventQueueActivity(mEventActivity);
+
+    EXPECT_EQ(0, ert_ringBellSocketPairChild(mTestSocket));
+    EXPECT_EQ(1, ert_waitUnixSocketReadReady(
+                  mTestSocket->mSocketPair->mParentSocket, 0));
+
+    eventCount_ = 0;
+    EXPECT_EQ(
+        0, ert_pollFileEventQueueActivity(mEventQueue, &Ert_ZeroDuration));
+    EXPECT_EQ(0, eventCount_);
+    EXPECT_EQ(0, mEventQueue->mNumArmed);
+}
+
+TEST_F(FileEventQueueTest, Timers)
+{
+    checkFileEventQueueTimers(mEventQueue);
+}
+
+TEST_F(FileEventQueueUringTest, Timers)
+{
+    if (uringUnavailable())
+        return;
+
+    checkFileEventQueueTimers(mEventQueue);
+}
+
 #include "_test_.h"
@@ -0,0 +1,108 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/histogram.h"
+
+#include "gtest/gtest.h"
+
+TEST(HistogramTest, Buckets)
+{
+    struct Ert_Histogram histogram;
+
+    ert_clearHistogram(&histogram);
+
+    ert_recordHistogram(&histogram, 0);
+    ert_recordHistogram(&histogram, 1);
+    ert_recordHistogram(&histogram, 2);
+    ert_recordHistogram(&histogram, 3);
+    ert_recordHistogram(&histogram, 1024);
+    ert_recordHistogram(&histogram, UINT64_MAX);
+
+    EXPECT_EQ(6u, histogram.mCount);
+    EXPECT_EQ(UINT64_MAX, histogram.mMax);
+
+    EXPECT_EQ(1u, histogram.mBuckets[0]);
+    EXPECT_EQ(1u, histogram.mBuckets[1]);
+    EXPECT_EQ(2u, histogram.mBuckets[2]);
+    EXPECT_EQ(1u, histogram.mBuckets[11]);
+    EXPECT_EQ(1u, histogram.mBuckets[ERT_HISTOGRAM_BUCKETS-1]);
+
+    EXPECT_EQ(0u,    ert_fetchHistogramBucketLimit(0));
+    EXPECT_EQ(1u,    ert_fetchHistogramBucketLimit(1));
+    EXPECT_EQ(2047u, ert_fetchHistogramBucketLimit(11));
+    EXPECT_EQ(UINT64_MAX,
+              ert_fetchHistogramBucketLimit(ERT_HISTOGRAM_BUCKETS-1));
+}
+
+TEST(HistogramTest, Percentile)
+{
+    struct Ert_Histogram histogram;
+
+    ert_clearHistogram(&histogram);
+
+    EXPECT_EQ(0u, ert_fetchHistogramPercentile(&histogram, 50));
+
+    for (unsigned ix = 0; 90 > ix; ++ix)
+        ert_recordHistogram(&histogram, 100);
+
+    for (unsigned ix = 0; 10 > ix; ++ix)
+        ert_recordHistogram(&histogram, 1000);
+
+    EXPECT_EQ(127u,  ert_fetchHistogramPercentile(&histogram, 50));
+    EXPECT_EQ(127u,  ert_fetchHistogramPercentile(&histogram, 90));
+    EXPECT_EQ(1000u, ert_fetchHistogramPercentile(&histogram, 99));
+    EXPECT_EQ(1000u, ert_fetchHistogramPercentile(&histogram, 100));
+}
+
+TEST(HistogramTest, Merge)
+{
+    struct Ert_Histogram histogram;
+    struct Ert_Histogram other;
+
+    ert_clearHistogram(&histogram);
+    ert_clearHistogram(&other);
+
+    ert_recordHistogram(&histogram, 1);
+    ert_recordHistogram(&histogram, 100);
+
+    ert_recordHistogram(&other, 100);
+    ert_recordHistogram(&other, 1000);
+
+    ert_mergeHistogram(&histogram, &other);
+
+    EXPECT_EQ(4u,    histogram.mCount);
+    EXPECT_EQ(1201u, histogram.mSum);
+    EXPECT_EQ(1000u, histogram.mMax);
+
+    EXPECT_EQ(1u, histogram.mBuckets[1]);
+    EXPECT_EQ(2u, histogram.mBuckets[7]);
+    EXPECT_EQ(1u, histogram.mBuckets[10]);
+}
+
+#include "_test_.h"
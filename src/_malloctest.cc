@@ -0,0 +1,180 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/malloc.h"
+#include "ert/process.h"
+#include "ert/timekeeping.h"
+
+#include "gtest/gtest.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t aSize);
+void  __libc_free(void *aBlock);
+}
+
+static const unsigned MallocTestBlocks_ = 64;
+static const unsigned MallocTestRounds_ = 10000;
+
+template <typename Alloc, typename Free>
+static double
+measureMalloc(Alloc aAlloc, Free aFree)
+{
+    void *blocks[MallocTestBlocks_];
+
+    struct Ert_MonotonicTime since = ert_monotonicTime();
+
+    for (unsigned ix = 0; MallocTestRounds_ > ix; ++ix)
+    {
+        for (unsigned jx = 0; MallocTestBlocks_ > jx; ++jx)
+        {
+            blocks[jx] = aAlloc(16 + jx * 8);
+            EXPECT_TRUE(blocks[jx]);
+        }
+
+        for (unsigned jx = 0; MallocTestBlocks_ > jx; ++jx)
+            aFree(blocks[jx]);
+    }
+
+    struct Ert_MonotonicTime until = ert_monotonicTime();
+
+    return (double) (until.monotonic.ns - since.monotonic.ns) /
+        (MallocTestBlocks_ * MallocTestRounds_);
+}
+
+TEST(MallocTest, Throughput)
+{
+    /* Compare the cost of each malloc() and free() pair through the
+     * signal safe allocator, when blocking signals and when deferring
+     * signals, with the underlying allocator. */
+
+    double libcNs = measureMalloc(__libc_malloc, __libc_free);
+
+    ert_deferProcessSignals(false);
+    double blockNs = measureMalloc(malloc, free);
+
+    ert_deferProcessSignals(true);
+    double deferNs = measureMalloc(malloc, free);
+
+    ert_deferProcessSignals(false);
+
+    fprintf(stderr,
+            "malloc/free ns libc %.1f block %.1f defer %.1f\n",
+            libcNs, blockNs, deferNs);
+
+    /* Timing is noisy, but deferral avoids the two system calls made
+     * to block signals around each call, so should be much cheaper. */
+
+    EXPECT_GT(blockNs, 2 * deferNs);
+}
+
+TEST(MallocTest, ForeignSignalHandler)
+{
+    /* A handler installed directly suspends deferral in the allocators
+     * until it is removed. */
+
+    ert_deferProcessSignals(true);
+
+    double deferNs = measureMalloc(malloc, free);
+
+    struct sigaction prevAction;
+    struct sigaction nextAction;
+
+    memset(&nextAction, 0, sizeof(nextAction));
+    nextAction.sa_handler = ERT_LAMBDA(void, (int aSigNum), { });
+    EXPECT_EQ(0, sigaction(SIGUSR2, &nextAction, &prevAction));
+
+    double foreignNs = measureMalloc(malloc, free);
+
+    EXPECT_EQ(0, sigaction(SIGUSR2, &prevAction, 0));
+
+    double resumeNs = measureMalloc(malloc, free);
+
+    ert_deferProcessSignals(false);
+
+    fprintf(stderr,
+            "malloc/free ns defer %.1f foreign %.1f resume %.1f\n",
+            deferNs, foreignNs, resumeNs);
+
+    EXPECT_GT(foreignNs, 2 * deferNs);
+    EXPECT_GT(foreignNs, 2 * resumeNs);
+}
+
+static ssize_t
+readFd(int aFd, void *aBuf, size_t aLen)
+{
+    ssize_t rc = -1;
+
+    while (1)
+    {
+        rc = read(aFd, aBuf, aLen);
+
+        if (-1 != rc || EINTR != errno)
+            break;
+    }
+
+    return rc;
+}
+
+TEST(MallocTest, Telemetry)
+{
+    ert_enableMallocTelemetry(1);
+
+    void *block = malloc(100);
+    EXPECT_TRUE(block);
+    free(block);
+
+    ert_disableMallocTelemetry();
+
+    int fd[2];
+    EXPECT_EQ(0, pipe(fd));
+
+    EXPECT_EQ(0, ert_printMallocTelemetry(fd[1]));
+    EXPECT_EQ(0, close(fd[1]));
+
+    char buf[65536];
+    ssize_t len = readFd(fd[0], buf, sizeof(buf)-1);
+    EXPECT_LT(0, len);
+    EXPECT_EQ(0, close(fd[0]));
+
+    buf[len > 0 ? len : 0] = 0;
+
+    EXPECT_TRUE(strstr(buf, "malloc calls "));
+    EXPECT_TRUE(strstr(buf, "free calls "));
+    EXPECT_TRUE(strstr(buf, "malloc allocated "));
+    EXPECT_TRUE(strstr(buf, "malloc sample size 100\n"));
+}
+
+#include "_test_.h"
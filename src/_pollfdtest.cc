@@ -0,0 +1,490 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/pollfd.h"
+#include "ert/pipe.h"
+#include "ert/timescale.h"
+#include "ert/timekeeping.h"
+#include "ert/macros.h"
+#include "ert/options.h"
+#include "ert/test.h"
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+
+#include <sys/poll.h>
+
+enum PollFdTestTimer
+{
+    POLLFD_TEST_TIMER_0,
+    POLLFD_TEST_TIMER_1,
+    POLLFD_TEST_TIMER_2,
+    POLLFD_TEST_TIMERS
+};
+
+static const char * const pollFdTestTimerNames_[POLLFD_TEST_TIMERS] =
+{
+    "timer0",
+    "timer1",
+    "timer2",
+};
+
+static const char * const pollFdTestFdNames_[1] =
+{
+    "fd",
+};
+
+struct PollFdTestContext
+{
+    struct Ert_PollFd              *mPollFd;
+    struct Ert_PollFdRuntimeAction  mRuntimeAction;
+    struct Ert_Pipe                *mPipe;
+    unsigned                        mRuntimeFired;
+    unsigned                        mFired[POLLFD_TEST_TIMERS];
+    enum PollFdTestTimer            mOrder[POLLFD_TEST_TIMERS];
+    unsigned                        mNumOrdered;
+};
+
+static void
+recordTimer(struct PollFdTestContext *self, enum PollFdTestTimer aTimer)
+{
+    if ( ! self->mFired[aTimer]++)
+        self->mOrder[self->mNumOrdered++] = aTimer;
+}
+
+static int
+fireTimer0(struct PollFdTestContext         *self,
+           const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_0);
+    return 0;
+}
+
+static int
+fireTimer1(struct PollFdTestContext         *self,
+           const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_1);
+    return 0;
+}
+
+static int
+fireTimer2(struct PollFdTestContext         *self,
+           const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_2);
+    return 0;
+}
+
+static int
+disarmTimer1(struct PollFdTestContext         *self,
+             const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_0);
+    ert_disarmPollFdTimerAction(self->mPollFd, POLLFD_TEST_TIMER_1);
+    return 0;
+}
+
+static int
+armTimer1(struct PollFdTestContext         *self,
+          const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_0);
+    ert_armPollFdTimerAction(
+        self->mPollFd,
+        POLLFD_TEST_TIMER_1,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1))));
+    ert_disarmPollFdTimerAction(self->mPollFd, POLLFD_TEST_TIMER_0);
+    return 0;
+}
+
+static int
+readRuntimeAction(struct PollFdTestContext         *self,
+                  const struct Ert_EventClockTime *aPollTime)
+{
+    char buf[1];
+
+    if (1 != ert_readFile(self->mPipe->mRdFile, buf, sizeof(buf), 0))
+        return -1;
+
+    ++self->mRuntimeFired;
+
+    return ert_removePollFdAction(self->mPollFd, &self->mRuntimeAction);
+}
+
+static int
+addRuntimeAction(struct PollFdTestContext         *self,
+                 const struct Ert_EventClockTime *aPollTime)
+{
+    recordTimer(self, POLLFD_TEST_TIMER_0);
+    ert_disarmPollFdTimerAction(self->mPollFd, POLLFD_TEST_TIMER_0);
+
+    if (ert_addPollFdAction(
+            self->mPollFd,
+            &self->mRuntimeAction,
+            "runtime",
+            self->mPipe->mRdFile->mFd,
+            ERT_POLL_INPUTEVENTS,
+            Ert_PollFdCallbackMethod(self, readRuntimeAction)))
+        return -1;
+
+    return 1 == ert_writeFile(self->mPipe->mWrFile, "x", 1, 0) ? 0 : -1;
+}
+
+static int
+countFdAction(struct PollFdTestContext         *self,
+              const struct Ert_EventClockTime *aPollTime)
+{
+    ++self->mRuntimeFired;
+    return 0;
+}
+
+static const unsigned fdActionRounds_ = 1000;
+
+static bool
+fdActionFiredOften(struct PollFdTestContext *self)
+{
+    return fdActionRounds_ <= self->mRuntimeFired;
+}
+
+static bool
+runtimeActionFired(struct PollFdTestContext *self)
+{
+    return self->mRuntimeFired;
+}
+
+static bool
+allTimersFired(struct PollFdTestContext *self)
+{
+    return POLLFD_TEST_TIMERS == self->mNumOrdered;
+}
+
+static bool
+timer0FiredThrice(struct PollFdTestContext *self)
+{
+    return 3 <= self->mFired[POLLFD_TEST_TIMER_0];
+}
+
+static bool
+timer1FiredTwice(struct PollFdTestContext *self)
+{
+    return 2 <= self->mFired[POLLFD_TEST_TIMER_1];
+}
+
+class PollFdTest : public ::testing::Test
+{
+    void SetUp()
+    {
+        mPoll[0].fd      = -1;
+        mPoll[0].events  = 0;
+        mPoll[0].revents = 0;
+
+        mFdActions[0].mAction = Ert_PollFdCallbackMethodNil();
+
+        for (unsigned ix = 0; ERT_NUMBEROF(mTimerActions) > ix; ++ix)
+        {
+            mTimerActions[ix].mAction = Ert_PollFdCallbackMethodNil();
+        }
+
+        mContext = PollFdTestContext();
+
+        mPollFd = 0;
+    }
+
+    void TearDown()
+    {
+        mPollFd = ert_closePollFd(mPollFd);
+    }
+
+protected:
+
+    void createPollFd(struct Ert_PollFdCompletionMethod aCompletion)
+    {
+        ASSERT_EQ(0, ert_createPollFd(
+                      &mPollFd_,
+                      mPoll,
+                      mFdActions,
+                      pollFdTestFdNames_,
+                      ERT_NUMBEROF(mFdActions),
+                      mTimerActions,
+                      pollFdTestTimerNames_,
+                      ERT_NUMBEROF(mTimerActions),
+                      aCompletion));
+        mPollFd = &mPollFd_;
+
+        mContext.mPollFd = mPollFd;
+    }
+
+    struct pollfd                mPoll[1];
+    struct Ert_PollFdAction      mFdActions[1];
+    struct Ert_PollFdTimerAction mTimerActions[POLLFD_TEST_TIMERS];
+
+    struct PollFdTestContext mContext;
+
+    struct Ert_PollFd  mPollFd_;
+    struct Ert_PollFd *mPollFd;
+};
+
+TEST_F(PollFdTest, TimerDeadlineOrder)
+{
+    /* Timers are dispatched in deadline order regardless of the order
+     * in which they are declared. */
+
+    mTimerActions[POLLFD_TEST_TIMER_0].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer0);
+
+    mTimerActions[POLLFD_TEST_TIMER_1].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer1);
+
+    mTimerActions[POLLFD_TEST_TIMER_2].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer2);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, allTimersFired));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_0,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(30))));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_1,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(10))));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_2,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(20))));
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    EXPECT_EQ(POLLFD_TEST_TIMER_1, mContext.mOrder[0]);
+    EXPECT_EQ(POLLFD_TEST_TIMER_2, mContext.mOrder[1]);
+    EXPECT_EQ(POLLFD_TEST_TIMER_0, mContext.mOrder[2]);
+}
+
+TEST_F(PollFdTest, TimerDisarm)
+{
+    /* A timer that is disarmed by another timer action must not
+     * fire subsequently. */
+
+    mTimerActions[POLLFD_TEST_TIMER_0].mAction =
+        Ert_PollFdCallbackMethod(&mContext, disarmTimer1);
+
+    mTimerActions[POLLFD_TEST_TIMER_1].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer1);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, timer0FiredThrice));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_0,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1))));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_1,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(10))));
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    EXPECT_EQ(3u, mContext.mFired[POLLFD_TEST_TIMER_0]);
+    EXPECT_EQ(0u, mContext.mFired[POLLFD_TEST_TIMER_1]);
+}
+
+TEST_F(PollFdTest, TimerArm)
+{
+    /* A timer that is armed by another timer action will fire, and
+     * a timer that disarms itself will not fire again. */
+
+    mTimerActions[POLLFD_TEST_TIMER_0].mAction =
+        Ert_PollFdCallbackMethod(&mContext, armTimer1);
+
+    mTimerActions[POLLFD_TEST_TIMER_1].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer1);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, timer1FiredTwice));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_0,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1))));
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    EXPECT_EQ(1u, mContext.mFired[POLLFD_TEST_TIMER_0]);
+    EXPECT_EQ(2u, mContext.mFired[POLLFD_TEST_TIMER_1]);
+}
+
+TEST_F(PollFdTest, RuntimeAction)
+{
+    /* An action registered at runtime is dispatched when its file
+     * descriptor becomes ready, and can remove itself. */
+
+    struct Ert_Pipe  pipe_;
+    struct Ert_Pipe *pipe = 0;
+
+    ASSERT_EQ(0, ert_createPipe(&pipe_, 0));
+    pipe = &pipe_;
+
+    mContext.mPipe = pipe;
+
+    mTimerActions[POLLFD_TEST_TIMER_0].mAction =
+        Ert_PollFdCallbackMethod(&mContext, addRuntimeAction);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, runtimeActionFired));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_0,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1))));
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    EXPECT_EQ(1u, mContext.mFired[POLLFD_TEST_TIMER_0]);
+    EXPECT_EQ(1u, mContext.mRuntimeFired);
+    EXPECT_EQ(0u, mPollFd->mRuntimeActions.mSize);
+
+    pipe = ert_closePipe(pipe);
+}
+
+TEST_F(PollFdTest, Statistics)
+{
+    /* Once enabled, the dispatch statistics for each timer record
+     * every dispatch, and timers that never fire remain empty. */
+
+    mTimerActions[POLLFD_TEST_TIMER_0].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer0);
+
+    mTimerActions[POLLFD_TEST_TIMER_1].mAction =
+        Ert_PollFdCallbackMethod(&mContext, fireTimer1);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, timer0FiredThrice));
+
+    ert_armPollFdTimerAction(
+        mPollFd,
+        POLLFD_TEST_TIMER_0,
+        Ert_Duration(ERT_NSECS(Ert_MilliSeconds(1))));
+
+    EXPECT_FALSE(ert_ownPollFdTimerActionStatistics(
+                     mPollFd, POLLFD_TEST_TIMER_0));
+
+    EXPECT_EQ(0, ert_enablePollFdStatistics(mPollFd));
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    const struct Ert_PollFdStatistics *timer0 =
+        ert_ownPollFdTimerActionStatistics(mPollFd, POLLFD_TEST_TIMER_0);
+    const struct Ert_PollFdStatistics *timer1 =
+        ert_ownPollFdTimerActionStatistics(mPollFd, POLLFD_TEST_TIMER_1);
+
+    ASSERT_TRUE(timer0);
+    ASSERT_TRUE(timer1);
+
+    EXPECT_EQ(3u, timer0->mDispatchDelay.mCount);
+    EXPECT_EQ(3u, timer0->mCallbackTime.mCount);
+    EXPECT_EQ(3u, timer0->mTimerLateness.mCount);
+
+    EXPECT_EQ(0u, timer1->mCallbackTime.mCount);
+
+    EXPECT_EQ(0u, ert_ownPollFdActionStatistics(mPollFd, 0)->
+                  mCallbackTime.mCount);
+    EXPECT_EQ(0u, ert_ownPollFdRuntimeActionStatistics(mPollFd)->
+                  mCallbackTime.mCount);
+
+    ert_clearPollFdStatistics(mPollFd);
+
+    EXPECT_EQ(0u, timer0->mCallbackTime.mCount);
+}
+
+TEST_F(PollFdTest, Overhead)
+{
+    /* Compare the cost of each iteration of the poll loop dispatching
+     * an action for a file descriptor that remains ready, with the cost
+     * of poll(2) itself. Test mode is disabled so that the loop is not
+     * slowed by race injection. Build with configure
+     * --with-debug-levels=0 to measure the loop with the debug messages
+     * compiled away. */
+
+    struct Ert_Pipe  pipe_;
+    struct Ert_Pipe *pipe = 0;
+
+    ASSERT_EQ(0, ert_createPipe(&pipe_, 0));
+    pipe = &pipe_;
+
+    ASSERT_EQ(1, ert_writeFile(pipe->mWrFile, "x", 1, 0));
+
+    mPoll[0].fd     = pipe->mRdFile->mFd;
+    mPoll[0].events = POLLIN;
+
+    unsigned optTest = gErtOptions_.mTest;
+
+    gErtOptions_.mTest = Ert_TestLevelNone;
+
+    struct Ert_MonotonicTime since = ert_monotonicTime();
+
+    for (unsigned ix = 0; fdActionRounds_ > ix; ++ix)
+        EXPECT_EQ(1, poll(mPoll, 1, -1));
+
+    struct Ert_MonotonicTime until = ert_monotonicTime();
+
+    double rawNs =
+        (double) (until.monotonic.ns - since.monotonic.ns) / fdActionRounds_;
+
+    mFdActions[0].mAction = Ert_PollFdCallbackMethod(&mContext, countFdAction);
+
+    createPollFd(Ert_PollFdCompletionMethod(&mContext, fdActionFiredOften));
+
+    since = ert_monotonicTime();
+
+    EXPECT_EQ(0, ert_runPollFdLoop(mPollFd));
+
+    until = ert_monotonicTime();
+
+    gErtOptions_.mTest = optTest;
+
+    EXPECT_EQ(fdActionRounds_, mContext.mRuntimeFired);
+
+    double loopNs =
+        (double) (until.monotonic.ns - since.monotonic.ns) /
+        mContext.mRuntimeFired;
+
+    fprintf(stderr,
+            "poll ns raw %.1f loop %.1f per iteration\n", rawNs, loopNs);
+
+    /* Timing is noisy, so only bound gross regressions in the work
+     * done by the loop on each iteration. */
+
+    EXPECT_GT(10 * rawNs, loopNs);
+
+    pipe = ert_closePipe(pipe);
+}
+
+#include "_test_.h"
@@ -29,8 +29,13 @@
 
 #include "ert/printf.h"
 
+#include "ert/timekeeping.h"
+
 #include "gtest/gtest.h"
 
+#include <stdio.h>
+#include <string.h>
+
 class PrintfTest : public ::testing::Test
 {
     void SetUp()
@@ -125,4 +130,83 @@ TEST_F(PrintfTest, PrintfMethod)
     free(bufPtr);
 }
 
+TEST_F(PrintfTest, FormatCache)
+{
+    /* A format buffer that is reused with different content must not
+     * be confused with the translation cached for its earlier content. */
+
+    TestClass test;
+
+    char fmt[64];
+    char buf[64];
+
+    strcpy(fmt, "<%" PRIs_Ert_Method ">");
+
+    for (unsigned ix = 0; 2 > ix; ++ix)
+    {
+        EXPECT_EQ(6, ert_snprintf(
+                      buf, sizeof(buf), fmt,
+                      FMTs_Ert_Method(&test, TestClass::print)));
+        EXPECT_EQ(std::string("<Test>"), buf);
+    }
+
+    strcpy(fmt, "[%" PRIs_Ert_Method "]");
+
+    EXPECT_EQ(6, ert_snprintf(
+                  buf, sizeof(buf), fmt,
+                  FMTs_Ert_Method(&test, TestClass::print)));
+    EXPECT_EQ(std::string("[Test]"), buf);
+}
+
+TEST_F(PrintfTest, Overhead)
+{
+    /* Compare the throughput of ert_snprintf() for a plain format and
+     * for a format that must be translated, with that of snprintf(). */
+
+    static const unsigned rounds = 100000;
+
+    TestClass test;
+
+    char buf[64];
+
+    struct Ert_MonotonicTime since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_LT(0, snprintf(buf, sizeof(buf), "%u %s", ix, "Test"));
+
+    struct Ert_MonotonicTime until = ert_monotonicTime();
+
+    double rawNs = (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_LT(0, ert_snprintf(buf, sizeof(buf), "%u %s", ix, "Test"));
+
+    until = ert_monotonicTime();
+
+    double plainNs = (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    since = ert_monotonicTime();
+
+    for (unsigned ix = 0; rounds > ix; ++ix)
+        EXPECT_LT(0, ert_snprintf(
+                      buf, sizeof(buf), "%u %" PRIs_Ert_Method, ix,
+                      FMTs_Ert_Method(&test, TestClass::print)));
+
+    until = ert_monotonicTime();
+
+    double methodNs =
+        (double) (until.monotonic.ns - since.monotonic.ns) / rounds;
+
+    fprintf(stderr,
+            "snprintf ns raw %.1f plain %.1f method %.1f\n",
+            rawNs, plainNs, methodNs);
+
+    /* Timing is noisy, so only bound gross regressions, such as
+     * scanning a plain format more than once on every call. */
+
+    EXPECT_GT(4 * rawNs, plainNs);
+}
+
 #include "_test_.h"
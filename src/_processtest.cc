@@ -172,6 +172,53 @@ TEST_F(ProcessTest, ProcessAppLock)
     EXPECT_FALSE(sigaction(SIGTERM, &prevAction, 0));
 }
 
+TEST_F(ProcessTest, ProcessAppLockShared)
+{
+    /* The application lock only uses the lock file once it is shared
+     * with a forked process, at which point the lock must exclude
+     * the forked process. */
+
+    struct Ert_ProcessAppLock *appLock = ert_createProcessAppLock();
+
+    const struct Ert_File *lockFile = ert_ownProcessAppLockFile(appLock);
+    EXPECT_TRUE(lockFile);
+
+    appLock = ert_destroyProcessAppLock(appLock);
+
+    int syncPipe[2];
+    EXPECT_EQ(0, pipe(syncPipe));
+
+    pid_t childPid = fork();
+    EXPECT_NE(-1, childPid);
+
+    if ( ! childPid)
+    {
+        char buf[1];
+
+        if (1 != read(syncPipe[0], buf, 1))
+            _exit(EXIT_FAILURE);
+
+        _exit(Ert_LockTypeWrite_ ==
+              ert_ownFileRegionLocked(lockFile, 0, 0).mType
+              ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    appLock = ert_createProcessAppLock();
+    {
+        EXPECT_EQ(1, write(syncPipe[1], "", 1));
+
+        int status;
+        EXPECT_EQ(0, ert_reapProcessChild(Ert_Pid(childPid), &status));
+        EXPECT_EQ(
+            EXIT_SUCCESS,
+            ert_extractProcessExitStatus(status, Ert_Pid(childPid)).mStatus);
+    }
+    appLock = ert_destroyProcessAppLock(appLock);
+
+    EXPECT_EQ(0, close(syncPipe[0]));
+    EXPECT_EQ(0, close(syncPipe[1]));
+}
+
 struct DaemonState
 {
     int mErrno;
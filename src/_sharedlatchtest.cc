@@ -0,0 +1,157 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/sharedlatch.h"
+#include "ert/process.h"
+#include "ert/timekeeping.h"
+
+#include "gtest/gtest.h"
+
+#include <unistd.h>
+
+TEST(SharedLatchTest, SetReset)
+{
+    struct Ert_SharedLatch  sharedLatch_;
+    struct Ert_SharedLatch *sharedLatch = 0;
+
+    EXPECT_EQ(0, ert_createSharedLatch(
+                  &sharedLatch_, 0, ERT_SHAREDLATCH_EVENTFD));
+    sharedLatch = &sharedLatch_;
+
+    struct Ert_Duration zeroDuration = Ert_ZeroDuration;
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_ownSharedLatchSetting(sharedLatch));
+    EXPECT_EQ(0, ert_waitSharedLatch(sharedLatch, &zeroDuration));
+    EXPECT_EQ(0, ert_waitFileReadReady(
+                  sharedLatch->mEventFile, &zeroDuration));
+
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_setSharedLatch(sharedLatch));
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_setSharedLatch(sharedLatch));
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_ownSharedLatchSetting(sharedLatch));
+    EXPECT_EQ(1, ert_waitSharedLatch(sharedLatch, 0));
+    EXPECT_EQ(1, ert_waitFileReadReady(
+                  sharedLatch->mEventFile, &zeroDuration));
+
+    EXPECT_EQ(Ert_EventLatchSettingOn,
+              ert_resetSharedLatch(sharedLatch));
+    EXPECT_EQ(Ert_EventLatchSettingOff,
+              ert_resetSharedLatch(sharedLatch));
+    EXPECT_EQ(0, ert_waitSharedLatch(sharedLatch, &zeroDuration));
+    EXPECT_EQ(0, ert_waitFileReadReady(
+                  sharedLatch->mEventFile, &zeroDuration));
+
+    sharedLatch = ert_closeSharedLatch(sharedLatch);
+}
+
+TEST(SharedLatchTest, WaitTimeout)
+{
+    struct Ert_SharedLatch  sharedLatch_;
+    struct Ert_SharedLatch *sharedLatch = 0;
+
+    EXPECT_EQ(0, ert_createSharedLatch(&sharedLatch_, 0, 0));
+    sharedLatch = &sharedLatch_;
+
+    EXPECT_EQ(0, sharedLatch->mEventFile);
+
+    struct Ert_Duration timeout = Ert_Duration(ERT_NSECS(Ert_MilliSeconds(100)));
+
+    struct Ert_EventClockTime since = ert_eventclockTime();
+    EXPECT_EQ(0, ert_waitSharedLatch(sharedLatch, &timeout));
+    struct Ert_EventClockTime until = ert_eventclockTime();
+
+    EXPECT_LE(timeout.duration.ns,
+              until.eventclock.ns - since.eventclock.ns);
+
+    sharedLatch = ert_closeSharedLatch(sharedLatch);
+}
+
+TEST(SharedLatchTest, ParentChild)
+{
+    /* The parent and child each set a latch that the other waits on,
+     * with the child waiting using the futex and the parent waiting
+     * on the eventfd. */
+
+    struct Ert_SharedLatch  parentLatch_;
+    struct Ert_SharedLatch *parentLatch = 0;
+
+    struct Ert_SharedLatch  childLatch_;
+    struct Ert_SharedLatch *childLatch = 0;
+
+    EXPECT_EQ(0, ert_createSharedLatch(&parentLatch_, 0, 0));
+    parentLatch = &parentLatch_;
+
+    EXPECT_EQ(0, ert_createSharedLatch(
+                  &childLatch_, 0, ERT_SHAREDLATCH_EVENTFD));
+    childLatch = &childLatch_;
+
+    struct Ert_Pid childPid = Ert_Pid(fork());
+
+    EXPECT_NE(-1, childPid.mPid);
+
+    if ( ! childPid.mPid)
+    {
+        for (unsigned ix = 0; 1000 > ix; ++ix)
+        {
+            if (1 != ert_waitSharedLatch(parentLatch, 0))
+                _exit(EXIT_FAILURE);
+
+            if (Ert_EventLatchSettingOn != ert_resetSharedLatch(parentLatch))
+                _exit(EXIT_FAILURE);
+
+            if (Ert_EventLatchSettingOff != ert_setSharedLatch(childLatch))
+                _exit(EXIT_FAILURE);
+        }
+
+        _exit(EXIT_SUCCESS);
+    }
+
+    for (unsigned ix = 0; 1000 > ix; ++ix)
+    {
+        EXPECT_EQ(Ert_EventLatchSettingOff,
+                  ert_setSharedLatch(parentLatch));
+
+        EXPECT_EQ(1, ert_waitFileReadReady(childLatch->mEventFile, 0));
+        EXPECT_EQ(Ert_EventLatchSettingOn,
+                  ert_resetSharedLatch(childLatch));
+    }
+
+    int status;
+    EXPECT_EQ(0, ert_reapProcessChild(childPid, &status));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    childLatch  = ert_closeSharedLatch(childLatch);
+    parentLatch = ert_closeSharedLatch(parentLatch);
+}
+
+#include "_test_.h"
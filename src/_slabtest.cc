@@ -0,0 +1,178 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/slab.h"
+#include "ert/thread.h"
+#include "ert/process.h"
+#include "ert/macros.h"
+
+#include "gtest/gtest.h"
+
+#include <string.h>
+#include <unistd.h>
+
+TEST(SlabTest, AllocFree)
+{
+    struct Ert_SlabPool  slabPool_;
+    struct Ert_SlabPool *slabPool = 0;
+
+    EXPECT_EQ(-1, ert_createSlabPool(&slabPool_, 1024 * 1024));
+    EXPECT_EQ(EINVAL, errno);
+
+    EXPECT_EQ(0, ert_createSlabPool(&slabPool_, 24));
+    slabPool = &slabPool_;
+
+    /* Allocate enough objects to require several slabs, and verify
+     * that each object is distinct and suitably aligned. */
+
+    static void *object[10000];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(object) > ix; ++ix)
+    {
+        object[ix] = ert_allocSlab(slabPool);
+        EXPECT_TRUE(object[ix]);
+        EXPECT_EQ(0u, (uintptr_t) object[ix] % ERT_SLABPOOL_ALIGN);
+
+        memset(object[ix], ix, 24);
+    }
+
+    EXPECT_LT(1u, slabPool->mNumSlabs);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(object) > ix; ++ix)
+    {
+        for (unsigned jx = 0; 24 > jx; ++jx)
+            EXPECT_EQ((unsigned char) ix, ((unsigned char *) object[ix])[jx]);
+    }
+
+    unsigned numSlabs = slabPool->mNumSlabs;
+
+    for (unsigned ix = 0; ERT_NUMBEROF(object) > ix; ++ix)
+        ert_freeSlab(slabPool, object[ix]);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(object) > ix; ++ix)
+        EXPECT_TRUE((object[ix] = ert_allocSlab(slabPool)));
+
+    EXPECT_EQ(numSlabs, slabPool->mNumSlabs);
+
+    for (unsigned ix = 0; ERT_NUMBEROF(object) > ix; ++ix)
+        ert_freeSlab(slabPool, object[ix]);
+
+    slabPool = ert_closeSlabPool(slabPool);
+}
+
+TEST(SlabTest, Threads)
+{
+    static struct Ert_SlabPool slabPool = ERT_SLABPOOL_INITIALIZER(64);
+
+    struct Ert_Thread thread[4];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_TRUE(
+            ert_createThread(
+                &thread[ix],
+                0,
+                0,
+                Ert_ThreadMethod(
+                    &slabPool,
+                    ERT_LAMBDA(
+                        int, (struct Ert_SlabPool *self_),
+                        {
+                            void *object[100];
+
+                            unsigned char tag =
+                                (unsigned char) (uintptr_t) &object;
+
+                            for (unsigned ix = 0; 1000 > ix; ++ix)
+                            {
+                                for (unsigned jx = 0;
+                                     ERT_NUMBEROF(object) > jx; ++jx)
+                                {
+                                    if ( ! (object[jx] =
+                                            ert_allocSlab(self_)))
+                                        return -1;
+
+                                    memset(object[jx], tag, 64);
+                                }
+
+                                for (unsigned jx = 0;
+                                     ERT_NUMBEROF(object) > jx; ++jx)
+                                {
+                                    for (unsigned kx = 0; 64 > kx; ++kx)
+                                    {
+                                        if (tag != ((unsigned char *)
+                                                    object[jx])[kx])
+                                            return -1;
+                                    }
+
+                                    ert_freeSlab(self_, object[jx]);
+                                }
+                            }
+
+                            return 0;
+                        }))));
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_FALSE(ert_closeThread(&thread[ix]));
+}
+
+TEST(SlabTest, Fork)
+{
+    struct Ert_SlabPool  slabPool_;
+    struct Ert_SlabPool *slabPool = 0;
+
+    EXPECT_EQ(0, ert_createSlabPool(&slabPool_, 32));
+    slabPool = &slabPool_;
+
+    void *object = ert_allocSlab(slabPool);
+    EXPECT_TRUE(object);
+
+    struct Ert_Pid childPid = Ert_Pid(fork());
+
+    EXPECT_NE(-1, childPid.mPid);
+
+    if ( ! childPid.mPid)
+    {
+        ert_freeSlab(slabPool, object);
+
+        void *childObject = ert_allocSlab(slabPool);
+
+        _exit(childObject == object ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status;
+    EXPECT_EQ(0, ert_reapProcessChild(childPid, &status));
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(EXIT_SUCCESS, WEXITSTATUS(status));
+
+    ert_freeSlab(slabPool, object);
+
+    slabPool = ert_closeSlabPool(slabPool);
+}
+
+#include "_test_.h"
@@ -0,0 +1,139 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/threadstatistics.h"
+#include "ert/thread.h"
+#include "ert/macros.h"
+
+#include "gtest/gtest.h"
+
+struct Counter
+{
+    uint64_t mCount;
+};
+
+static void
+mergeCounter(void *self_, const void *aOther_)
+{
+    struct Counter       *self   = (struct Counter *) self_;
+    const struct Counter *aOther = (const struct Counter *) aOther_;
+
+    self->mCount += aOther->mCount;
+}
+
+static struct Counter exitedCounter;
+
+static struct Ert_ThreadStatistics counterStatistics =
+    ERT_THREADSTATISTICS_INITIALIZER(&exitedCounter, mergeCounter);
+
+static __thread struct Ert_ThreadStatisticsThread counterThread;
+
+static bool
+countThread(unsigned aCount)
+{
+    for (unsigned ix = 0; aCount > ix; ++ix)
+    {
+        struct Counter *counter = (struct Counter *)
+            ert_beginThreadStatistics(&counterStatistics, &counterThread);
+
+        if ( ! counter)
+            return false;
+
+        /* Statistics cannot be recorded recursively, for example from
+         * a signal handler, while the thread is recording. */
+
+        if (ert_beginThreadStatistics(&counterStatistics, &counterThread))
+            return false;
+
+        ++counter->mCount;
+
+        ert_endThreadStatistics(&counterThread);
+    }
+
+    return true;
+}
+
+static uint64_t
+sumCounters(unsigned *aLive)
+{
+    pthread_mutex_t *lock =
+        ert_lockThreadStatistics(&counterStatistics, &counterThread);
+
+    uint64_t sum = exitedCounter.mCount;
+
+    *aLive = 0;
+
+    const struct Counter *counter = 0;
+
+    while ((counter = (const struct Counter *) ert_nextThreadStatistics(
+                &counterStatistics, counter)))
+    {
+        ++*aLive;
+        sum += counter->mCount;
+    }
+
+    lock = ert_unlockThreadStatistics(&counterThread, lock);
+
+    return sum;
+}
+
+TEST(ThreadStatisticsTest, MergeExited)
+{
+    EXPECT_TRUE(countThread(10));
+
+    struct Ert_Thread thread[4];
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_TRUE(
+            ert_createThread(
+                &thread[ix],
+                0,
+                0,
+                Ert_ThreadMethod(
+                    &thread[ix],
+                    ERT_LAMBDA(
+                        int, (struct Ert_Thread *self_),
+                        {
+                            return countThread(100) ? 0 : -1;
+                        }))));
+
+    for (unsigned ix = 0; ERT_NUMBEROF(thread) > ix; ++ix)
+        EXPECT_FALSE(ert_closeThread(&thread[ix]));
+
+    /* The blocks of the terminated threads are merged, leaving only
+     * the block of the main thread. */
+
+    unsigned live;
+
+    EXPECT_EQ(10u + 100u * ERT_NUMBEROF(thread), sumCounters(&live));
+    EXPECT_EQ(1u, live);
+    EXPECT_EQ(100u * ERT_NUMBEROF(thread), exitedCounter.mCount);
+}
+
+#include "_test_.h"
@@ -30,6 +30,8 @@
 #include "ert/thread.h"
 #include "ert/process.h"
 
+#include <signal.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <sys/mman.h>
@@ -137,6 +139,127 @@ TEST_F(ThreadTest, ThreadSigMutex)
     sigMutex = ert_destroyThreadSigMutex(sigMutex);
 }
 
+TEST_F(ThreadTest, ThreadSigMutexDefer)
+{
+    struct Ert_ThreadSigMutex  sigMutex_;
+    struct Ert_ThreadSigMutex *sigMutex = 0;
+
+    sigMutex = ert_createThreadSigMutex(&sigMutex_);
+
+    static int sigTermCount;
+
+    sigTermCount = 0;
+
+    EXPECT_EQ(0, ert_watchProcessSignals(
+                  Ert_WatchProcessSignalMethod(
+                      &sigTermCount,
+                      ERT_LAMBDA(
+                          int, (int            *self_,
+                                int             aSigNum,
+                                struct Ert_Pid  aPid,
+                                struct Ert_Uid  aUid),
+                          {
+                              if (SIGTERM == aSigNum)
+                                  ++*self_;
+                              return 0;
+                          }))));
+
+    ert_deferProcessSignals(true);
+
+    EXPECT_FALSE(raise(SIGTERM));
+    EXPECT_EQ(1, sigTermCount);
+
+    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(sigMutex);
+    {
+        // Verify that signals delivered while the lock is taken
+        // are deferred, and coalesced, until the lock is released.
+
+        EXPECT_FALSE(raise(SIGTERM));
+        EXPECT_EQ(1, sigTermCount);
+
+        struct Ert_ThreadSigMutex *relock = ert_lockThreadSigMutex(sigMutex);
+        relock = ert_unlockThreadSigMutex(relock);
+
+        EXPECT_FALSE(raise(SIGTERM));
+        EXPECT_EQ(1, sigTermCount);
+    }
+    lock = ert_unlockThreadSigMutex(lock);
+
+    EXPECT_EQ(2, sigTermCount);
+
+    EXPECT_FALSE(raise(SIGTERM));
+    EXPECT_EQ(3, sigTermCount);
+
+    ert_deferProcessSignals(false);
+
+    EXPECT_EQ(0, ert_unwatchProcessSignals());
+
+    sigMutex = ert_destroyThreadSigMutex(sigMutex);
+}
+
+static int sigRtCount_;
+
+static void
+sigRtReplay_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
+{
+    if (aSigContext)
+        ++sigRtCount_;
+}
+
+static void
+sigRtAction_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
+{
+    if ( ! ert_deferThreadSigMaskSignal_(aSigNum, aSigInfo, aSigContext))
+        ++sigRtCount_;
+}
+
+TEST_F(ThreadTest, ThreadSigMutexDeferRealTime)
+{
+    // Verify that each instance of a real-time signal delivered while
+    // the lock is taken is delivered once the lock is released.
+
+    struct Ert_ThreadSigMutex  sigMutex_;
+    struct Ert_ThreadSigMutex *sigMutex = 0;
+
+    sigMutex = ert_createThreadSigMutex(&sigMutex_);
+
+    struct sigaction prevAction;
+    struct sigaction nextAction;
+
+    memset(&nextAction, 0, sizeof(nextAction));
+    nextAction.sa_sigaction = sigRtAction_;
+    nextAction.sa_flags     = SA_SIGINFO;
+    EXPECT_FALSE(sigfillset(&nextAction.sa_mask));
+
+    EXPECT_FALSE(sigaction(SIGRTMIN, &nextAction, &prevAction));
+
+    ert_enableThreadSigMaskDefer_(sigRtReplay_);
+
+    sigRtCount_ = 0;
+
+    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(sigMutex);
+    {
+        for (int ix = 0; 3 > ix; ++ix)
+        {
+            union sigval sigValue;
+
+            sigValue.sival_int = ix;
+            EXPECT_FALSE(pthread_sigqueue(pthread_self(), SIGRTMIN, sigValue));
+        }
+
+        EXPECT_EQ(0, sigRtCount_);
+    }
+    lock = ert_unlockThreadSigMutex(lock);
+
+    EXPECT_EQ(3, sigRtCount_);
+
+    ert_enableThreadSigMaskDefer_(0);
+
+    EXPECT_FALSE(sigaction(SIGRTMIN, &prevAction, 0));
+
+    sigMutex = ert_destroyThreadSigMutex(sigMutex);
+}
+
 struct Ert_SharedMutexTestState
 {
     struct Ert_SharedMutex  mMutex_;
@@ -558,4 +558,19 @@ TEST(TimeKeepingTest, BootClockTime)
     EXPECT_GE(after.duration.ns,  bootclocktime.bootclock.ns);
 }
 
+TEST(TimeKeepingTest, TimerSlack)
+{
+    struct Ert_Duration original;
+    EXPECT_EQ(0, ert_fetchTimerSlack(&original));
+
+    struct Ert_Duration slack = Ert_Duration(ERT_NSECS(Ert_MicroSeconds(1)));
+    EXPECT_EQ(0, ert_setTimerSlack(slack));
+
+    struct Ert_Duration current;
+    EXPECT_EQ(0, ert_fetchTimerSlack(&current));
+    EXPECT_EQ(slack.duration.ns, current.duration.ns);
+
+    EXPECT_EQ(0, ert_setTimerSlack(original));
+}
+
 #include "_test_.h"
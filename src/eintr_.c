@@ -29,11 +29,17 @@
 
 #define EINTR_MODULE_DEFN_
 #include "eintr_.h"
+#include "ert/eintr.h"
 #include "ert/dl.h"
 #include "ert/error.h"
+#include "ert/printf.h"
 #include "ert/random.h"
+#include "ert/threadstatistics.h"
+#include "ert/timekeeping.h"
 
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 /* -------------------------------------------------------------------------- */
@@ -48,9 +54,15 @@ static ERT_DECLTYPE(Name_ ## _) *Name_ ## _check_ ERT_UNUSED = Name_;   \
 Return_                                                                 \
 Name_ Signature_                                                        \
 {                                                                       \
-    return                                                              \
+    uint64_t since_ = startSystemCall();                                \
+                                                                        \
+    Return_ rc_ =                                                       \
         SYSCALL_EINTR_(                                                 \
             Eintr_, Enum_, Name_, Predicate_, ## __VA_ARGS__) Args_;    \
+                                                                        \
+    stopSystemCall(Enum_, since_, (Return_) -1 == rc_);                 \
+                                                                        \
+    return rc_;                                                         \
 }                                                                       \
                                                                         \
 Return_                                                                 \
@@ -146,6 +158,115 @@ invokeSystemCall(enum SystemCallKind aKind);
 static uintptr_t
 interruptSystemCall(enum SystemCallKind aKind, const char *aErrName);
 
+/* -------------------------------------------------------------------------- */
+/* System Call Statistics
+ *
+ * Statistics are recorded by each thread using Ert_ThreadStatistics.
+ * System calls made while recording or printing statistics, for
+ * example from a signal handler, are not themselves recorded. */
+
+struct SystemCallStatistics_
+{
+    struct Ert_SystemCallStatistics mKind[SYSTEMCALL_KINDS];
+};
+
+static void
+mergeSystemCallStatistics_(
+    struct Ert_SystemCallStatistics       *self,
+    const struct Ert_SystemCallStatistics *aOther)
+{
+    self->mCalls      += aOther->mCalls;
+    self->mInterrupts += aOther->mInterrupts;
+    self->mErrors     += aOther->mErrors;
+
+    ert_mergeHistogram(&self->mLatency, &aOther->mLatency);
+}
+
+static void
+mergeSystemCallThreadStatistics_(
+    void       *self_,
+    const void *aOther_)
+{
+    struct SystemCallStatistics_       *self   = self_;
+    const struct SystemCallStatistics_ *aOther = aOther_;
+
+    for (unsigned ix = 0; SYSTEMCALL_KINDS > ix; ++ix)
+        mergeSystemCallStatistics_(&self->mKind[ix], &aOther->mKind[ix]);
+}
+
+static struct
+{
+    unsigned mEnabled;
+
+    struct SystemCallStatistics_ mExited;
+    struct Ert_ThreadStatistics  mStatistics;
+
+} systemCallStatistics_ =
+{
+    .mStatistics = ERT_THREADSTATISTICS_INITIALIZER(
+        &systemCallStatistics_.mExited, mergeSystemCallThreadStatistics_),
+};
+
+static __thread struct Ert_ThreadStatisticsThread systemCallThreadStatistics_;
+
+static void
+recordSystemCall_(
+    enum SystemCallKind aKind,
+    uint64_t            aLatency,
+    bool                aFailed,
+    int                 aErrno)
+{
+    struct SystemCallStatistics_ *self = ert_beginThreadStatistics(
+        &systemCallStatistics_.mStatistics, &systemCallThreadStatistics_);
+
+    if (self)
+    {
+        struct Ert_SystemCallStatistics *kind = &self->mKind[aKind];
+
+        ++kind->mCalls;
+
+        if (aFailed)
+        {
+            if (EINTR == aErrno)
+                ++kind->mInterrupts;
+            else
+                ++kind->mErrors;
+        }
+
+        ert_recordHistogram(&kind->mLatency, aLatency);
+
+        ert_endThreadStatistics(&systemCallThreadStatistics_);
+    }
+}
+
+static uint64_t
+startSystemCall(void)
+{
+    return
+        __builtin_expect(
+            __atomic_load_n(
+                &systemCallStatistics_.mEnabled, __ATOMIC_RELAXED), 0)
+        ? ert_monotonicTime().monotonic.ns
+        : 0;
+}
+
+static void
+stopSystemCall(enum SystemCallKind aKind, uint64_t aSince, bool aFailed)
+{
+    if (aSince)
+    {
+        int err = errno;
+
+        recordSystemCall_(
+            aKind,
+            ert_monotonicTime().monotonic.ns - aSince,
+            aFailed,
+            err);
+
+        errno = err;
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 #define SYSCALL_EINTR_(Eintr_, Kind_, Function_, Predicate_, ...)   \
     ({                                                              \
@@ -175,8 +296,12 @@ interruptSystemCall(enum SystemCallKind aKind, const char *aErrName);
     {                                                                   \
         uintptr_t syscall_ = invokeSystemCall((Kind_));                 \
                                                                         \
+        uint64_t since_ = startSystemCall();                            \
+                                                                        \
         ERT_AUTO(rc, ((ERT_DECLTYPE(Function_) *) syscall_) Args_);     \
                                                                         \
+        stopSystemCall((Kind_), since_, (ERT_DECLTYPE(rc)) -1 == rc);   \
+                                                                        \
         return rc;                                                      \
                                                                         \
     } while (0)
@@ -240,8 +365,12 @@ close_raw_(int aFd, uintptr_t aCloseAddr)
      * asynchronously and the process shall have no further ability to track
      * the completion or final status of the close operation. */
 
+    uint64_t since = startSystemCall();
+
     int rc = ((ERT_DECLTYPE(close) *) aCloseAddr)(aFd);
 
+    stopSystemCall(SYSTEMCALL_CLOSE, since, -1 == rc);
+
     rc = ! rc
         ? 0
 #ifndef POSIX_CLOSE_RESTART
@@ -318,6 +447,8 @@ fcntl_raw_(uintptr_t aFcntlAddr, int aFd, int aCmd, va_list aArgs)
 
     ERT_AUTO(fcntlp, (ERT_DECLTYPE(fcntl) *) aFcntlAddr);
 
+    uint64_t since = startSystemCall();
+
     switch (aCmd)
     {
     default:
@@ -389,6 +520,8 @@ fcntl_raw_(uintptr_t aFcntlAddr, int aFd, int aCmd, va_list aArgs)
         break;
     }
 
+    stopSystemCall(SYSTEMCALL_FCNTL, since, -1 == rc);
+
     return rc;
 }
 
@@ -455,9 +588,15 @@ local_ioctl_raw_(int aFd, EINTR_IOCTL_REQUEST_T_ aRequest, void *aArg)
 static int
 local_ioctl_(int aFd, EINTR_IOCTL_REQUEST_T_ aRequest, void *aArg)
 {
-    return
+    uint64_t since = startSystemCall();
+
+    int rc =
         SYSCALL_EINTR_(
             EINTR, SYSTEMCALL_IOCTL, ioctl, false)(aFd, aRequest, aArg);
+
+    stopSystemCall(SYSTEMCALL_IOCTL, since, -1 == rc);
+
+    return rc;
 }
 
 #define EINTR_IOCTL_DEFN_(Name_)                                \
@@ -565,9 +704,15 @@ local_open_raw_(const char *aPath, int aFlags, mode_t aMode)
 static int
 local_open_(const char *aPath, int aFlags, mode_t aMode)
 {
-    return
+    uint64_t since = startSystemCall();
+
+    int rc =
         SYSCALL_EINTR_(
             EINTR, SYSTEMCALL_OPEN, open, false)(aPath, aFlags, aMode);
+
+    stopSystemCall(SYSTEMCALL_OPEN, since, -1 == rc);
+
+    return rc;
 }
 
 #define EINTR_OPEN_DEFN_(Name_)                         \
@@ -1032,10 +1177,16 @@ interruptSystemCall(enum SystemCallKind aKind, const char *aErrName)
     uintptr_t addr = 0;
 
     if (ert_testAction(Ert_TestLevelRace) && 1 > ert_fetchRandomRange(10))
+    {
         ert_debug(0,
               "inject %s into %s",
               (aErrName ? aErrName : "EINTR"),
               sysCall->mName);
+
+        if ( ! aErrName &&
+            __atomic_load_n(&systemCallStatistics_.mEnabled, __ATOMIC_RELAXED))
+            recordSystemCall_(aKind, 0, true, EINTR);
+    }
     else
         addr = initSystemCall(sysCall);
 
@@ -1050,3 +1201,112 @@ invokeSystemCall(enum SystemCallKind aKind)
 }
 
 /* -------------------------------------------------------------------------- */
+void
+ert_enableSystemCallStatistics(void)
+{
+    __atomic_store_n(&systemCallStatistics_.mEnabled, 1, __ATOMIC_RELEASE);
+}
+
+void
+ert_disableSystemCallStatistics(void)
+{
+    __atomic_store_n(&systemCallStatistics_.mEnabled, 0, __ATOMIC_RELEASE);
+}
+
+static void
+summariseSystemCallStatistics_(
+    struct Ert_SystemCallStatistics *self,
+    enum SystemCallKind              aKind)
+{
+    *self = systemCallStatistics_.mExited.mKind[aKind];
+
+    const struct SystemCallStatistics_ *statistics = 0;
+
+    while ((statistics = ert_nextThreadStatistics(
+                &systemCallStatistics_.mStatistics, statistics)))
+        mergeSystemCallStatistics_(self, &statistics->mKind[aKind]);
+}
+
+int
+ert_fetchSystemCallStatistics(
+    const char                      *aName,
+    struct Ert_SystemCallStatistics *aStatistics)
+{
+    int rc = -1;
+
+    pthread_mutex_t *lock = ert_lockThreadStatistics(
+        &systemCallStatistics_.mStatistics, &systemCallThreadStatistics_);
+
+    unsigned kind = 0;
+
+    while (SYSTEMCALL_KINDS > kind && strcmp(aName, systemCall_[kind].mName))
+        ++kind;
+
+    ERT_ERROR_IF(
+        SYSTEMCALL_KINDS == kind,
+        {
+            errno = ENOENT;
+        });
+
+    summariseSystemCallStatistics_(aStatistics, kind);
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        lock = ert_unlockThreadStatistics(&systemCallThreadStatistics_, lock);
+    });
+
+    return rc;
+}
+
+int
+ert_printSystemCallStatistics(
+    int aFd)
+{
+    int rc = -1;
+
+    pthread_mutex_t *lock = ert_lockThreadStatistics(
+        &systemCallStatistics_.mStatistics, &systemCallThreadStatistics_);
+
+    for (unsigned ix = 0; SYSTEMCALL_KINDS > ix; ++ix)
+    {
+        struct Ert_SystemCallStatistics summary;
+
+        summariseSystemCallStatistics_(&summary, ix);
+
+        if (summary.mCalls)
+        {
+            const char *name = systemCall_[ix].mName;
+
+            ERT_ERROR_IF(
+                ert_writeFdPrintf(
+                    aFd,
+                    "%s calls %" PRIu64
+                    " interrupts %" PRIu64
+                    " errors %" PRIu64 "\n",
+                    name,
+                    summary.mCalls,
+                    summary.mInterrupts,
+                    summary.mErrors));
+
+            ERT_ERROR_IF(
+                ert_printHistogram(&summary.mLatency, aFd, name));
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        lock = ert_unlockThreadStatistics(&systemCallThreadStatistics_, lock);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
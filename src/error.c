@@ -41,7 +41,13 @@
 #include <string.h>
 #include <execinfo.h>
 
+#include <sched.h>
+
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <linux/futex.h>
 
 #include <valgrind/valgrind.h>
 
@@ -240,6 +246,176 @@ struct Ert_ErrorFrameChunk
     struct Ert_ErrorFrame  mFrame_[];
 };
 
+/* -------------------------------------------------------------------------- */
+/* Error frame chunk pool
+ *
+ * Chunks are retained in a lock-free stack that is shared by all threads.
+ * Chunks are page aligned, so the low order bits of the head of the stack
+ * are used as a generation count to avoid the ABA problem.
+ *
+ * A popping thread reads the link of the chunk at the head of the stack,
+ * and that chunk might be concurrently popped by another thread. To ensure
+ * that the link remains readable, a chunk is only unmapped when there are
+ * no threads popping the stack. Any chunk popped after the releasing
+ * thread observes no poppers is no longer reachable from the stack, so
+ * cannot be referenced by a later popper. */
+
+#define ERROR_FRAME_CHUNK_TAG_     ((uintptr_t) 4095)
+#define ERROR_FRAME_CHUNK_PREFILL_ (2 * Ert_ErrorFrameStackKinds)
+
+static struct
+{
+    uintptr_t mHead;
+    unsigned  mSize;
+    unsigned  mLimit;
+    unsigned  mPoppers;
+
+} errorFrameChunkPool_ =
+{
+    .mLimit = ERT_ERROR_FRAME_CHUNK_POOL_LIMIT,
+};
+
+static struct Ert_ErrorFrameChunk *
+popErrorFrameChunkPool_(void)
+{
+    struct Ert_ErrorFrameChunk *chunk = 0;
+
+    __atomic_add_fetch(&errorFrameChunkPool_.mPoppers, 1, __ATOMIC_SEQ_CST);
+
+    uintptr_t head =
+        __atomic_load_n(&errorFrameChunkPool_.mHead, __ATOMIC_SEQ_CST);
+
+    while ((chunk = (void *) (head & ~ERROR_FRAME_CHUNK_TAG_)))
+    {
+        uintptr_t next =
+            (uintptr_t) __atomic_load_n(
+                &chunk->mChunkList, __ATOMIC_RELAXED) |
+            ((head + 1) & ERROR_FRAME_CHUNK_TAG_);
+
+        if (__atomic_compare_exchange_n(
+                &errorFrameChunkPool_.mHead, &head, next,
+                true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        {
+            __atomic_sub_fetch(
+                &errorFrameChunkPool_.mSize, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    __atomic_sub_fetch(&errorFrameChunkPool_.mPoppers, 1, __ATOMIC_SEQ_CST);
+
+    return chunk;
+}
+
+static void
+pushErrorFrameChunkPool_(struct Ert_ErrorFrameChunk *aChunk)
+{
+    uintptr_t head =
+        __atomic_load_n(&errorFrameChunkPool_.mHead, __ATOMIC_RELAXED);
+    uintptr_t next;
+
+    __atomic_add_fetch(&errorFrameChunkPool_.mSize, 1, __ATOMIC_RELAXED);
+
+    do
+    {
+        __atomic_store_n(
+            &aChunk->mChunkList,
+            (void *) (head & ~ERROR_FRAME_CHUNK_TAG_), __ATOMIC_RELAXED);
+
+        next = (uintptr_t) aChunk | ((head + 1) & ERROR_FRAME_CHUNK_TAG_);
+    }
+    while ( ! __atomic_compare_exchange_n(
+                &errorFrameChunkPool_.mHead, &head, next,
+                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void
+releaseErrorFrameChunk_(struct Ert_ErrorFrameChunk *aChunk)
+{
+    size_t chunkSize = aChunk->mChunkSize;
+
+    VALGRIND_FREELIKE_BLOCK(aChunk, 0);
+
+    if (__atomic_load_n(&errorFrameChunkPool_.mSize, __ATOMIC_RELAXED) <
+            __atomic_load_n(&errorFrameChunkPool_.mLimit, __ATOMIC_RELAXED) ||
+        __atomic_load_n(&errorFrameChunkPool_.mPoppers, __ATOMIC_SEQ_CST))
+    {
+        pushErrorFrameChunkPool_(aChunk);
+    }
+    else
+    {
+        if (munmap(aChunk, chunkSize))
+            ert_abortProcess();
+    }
+}
+
+static size_t
+fetchErrorFrameChunkSize_(void)
+{
+    /* Do not use fetchSystemPageSize() because that might cause a recursive
+     * reference to createErrorFrameChunk_(). */
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    if (-1 == pageSize || ! pageSize)
+        ert_abortProcess();
+
+    return ERT_ROUNDUP(
+        sizeof(struct Ert_ErrorFrameChunk) +
+        sizeof(struct Ert_ErrorFrame), pageSize);
+}
+
+static struct Ert_ErrorFrameChunk *
+mapErrorFrameChunk_(void)
+{
+    /* Do not use malloc() because the the implementation in malloc_.c
+     * will cause a recursive reference to createErrorFrameChunk_(). */
+
+    size_t chunkSize = fetchErrorFrameChunkSize_();
+
+    struct Ert_ErrorFrameChunk *chunk =
+        mmap(0, chunkSize,
+             PROT_READ | PROT_WRITE,
+             MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+    if (MAP_FAILED == chunk)
+        ert_abortProcess();
+
+    if ((uintptr_t) chunk & ERROR_FRAME_CHUNK_TAG_)
+        ert_abortProcess();
+
+    chunk->mChunkSize = chunkSize;
+
+    return chunk;
+}
+
+static struct Ert_ErrorFrameChunk *
+acquireErrorFrameChunk_(void)
+{
+    struct Ert_ErrorFrameChunk *chunk = popErrorFrameChunkPool_();
+
+    if ( ! chunk)
+        chunk = mapErrorFrameChunk_();
+
+    VALGRIND_MALLOCLIKE_BLOCK(chunk, chunk->mChunkSize, 0, 0);
+
+    return chunk;
+}
+
+unsigned
+ert_setErrorFrameChunkPoolLimit(unsigned aLimit)
+{
+    return __atomic_exchange_n(
+        &errorFrameChunkPool_.mLimit, aLimit, __ATOMIC_RELAXED);
+}
+
+unsigned
+ert_ownErrorFrameChunkPoolSize_(void)
+{
+    return __atomic_load_n(&errorFrameChunkPool_.mSize, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
 static struct Ert_ErrorFrameStackPool
 {
     /* Carefully crafted so that new threads will see an initialised
@@ -276,9 +452,13 @@ static struct Ert_ErrorFrameStackPool
  * running at this time, but this cannot be guaranteed necessitating
  * the use of pthread_once(). */
 
+static void
+destroyErrorLogKey_(void *aRing_);
+
 struct Ert_ErrorDtor
 {
     pthread_key_t  mKey;
+    pthread_key_t  mLogKey;
     pthread_once_t mOnce;
 };
 
@@ -296,10 +476,7 @@ destroyErrorKey_(void *aChunk_)
     {
         struct Ert_ErrorFrameChunk *next = chunk->mChunkList;
 
-        if (munmap(chunk, chunk->mChunkSize))
-            ert_abortProcess();
-
-        VALGRIND_FREELIKE_BLOCK(chunk, 0);
+        releaseErrorFrameChunk_(chunk);
 
         chunk = next;
     }
@@ -316,6 +493,10 @@ initErrorKey_(void)
                     if (pthread_key_create(
                             &errorDtor_.mKey, destroyErrorKey_))
                         ert_abortProcess();
+
+                    if (pthread_key_create(
+                            &errorDtor_.mLogKey, destroyErrorLogKey_))
+                        ert_abortProcess();
                 })))
         ert_abortProcess();
 }
@@ -340,40 +521,16 @@ ERT_EARLY_INITIALISER(
 static struct Ert_ErrorFrameChunk *
 createErrorFrameChunk_(void)
 {
-    struct Ert_ErrorFrameChunk *self = 0;
-
-    /* Do not use fetchSystemPageSize() because that might cause a recursive
-     * reference to createErrorFrameChunk_(). */
-
-    long pageSize = sysconf(_SC_PAGESIZE);
-
-    if (-1 == pageSize || ! pageSize)
-        ert_abortProcess();
-
-    /* Do not use malloc() because the the implementation in malloc_.c
-     * will cause a recursive reference to createErrorFrameChunk_(). */
-
-    size_t chunkSize =
-        ERT_ROUNDUP(sizeof(*self) + sizeof(self->mFrame_[0]), pageSize);
-
-    self = mmap(0, chunkSize,
-                PROT_READ | PROT_WRITE,
-                MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-
-    if (MAP_FAILED == self)
-        ert_abortProcess();
-
-    VALGRIND_MALLOCLIKE_BLOCK(self, chunkSize, 0, 0);
+    struct Ert_ErrorFrameChunk *self = acquireErrorFrameChunk_();
 
     self->mChunkList = 0;
-    self->mChunkSize = chunkSize;
 
     /* Find out the number of frames that will fit in the allocated
      * space, but only use a small number during test in order to
      * exercise the frame allocator. */
 
     size_t numFrames =
-        (chunkSize - sizeof(*self)) / sizeof(self->mFrame_[0]);
+        (self->mChunkSize - sizeof(*self)) / sizeof(self->mFrame_[0]);
 
     unsigned testFrames = 2;
 
@@ -481,7 +638,7 @@ Ert_Finally:
 /* -------------------------------------------------------------------------- */
 void
 ert_addErrorFrame_(
-    const struct Ert_ErrorFrame           *self,
+    const struct Ert_ErrorFrameSite       *aSite,
     int                                    aErrno,
     const struct Ert_ErrorFrameSequenceId *aSeqId )
 {
@@ -500,10 +657,12 @@ ert_addErrorFrame_(
         iter->mFrame = chunk->mBegin;
     }
 
-    iter->mFrame[0]        = *self;
-    iter->mFrame[0].mErrno = aErrno;
-    iter->mFrame[0].mSeqId = (
-        aSeqId ? *aSeqId : ert_ownErrorFrameSequenceId());
+    iter->mFrame[0] = (struct Ert_ErrorFrame)
+    {
+        .mSite  = aSite,
+        .mErrno = aErrno,
+        .mSeqId = aSeqId ? *aSeqId : ert_ownErrorFrameSequenceId(),
+    };
 
     ++tail->mOffset;
     ++iter->mFrame;
@@ -774,7 +933,7 @@ Ert_Finally:
 
         for (unsigned sx = 0; sx < aSeqLength; ++sx)
             ert_addErrorFrame_(
-                &errorFrames[sx],
+                errorFrames[sx].mSite,
                 errorFrames[sx].mErrno,
                 &errorFrames[sx].mSeqId);
 
@@ -879,6 +1038,70 @@ Ert_Finally:
     return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+static int
+snprintErrorPrefix_(
+    char                      *aBuf,
+    size_t                     aSize,
+    struct Ert_Pid             aPid,
+    struct Ert_Tid             aTid,
+    const struct Ert_Duration *aElapsed,
+    uint64_t                   aElapsed_h,
+    uint64_t                   aElapsed_m,
+    uint64_t                   aElapsed_s,
+    uint64_t                   aElapsed_ms,
+    const char                *aFunction,
+    const char                *aFile,
+    unsigned                   aLine)
+{
+    /* Format the prefix that introduces each message line, returning
+     * the length of the prefix as snprintf() would. */
+
+    if ( ! aFile)
+        return snprintf(aBuf, aSize, "%s: ", ert_ownProcessName());
+
+    if (aPid.mPid == aTid.mTid)
+    {
+        if (aElapsed->duration.ns)
+            return snprintf(
+                aBuf, aSize,
+                "%s: [%04" PRIu64 ":%02" PRIu64
+                ":%02" PRIu64
+                ".%03" PRIu64 " %" PRId_Ert_Pid " %s %s:%u] ",
+                ert_ownProcessName(),
+                aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
+                FMTd_Ert_Pid(aPid), aFunction, aFile, aLine);
+        else
+            return snprintf(
+                aBuf, aSize,
+                "%s: [%" PRId_Ert_Pid " %s %s:%u] ",
+                ert_ownProcessName(),
+                FMTd_Ert_Pid(aPid), aFunction, aFile, aLine);
+    }
+    else
+    {
+        if (aElapsed->duration.ns)
+            return snprintf(
+                aBuf, aSize,
+                "%s: [%04" PRIu64 ":%02" PRIu64
+                ":%02" PRIu64
+                ".%03" PRIu64
+                " %" PRId_Ert_Pid
+                ":%" PRId_Ert_Tid " %s %s:%u] ",
+                ert_ownProcessName(),
+                aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
+                FMTd_Ert_Pid(aPid), FMTd_Ert_Tid(aTid),
+                aFunction, aFile, aLine);
+        else
+            return snprintf(
+                aBuf, aSize,
+                "%s: [%" PRId_Ert_Pid ":%" PRId_Ert_Tid " %s %s:%u] ",
+                ert_ownProcessName(),
+                FMTd_Ert_Pid(aPid), FMTd_Ert_Tid(aTid),
+                aFunction, aFile, aLine);
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 static void
 dprint_(
@@ -898,56 +1121,28 @@ dprint_(
     unsigned                   aLine,
     const char                *aFmt, va_list aArgs)
 {
+    int prefixLen = snprintErrorPrefix_(
+        0, 0,
+        aPid, aTid,
+        aElapsed, aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
+        aFunction, aFile, aLine);
 
-    if ( ! aFile)
-        dprintf(aFd, "%s: ", ert_ownProcessName());
-    else
+    if (0 <= prefixLen)
     {
-        if (aPid.mPid == aTid.mTid)
-        {
-            if (aElapsed->duration.ns)
-                dprintf(
-                    aFd,
-                    "%s: [%04" PRIu64 ":%02" PRIu64
-                    ":%02" PRIu64
-                    ".%03" PRIu64 " %" PRId_Ert_Pid " %s %s:%u] ",
-                    ert_ownProcessName(),
-                    aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
-                    FMTd_Ert_Pid(aPid), aFunction, aFile, aLine);
-            else
-                dprintf(
-                    aFd,
-                    "%s: [%" PRId_Ert_Pid " %s %s:%u] ",
-                    ert_ownProcessName(),
-                    FMTd_Ert_Pid(aPid), aFunction, aFile, aLine);
-        }
-        else
-        {
-            if (aElapsed->duration.ns)
-                dprintf(
-                    aFd,
-                    "%s: [%04" PRIu64 ":%02" PRIu64
-                    ":%02" PRIu64
-                    ".%03" PRIu64
-                    " %" PRId_Ert_Pid
-                    ":%" PRId_Ert_Tid " %s %s:%u] ",
-                    ert_ownProcessName(),
-                    aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
-                    FMTd_Ert_Pid(aPid), FMTd_Ert_Tid(aTid),
-                    aFunction, aFile, aLine);
-            else
-                dprintf(
-                    aFd,
-                    "%s: [%" PRId_Ert_Pid ":%" PRId_Ert_Tid " %s %s:%u] ",
-                    ert_ownProcessName(),
-                    FMTd_Ert_Pid(aPid), FMTd_Ert_Tid(aTid),
-                    aFunction, aFile, aLine);
-        }
+        char prefix[prefixLen + 1];
+
+        snprintErrorPrefix_(
+            prefix, sizeof(prefix),
+            aPid, aTid,
+            aElapsed, aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
+            aFunction, aFile, aLine);
 
-        if (EWOULDBLOCK != aLockErr)
-            dprintf(aFd, "- lock error %d - ", aLockErr);
+        dprintf(aFd, "%s", prefix);
     }
 
+    if (aFile && EWOULDBLOCK != aLockErr)
+        dprintf(aFd, "- lock error %d - ", aLockErr);
+
     ert_vdprintf(aFd, aFmt, aArgs);
     if ( ! aErrCode)
         dprintf(aFd, "\n");
@@ -986,6 +1181,434 @@ dprintf_(
     va_end(args);
 }
 
+/* -------------------------------------------------------------------------- */
+/* Asynchronous Error Log Sink
+ *
+ * When the sink is enabled, lines destined for stderr are formatted by
+ * each thread into its own single producer, single consumer ring without
+ * taking the process lock, and a writer thread gathers the contents of
+ * all the rings using writev(). Lines from each thread are written in
+ * order, but lines from different threads might be interleaved in an
+ * order that differs from the order in which they were issued.
+ *
+ * Rings are never unmapped, and are linked into a list that only grows,
+ * so that the writer and flushing threads can traverse the list without
+ * locks. A ring released by a terminating thread is reused by the next
+ * thread that issues a message.
+ *
+ * Messages issued in signal context, or by a forked child, or that are
+ * too long for the line buffer, or that do not fit in the space left
+ * in the ring, use the synchronous path after the lines queued by the
+ * thread have been written. */
+
+#define ERROR_LOG_RING_SIZE_ (16 * 1024)
+#define ERROR_LOG_LINE_SIZE_ 1024
+#define ERROR_LOG_BATCH_     32
+
+struct ErrorLogRing_
+{
+    struct ErrorLogRing_ *mNext;
+    unsigned              mOwned;
+    uint32_t              mHead;
+    uint32_t              mTail;
+    char                  mBuf[ERROR_LOG_RING_SIZE_];
+};
+
+static struct
+{
+    unsigned              mEnabled;
+    unsigned              mStop;
+    unsigned              mPending;
+    unsigned              mDraining;
+    int                   mFd;
+    pid_t                 mPid;
+    struct ErrorLogRing_ *mRings;
+    struct Ert_Thread     mThread_;
+    struct Ert_Thread    *mThread;
+} errorLog_;
+
+static __thread struct ErrorLogRing_ *errorLogRing_;
+
+static void
+destroyErrorLogKey_(void *aRing_)
+{
+    struct ErrorLogRing_ *ring = aRing_;
+
+    errorLogRing_ = 0;
+
+    __atomic_store_n(&ring->mOwned, 0, __ATOMIC_RELEASE);
+}
+
+static bool
+ownErrorLogSink_(void)
+{
+    /* The writer thread does not survive fork(), so only the process
+     * that enabled the sink can use it. */
+
+    return
+        __atomic_load_n(&errorLog_.mEnabled, __ATOMIC_ACQUIRE) &&
+        errorLog_.mPid == getpid();
+}
+
+static void
+wakeErrorLogWriter_(void)
+{
+    if ( ! __atomic_exchange_n(&errorLog_.mPending, 1, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex,
+                &errorLog_.mPending, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+}
+
+static struct ErrorLogRing_ *
+claimErrorLogRing_(void)
+{
+    struct ErrorLogRing_ *ring = errorLogRing_;
+
+    if ( ! ring)
+    {
+        for (ring = __atomic_load_n(&errorLog_.mRings, __ATOMIC_ACQUIRE);
+             ring;
+             ring = ring->mNext)
+        {
+            unsigned owned = 0;
+
+            if (__atomic_compare_exchange_n(
+                    &ring->mOwned, &owned, 1,
+                    false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+        }
+
+        if ( ! ring)
+        {
+            /* Do not use malloc() because the implementation in malloc_.c
+             * might issue diagnostics. */
+
+            ring = mmap(0, sizeof(*ring),
+                        PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+            if (MAP_FAILED == ring)
+                return 0;
+
+            ring->mOwned = 1;
+            ring->mNext  = __atomic_load_n(&errorLog_.mRings, __ATOMIC_RELAXED);
+
+            while ( ! __atomic_compare_exchange_n(
+                        &errorLog_.mRings, &ring->mNext, ring,
+                        true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+                continue;
+        }
+
+        initErrorKey_();
+
+        if (pthread_setspecific(errorDtor_.mLogKey, ring))
+            ert_abortProcess();
+
+        errorLogRing_ = ring;
+    }
+
+    return ring;
+}
+
+static bool
+appendErrorLog_(const char *aBuf, size_t aLen)
+{
+    struct ErrorLogRing_ *ring = claimErrorLogRing_();
+
+    if ( ! ring)
+        return false;
+
+    uint32_t head = ring->mHead;
+
+    /* Rather than wait for the writer to make space, have the caller
+     * write the line directly after draining the queued lines. */
+
+    if (ERROR_LOG_RING_SIZE_ -
+        (head - __atomic_load_n(&ring->mTail, __ATOMIC_ACQUIRE)) < aLen)
+        return false;
+
+    size_t offset = head % ERROR_LOG_RING_SIZE_;
+    size_t first  = ERROR_LOG_RING_SIZE_ - offset;
+
+    if (first > aLen)
+        first = aLen;
+
+    memcpy(&ring->mBuf[offset], aBuf, first);
+    memcpy(&ring->mBuf[0], aBuf + first, aLen - first);
+
+    __atomic_store_n(&ring->mHead, head + aLen, __ATOMIC_RELEASE);
+
+    wakeErrorLogWriter_();
+
+    return true;
+}
+
+static size_t
+drainErrorLogBatch_(struct ErrorLogRing_ **aRing)
+{
+    struct ErrorLogRing_ *ring[ERROR_LOG_BATCH_];
+    struct iovec          iov[2 * ERROR_LOG_BATCH_];
+    uint32_t              len[ERROR_LOG_BATCH_];
+
+    unsigned numRings = 0;
+    unsigned numIov   = 0;
+    size_t   total    = 0;
+
+    for ( ; *aRing && ERROR_LOG_BATCH_ > numRings; *aRing = (*aRing)->mNext)
+    {
+        uint32_t tail = (*aRing)->mTail;
+        uint32_t size =
+            __atomic_load_n(&(*aRing)->mHead, __ATOMIC_ACQUIRE) - tail;
+
+        if (size)
+        {
+            size_t offset = tail % ERROR_LOG_RING_SIZE_;
+            size_t first  = ERROR_LOG_RING_SIZE_ - offset;
+
+            if (first > size)
+                first = size;
+
+            iov[numIov++] = (struct iovec) {
+                .iov_base = &(*aRing)->mBuf[offset], .iov_len = first };
+
+            if (size - first)
+                iov[numIov++] = (struct iovec) {
+                    .iov_base = &(*aRing)->mBuf[0], .iov_len = size - first };
+
+            ring[numRings] = *aRing;
+            len[numRings]  = size;
+
+            ++numRings;
+            total += size;
+        }
+    }
+
+    if (total)
+    {
+        ssize_t wrote;
+
+        do
+            wrote = writev(errorLog_.mFd, iov, numIov);
+        while (-1 == wrote && EINTR == errno);
+
+        /* If the output cannot be written, discard it rather than
+         * block the threads issuing messages. */
+
+        size_t written = -1 == wrote ? total : wrote;
+
+        for (unsigned ix = 0; numRings > ix && written; ++ix)
+        {
+            uint32_t advance = len[ix] < written ? len[ix] : written;
+
+            __atomic_store_n(
+                &ring[ix]->mTail, ring[ix]->mTail + advance, __ATOMIC_RELEASE);
+
+            written -= advance;
+        }
+    }
+
+    return total;
+}
+
+static bool
+flushErrorLog_(unsigned aAttempts)
+{
+    /* Only one thread can drain the rings at a time. When called to
+     * terminate the process, make only a bounded number of attempts in
+     * case the thread draining the rings is itself unable to proceed. */
+
+    while (__atomic_exchange_n(&errorLog_.mDraining, 1, __ATOMIC_ACQUIRE))
+    {
+        if (aAttempts && ! --aAttempts)
+            return false;
+
+        sched_yield();
+    }
+
+    bool drained;
+
+    do
+    {
+        drained = true;
+
+        struct ErrorLogRing_ *ring =
+            __atomic_load_n(&errorLog_.mRings, __ATOMIC_ACQUIRE);
+
+        while (ring)
+        {
+            if (drainErrorLogBatch_(&ring))
+                drained = false;
+        }
+
+    } while ( ! drained);
+
+    __atomic_store_n(&errorLog_.mDraining, 0, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static void
+drainErrorLogRing_(void)
+{
+    /* Before a line from this thread is written synchronously, write
+     * any lines still queued in its ring so that the synchronous line
+     * does not overtake them. The number of attempts is bounded because
+     * this might run in signal context, and the interrupted code might
+     * itself be draining the rings. */
+
+    struct ErrorLogRing_ *ring = errorLogRing_;
+
+    if (ring && errorLog_.mPid == getpid())
+    {
+        if (__atomic_load_n(&ring->mTail, __ATOMIC_ACQUIRE) !=
+            __atomic_load_n(&ring->mHead, __ATOMIC_ACQUIRE))
+        {
+            flushErrorLog_(1000);
+        }
+    }
+}
+
+static int
+runErrorLogWriter_(void *self_)
+{
+    while ( ! __atomic_load_n(&errorLog_.mStop, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&errorLog_.mPending, 0, __ATOMIC_SEQ_CST);
+
+        flushErrorLog_(0);
+
+        struct timespec timeout = { .tv_sec = 1 };
+
+        syscall(SYS_futex,
+                &errorLog_.mPending, FUTEX_WAIT_PRIVATE, 0, &timeout, 0, 0);
+    }
+
+    flushErrorLog_(0);
+
+    return 0;
+}
+
+int
+ert_enableErrorLogSink(void)
+{
+    int rc = -1;
+
+    ert_ensure( ! errorLog_.mThread);
+
+    errorLog_.mFd   = STDERR_FILENO;
+    errorLog_.mPid  = getpid();
+    errorLog_.mStop = 0;
+
+    /* The method outlives this stack frame, so construct it directly
+     * rather than using a trampoline. */
+
+    ERT_ERROR_UNLESS(
+        (errorLog_.mThread = ert_createThread(
+            &errorLog_.mThread_,
+            "errorlog",
+            0,
+            Ert_ThreadMethod_(&errorLog_, runErrorLogWriter_))));
+
+    __atomic_store_n(&errorLog_.mEnabled, 1, __ATOMIC_RELEASE);
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+int
+ert_disableErrorLogSink(void)
+{
+    int rc = -1;
+
+    if (errorLog_.mThread)
+    {
+        __atomic_store_n(&errorLog_.mEnabled, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&errorLog_.mStop, 1, __ATOMIC_RELEASE);
+
+        __atomic_store_n(&errorLog_.mPending, 0, __ATOMIC_SEQ_CST);
+        wakeErrorLogWriter_();
+
+        struct Ert_Thread *thread = errorLog_.mThread;
+
+        errorLog_.mThread = 0;
+
+        ERT_ERROR_IF(
+            ert_closeThread(thread));
+
+        flushErrorLog_(0);
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+void
+ert_flushErrorLogSink(void)
+{
+    if (errorLog_.mPid == getpid())
+        flushErrorLog_(1000);
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+snprintErrorLine_(
+    char                      *aBuf,
+    size_t                     aSize,
+    int                        aErrCode,
+    const char                *aErrText,
+    struct Ert_Pid             aPid,
+    struct Ert_Tid             aTid,
+    const struct Ert_Duration *aElapsed,
+    uint64_t                   aElapsed_h,
+    uint64_t                   aElapsed_m,
+    uint64_t                   aElapsed_s,
+    uint64_t                   aElapsed_ms,
+    const char                *aFunction,
+    const char                *aFile,
+    unsigned                   aLine,
+    const char                *aFmt, va_list aArgs)
+{
+    size_t len = 0;
+    int    printed;
+
+#define SNPRINTF_(Printf_, ...)                                    \
+    do                                                              \
+    {                                                               \
+        printed = Printf_(&aBuf[len], aSize - len, __VA_ARGS__);    \
+        if (0 > printed || aSize - len <= printed)                  \
+            return -1;                                              \
+        len += printed;                                             \
+    } while (0)
+
+    SNPRINTF_(
+        snprintErrorPrefix_,
+        aPid, aTid,
+        aElapsed, aElapsed_h, aElapsed_m, aElapsed_s, aElapsed_ms,
+        aFunction, aFile, aLine);
+
+    SNPRINTF_(ert_vsnprintf, aFmt, aArgs);
+
+    if ( ! aErrCode)
+        SNPRINTF_(snprintf, "\n");
+    else if (aErrText)
+        SNPRINTF_(snprintf, " - errno %d [%s]\n", aErrCode, aErrText);
+    else
+        SNPRINTF_(snprintf, " - errno %d\n", aErrCode);
+
+#undef SNPRINTF_
+
+    return len;
+}
+
 /* -------------------------------------------------------------------------- */
 static struct {
     char  *mBuf;
@@ -1026,27 +1649,6 @@ print_(
         struct Ert_Pid pid = ert_ownProcessId();
         struct Ert_Tid tid = ert_ownThreadId();
 
-        /* The availability of buffered IO might be lost while a message
-         * is being processed since this code might run in a thread
-         * that continues to execute while the process is being shut down. */
-
-        int  lockerr;
-        bool locked;
-        bool buffered;
-
-        if (ert_acquireProcessAppLock())
-        {
-            lockerr  = errno ? errno : EPERM;
-            locked   = false;
-            buffered = false;
-        }
-        else
-        {
-            lockerr  = EWOULDBLOCK;
-            locked   = true;
-            buffered = !! printBuf_.mFile;
-        }
-
         struct Ert_Duration elapsed = ert_ownProcessElapsedTime();
 
         uint64_t elapsed_ms = ERT_MSECS(elapsed.duration).ms;
@@ -1081,110 +1683,137 @@ print_(
                 errText = errTextMsg;
         }
 
-        if ( ! buffered)
+        /* Prefer the asynchronous sink if it is available, and only
+         * take the process lock if the message must be written
+         * synchronously. */
+
+        bool queued = false;
+
+        if (STDERR_FILENO == errfd &&
+            ownErrorLogSink_() &&
+            ! ert_ownProcessSignalContext())
         {
-            /* Note that there is an old defect which causes dprintf()
-             * to race with fork():
-             *
-             *    https://sourceware.org/bugzilla/show_bug.cgi?id=12847
-             *
-             * The symptom is that the child process will terminate with
-             * SIGSEGV in fresetlockfiles(). */
-
-            dprint_(errfd,
-                    lockerr,
-                    aErrCode, errText,
-                    pid, tid,
-                    &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
-                    aFunction, aFile, aLine,
-                    aFmt, aArgs);
+            char line[ERROR_LOG_LINE_SIZE_];
+
+            va_list args;
+
+            va_copy(args, aArgs);
+            int lineLen = snprintErrorLine_(
+                line, sizeof(line),
+                aErrCode, errText,
+                pid, tid,
+                &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
+                aFunction, aFile, aLine,
+                aFmt, args);
+            va_end(args);
+
+            queued = 0 < lineLen && appendErrorLog_(line, lineLen);
         }
-        else
+
+        if ( ! queued)
         {
-            rewind(printBuf_.mFile);
+            drainErrorLogRing_();
 
-            if ( ! aFile)
-                fprintf(printBuf_.mFile, "%s: ", ert_ownProcessName());
+            /* The availability of buffered IO might be lost while a
+             * message is being processed since this code might run in a
+             * thread that continues to execute while the process is being
+             * shut down. */
+
+            int  lockerr;
+            bool locked;
+            bool buffered;
+
+            if (ert_acquireProcessAppLock())
+            {
+                lockerr  = errno ? errno : EPERM;
+                locked   = false;
+                buffered = false;
+            }
             else
             {
-                if (pid.mPid == tid.mTid)
-                {
-                    if (elapsed.duration.ns)
-                        fprintf(
-                            printBuf_.mFile,
-                            "%s: [%04" PRIu64 ":%02" PRIu64
-                            ":%02" PRIu64
-                            ".%03" PRIu64 " %" PRId_Ert_Pid " %s %s:%u] ",
-                            ert_ownProcessName(),
-                            elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
-                            FMTd_Ert_Pid(pid), aFunction, aFile, aLine);
-                    else
-                        fprintf(
-                            printBuf_.mFile,
-                            "%s: [%" PRId_Ert_Pid " %s %s:%u] ",
-                            ert_ownProcessName(),
-                            FMTd_Ert_Pid(pid), aFunction, aFile, aLine);
-                }
-                else
-                {
-                    if (elapsed.duration.ns)
-                        fprintf(
-                            printBuf_.mFile,
-                            "%s: [%04" PRIu64 ":%02" PRIu64
-                            ":%02" PRIu64
-                            ".%03" PRIu64 " %" PRId_Ert_Pid
-                            ":%" PRId_Ert_Tid " "
-                            "%s %s:%u] ",
-                            ert_ownProcessName(),
-                            elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
-                            FMTd_Ert_Pid(pid), FMTd_Ert_Tid(tid),
-                            aFunction, aFile, aLine);
-                    else
-                        fprintf(
-                            printBuf_.mFile,
-                            "%s: [%" PRId_Ert_Pid
-                            ":%" PRId_Ert_Tid " %s %s:%u] ",
-                            ert_ownProcessName(),
-                            FMTd_Ert_Pid(pid), FMTd_Ert_Tid(tid),
-                            aFunction, aFile, aLine);
-                }
+                lockerr  = EWOULDBLOCK;
+                locked   = true;
+                buffered = !! printBuf_.mFile;
             }
 
-            ert_vfprintf(printBuf_.mFile, aFmt, aArgs);
-            if ( ! aErrCode)
-                fprintf(printBuf_.mFile, "\n");
-            else if (errText)
-                fprintf(
-                    printBuf_.mFile, " - errno %d [%s]\n", aErrCode, errText);
+            if ( ! buffered)
+            {
+                /* Note that there is an old defect which causes dprintf()
+                 * to race with fork():
+                 *
+                 *    https://sourceware.org/bugzilla/show_bug.cgi?id=12847
+                 *
+                 * The symptom is that the child process will terminate with
+                 * SIGSEGV in fresetlockfiles(). */
+
+                dprint_(errfd,
+                        lockerr,
+                        aErrCode, errText,
+                        pid, tid,
+                        &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
+                        aFunction, aFile, aLine,
+                        aFmt, aArgs);
+            }
             else
-                fprintf(printBuf_.mFile, " - errno %d\n", aErrCode);
-            fflush(printBuf_.mFile);
-
-            /* Use writeFdRaw() rather than writeFd() to avoid having
-             * EINTR error injection cause diagnostic messages to
-             * be issued recursively. This avoids the message log being
-             * unsightly with EINTR messages grafted into the middle of
-             * message lines, and also EINTR messages with later timestamps
-             * printed before messages with earlier timestamps. */
-
-            if (printBuf_.mSize != ert_writeFdRaw(errfd,
-                                                  printBuf_.mBuf,
-                                                  printBuf_.mSize, 0))
-                ert_abortProcess();
-        }
-
-        if (locked)
-        {
-            if (ert_releaseProcessAppLock())
             {
-                dprintf_(
-                    errfd,
-                    errno, 0,
+                rewind(printBuf_.mFile);
+
+                int prefixLen = snprintErrorPrefix_(
+                    0, 0,
                     pid, tid,
                     &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
-                    __func__, __FILE__, __LINE__,
-                    "Unable to release process lock");
-                ert_abortProcess();
+                    aFunction, aFile, aLine);
+
+                if (0 <= prefixLen)
+                {
+                    char prefix[prefixLen + 1];
+
+                    snprintErrorPrefix_(
+                        prefix, sizeof(prefix),
+                        pid, tid,
+                        &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
+                        aFunction, aFile, aLine);
+
+                    fputs(prefix, printBuf_.mFile);
+                }
+
+                ert_vfprintf(printBuf_.mFile, aFmt, aArgs);
+                if ( ! aErrCode)
+                    fprintf(printBuf_.mFile, "\n");
+                else if (errText)
+                    fprintf(
+                        printBuf_.mFile,
+                        " - errno %d [%s]\n", aErrCode, errText);
+                else
+                    fprintf(printBuf_.mFile, " - errno %d\n", aErrCode);
+                fflush(printBuf_.mFile);
+
+                /* Use writeFdRaw() rather than writeFd() to avoid having
+                 * EINTR error injection cause diagnostic messages to
+                 * be issued recursively. This avoids the message log being
+                 * unsightly with EINTR messages grafted into the middle of
+                 * message lines, and also EINTR messages with later timestamps
+                 * printed before messages with earlier timestamps. */
+
+                if (printBuf_.mSize != ert_writeFdRaw(errfd,
+                                                      printBuf_.mBuf,
+                                                      printBuf_.mSize, 0))
+                    ert_abortProcess();
+            }
+
+            if (locked)
+            {
+                if (ert_releaseProcessAppLock())
+                {
+                    dprintf_(
+                        errfd,
+                        errno, 0,
+                        pid, tid,
+                        &elapsed, elapsed_h, elapsed_m, elapsed_s, elapsed_ms,
+                        __func__, __FILE__, __LINE__,
+                        "Unable to release process lock");
+                    ert_abortProcess();
+                }
             }
         }
     });
@@ -1453,13 +2082,13 @@ ert_logErrorFrameSequence(
                 ert_errorWarn_(
                     self->mFileDescriptor,
                     aFramePtr->mErrno,
-                    aFramePtr->mName,
-                    aFramePtr->mFile,
-                    aFramePtr->mLine,
+                    aFramePtr->mSite->mName,
+                    aFramePtr->mSite->mFile,
+                    aFramePtr->mSite->mLine,
                     "%" PRIs_Ert_ErrorFrameSequenceId " Error frame %u - %s",
                     FMTs_Ert_ErrorFrameSequenceId(aFramePtr->mSeqId),
                     aFrameOffset,
-                    aFramePtr->mText);
+                    aFramePtr->mSite->mText);
 
                 return 0;
             }));
@@ -1597,6 +2226,20 @@ Ert_Error_init(struct Ert_ErrorModule *self)
         appLock = ert_createProcessAppLock();
 
         printBuf_.mFile = file;
+
+        /* Populate the pool so that the first threads created will
+         * not need to map their error frame chunks. */
+
+        unsigned prefill = ERROR_FRAME_CHUNK_PREFILL_;
+
+        if (prefill > errorFrameChunkPool_.mLimit)
+            prefill = errorFrameChunkPool_.mLimit;
+
+        for (unsigned ix = ert_ownErrorFrameChunkPoolSize_();
+             prefill > ix; ++ix)
+        {
+            pushErrorFrameChunkPool_(mapErrorFrameChunk_());
+        }
     }
 
     ++moduleInit_;
@@ -0,0 +1,75 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_EINTR_H
+#define ERT_EINTR_H
+
+#include "ert/compiler.h"
+#include "ert/histogram.h"
+
+ERT_BEGIN_C_SCOPE;
+
+/* -------------------------------------------------------------------------- */
+/* System call statistics
+ *
+ * The system calls interposed by the library can optionally count
+ * calls, calls that were interrupted, calls that failed for any other
+ * reason, and the distribution of the latency of each call in
+ * nanoseconds. Statistics are recorded in each thread, and are
+ * disabled by default so that they cost only a test of a flag in each
+ * system call while disabled. */
+
+struct Ert_SystemCallStatistics
+{
+    uint64_t mCalls;
+    uint64_t mInterrupts;
+    uint64_t mErrors;
+
+    struct Ert_Histogram mLatency;
+};
+
+void
+ert_enableSystemCallStatistics(void);
+
+void
+ert_disableSystemCallStatistics(void);
+
+ERT_CHECKED int
+ert_fetchSystemCallStatistics(
+    const char                      *aName,
+    struct Ert_SystemCallStatistics *aStatistics);
+
+ERT_CHECKED int
+ert_printSystemCallStatistics(
+    int aFd);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_EINTR_H */
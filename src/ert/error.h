@@ -87,20 +87,20 @@ ert_errorAssert_(const char *aPredicate, const char *aFile, unsigned aLine);
         const void *ert_finally_                         \
         __attribute__((__unused__)) = 0;                 \
                                                          \
-        struct Ert_ErrorFrame frame_ =                   \
-            ERT_ERRORFRAME_INIT( (Message_) );           \
+        static const struct Ert_ErrorFrameSite site_ =   \
+            ERT_ERRORFRAMESITE_INIT( (Message_) );       \
                                                          \
         /* Activation of a new error frame implies       \
          * a new stack unwinding sequence. */            \
                                                          \
         ert_restartErrorFrameSequence_();                \
                                                          \
-        if (ert_testFinally(&frame_) ||                  \
+        if (ert_testFinally(&site_) ||                   \
             Sense_ (Predicate_))                         \
         {                                                \
             __VA_ARGS__                                  \
                                                          \
-            ert_addErrorFrame_(&frame_, errno, 0);       \
+            ert_addErrorFrame_(&site_, errno, 0);        \
             goto Ert_Error_;                             \
         }                                                \
                                                          \
@@ -257,19 +257,27 @@ struct Ert_ErrorFrameSequenceId
     unsigned       mSeqIndex;
 };
 
-struct Ert_ErrorFrame
+/* The constant description of each error site is emitted statically
+ * so that a recorded error frame need only refer to it. */
+
+struct Ert_ErrorFrameSite
 {
     const char *mFile;
     unsigned    mLine;
     const char *mName;
     const char *mText;
-    int         mErrno;
+};
+
+#define ERT_ERRORFRAMESITE_INIT(aText) { __FILE__, __LINE__, __func__, aText }
+
+struct Ert_ErrorFrame
+{
+    const struct Ert_ErrorFrameSite *mSite;
+    int                              mErrno;
 
     struct Ert_ErrorFrameSequenceId mSeqId;
 };
 
-#define ERT_ERRORFRAME_INIT(aText) { __FILE__, __LINE__, __func__, aText }
-
 struct Ert_ErrorFrameChunk;
 
 struct Ert_ErrorFrameIter
@@ -321,7 +329,7 @@ struct Ert_ErrorFileDescriptor
 /* -------------------------------------------------------------------------- */
 void
 ert_addErrorFrame_(
-    const struct Ert_ErrorFrame           *aFrame,
+    const struct Ert_ErrorFrameSite       *aSite,
     int                                    aErrno,
     const struct Ert_ErrorFrameSequenceId *aSeqId);
 
@@ -357,6 +365,38 @@ ert_popErrorFrameSequence(struct Ert_ErrorFrameSequence aSequence);
 enum Ert_ErrorFrameStackKind
 ert_switchErrorFrameStack(enum Ert_ErrorFrameStackKind aStack);
 
+/* -------------------------------------------------------------------------- */
+/* Error frame chunk pool
+ *
+ * Error frame chunks released by terminating threads are retained in
+ * a process wide pool for reuse, up to a high water mark beyond which
+ * they are returned to the system. Return the previous high water mark. */
+
+#define ERT_ERROR_FRAME_CHUNK_POOL_LIMIT 64
+
+unsigned
+ert_setErrorFrameChunkPoolLimit(unsigned aLimit);
+
+unsigned
+ert_ownErrorFrameChunkPoolSize_(void);
+
+/* -------------------------------------------------------------------------- */
+/* Asynchronous error log sink
+ *
+ * Messages written to stderr by ert_errorWarn(), ert_errorMessage() and
+ * ert_debug() are queued and written by a dedicated thread instead of
+ * being serialised by the process lock. The sink is flushed by
+ * ert_abortProcess() and ert_exitProcess(). */
+
+ERT_CHECKED int
+ert_enableErrorLogSink(void);
+
+ERT_CHECKED int
+ert_disableErrorLogSink(void);
+
+void
+ert_flushErrorLogSink(void);
+
 /* -------------------------------------------------------------------------- */
 #ifndef __cplusplus
 #define ert_breadcrumb Ert_Error_breadcrumb_
@@ -367,8 +407,19 @@ ert_switchErrorFrameStack(enum Ert_ErrorFrameStackKind aStack);
 #define Ert_Error_breadcrumb_() \
     ert_errorDebug(__func__, __FILE__, __LINE__, ".")
 
+/* Debug levels at or above ERT_DEBUG_LEVELS, for example as configured
+ * using configure --with-debug-levels, are compiled away together with
+ * the evaluation of their arguments. Otherwise the level is checked
+ * against gErtOptions_.mDebug before any arguments are evaluated. */
+
+#ifdef ERT_DEBUG_LEVELS
+#define Ert_Error_debuglevel_(aLevel)                   \
+    ((aLevel) < (ERT_DEBUG_LEVELS) &&                   \
+     __builtin_expect((aLevel) < gErtOptions_.mDebug, 0))
+#else
 #define Ert_Error_debuglevel_(aLevel) \
-    ((aLevel) < gErtOptions_.mDebug)
+    (__builtin_expect((aLevel) < gErtOptions_.mDebug, 0))
+#endif
 
 #define Ert_Error_debug_(aLevel, ...)                                    \
     do                                                                   \
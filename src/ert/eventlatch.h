@@ -34,6 +34,7 @@
 #include "ert/method.h"
 #include "ert/queue.h"
 
+#include <stdbool.h>
 #include <stdio.h>
 
 /* -------------------------------------------------------------------------- */
@@ -74,11 +75,18 @@ ERT_BEGIN_C_SCOPE;
 struct Ert_EventPipe;
 struct Ert_EventLatch;
 
+/* Each event pipe has a ready list of the latches that have been
+ * signalled, so that polling the event pipe only visits these latches.
+ * mReady indicates that the entry is on the ready list, and mReadyNext
+ * links the entries in the ready list. */
+
 struct Ert_EventLatchListEntry
 {
     struct Ert_EventLatch              *mLatch;
     struct Ert_EventLatchMethod         mMethod;
     LIST_ENTRY(Ert_EventLatchListEntry) mEntry;
+    struct Ert_EventLatchListEntry     *mReadyNext;
+    bool                                mReady;
 };
 
 struct Ert_EventLatchList
@@ -86,11 +94,19 @@ struct Ert_EventLatchList
     LIST_HEAD(, Ert_EventLatchListEntry) mList;
 };
 
+/* The state of the latch in mEvent is changed atomically, so that the
+ * latch can be set and reset without taking the mutex. The mutex
+ * serialises binding and unbinding the event pipe, and disabling the
+ * latch. Setting the latch signals the event pipe outside the mutex,
+ * so mSignalling counts the signals in flight, and unbinding waits for
+ * these to drain before the event pipe is released. */
+
 struct Ert_EventLatch
 {
     struct Ert_ThreadSigMutex       mMutex_;
     struct Ert_ThreadSigMutex      *mMutex;
     unsigned                        mEvent;
+    unsigned                        mSignalling;
     struct Ert_EventPipe           *mPipe;
     char                           *mName;
     struct Ert_EventLatchListEntry  mList;
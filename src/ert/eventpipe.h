@@ -39,16 +39,35 @@
 
 ERT_BEGIN_C_SCOPE;
 
+/* By default, an event pipe is signalled using a pipe(2). Specify
+ * ERT_EVENTPIPE_EVENTFD to use an eventfd(2) instead, which requires
+ * only one file descriptor, and no pipe buffer. In either case, mFile
+ * becomes readable when the event pipe is signalled. */
+
+#define ERT_EVENTPIPE_EVENTFD 0x80000000u
+
+/* The mutex serialises polling the event pipe, and the latch list.
+ * Signalling and resetting the event pipe only take the signal mutex,
+ * which is never held while latches are polled, so that a latch can
+ * always signal the event pipe promptly. */
+
 struct Ert_EventPipe
 {
     struct Ert_ThreadSigMutex  mMutex_;
     struct Ert_ThreadSigMutex *mMutex;
+    struct Ert_ThreadSigMutex  mSignalMutex_;
+    struct Ert_ThreadSigMutex *mSignalMutex;
     struct Ert_Pipe            mPipe_;
     struct Ert_Pipe           *mPipe;
+    struct Ert_File            mEventFile_;
+    struct Ert_File           *mEventFile;
+    struct Ert_File           *mFile;
     bool                       mSignalled;
 
     struct Ert_EventLatchList   mLatchList_;
     struct Ert_EventLatchList  *mLatchList;
+
+    struct Ert_EventLatchListEntry *mReadyList;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -85,6 +104,11 @@ ert_detachEventPipeLatch_(
     struct Ert_EventPipe           *self,
     struct Ert_EventLatchListEntry *aEntry);
 
+void
+ert_readyEventPipeLatch_(
+    struct Ert_EventPipe           *self,
+    struct Ert_EventLatchListEntry *aEntry);
+
 /* -------------------------------------------------------------------------- */
 
 ERT_END_C_SCOPE;
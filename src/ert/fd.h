@@ -41,6 +41,8 @@ struct Ert_Deadline;
 struct Ert_Duration;
 struct Ert_FdSet;
 
+struct pollfd;
+
 /* -------------------------------------------------------------------------- */
 struct Ert_LockType
 {
@@ -202,6 +204,12 @@ struct Ert_LockType
 ert_ownFdRegionLocked(
     int aFd, off_t aPos, off_t aLen);
 
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_pollFds(
+    struct pollfd *aPollFds, size_t aNumFds,
+    const struct Ert_Duration *aTimeout);
+
 /* -------------------------------------------------------------------------- */
 ERT_CHECKED int
 ert_waitFdWriteReady(
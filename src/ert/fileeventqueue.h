@@ -32,6 +32,12 @@
 #include "ert/compiler.h"
 #include "ert/file.h"
 #include "ert/method.h"
+#include "ert/histogram.h"
+#include "ert/timekeeping.h"
+#include "ert/pipe.h"
+#include "ert/thread.h"
+
+#include <stdbool.h>
 
 /* -------------------------------------------------------------------------- */
 ERT_BEGIN_C_SCOPE;
@@ -66,7 +72,23 @@ ERT_END_C_SCOPE;
 /* -------------------------------------------------------------------------- */
 ERT_BEGIN_C_SCOPE;
 
+struct Ert_Deadline;
 struct Ert_Duration;
+struct Ert_FileEventQueuePool;
+struct Ert_FileEventQueueUring;
+struct Ert_FileEventQueueTimers;
+
+/* The epoll(7) engine is the default. The io_uring(7) engine batches
+ * the arming and disarming of activities together with the wait for
+ * events into a single system call, but is only used if the kernel
+ * supports it. Otherwise the queue falls back to the epoll(7) engine,
+ * and mEngine records the engine that was actually selected. */
+
+enum Ert_FileEventQueueEngine
+{
+    Ert_FileEventQueueEpollEngine,
+    Ert_FileEventQueueUringEngine,
+};
 
 enum Ert_FileEventQueuePollTrigger
 {
@@ -76,16 +98,51 @@ enum Ert_FileEventQueuePollTrigger
     Ert_FileEventQueuePollTriggers,
 };
 
+/* A one-shot activity is disarmed when it fires, and must be armed
+ * again to receive the next event. A persistent activity remains
+ * armed across events until it is explicitly disarmed or closed, and
+ * can be either level-triggered or edge-triggered. */
+
+enum Ert_FileEventQueueArmMode
+{
+    Ert_FileEventQueueArmOneShot,
+    Ert_FileEventQueueArmLevelTriggered,
+    Ert_FileEventQueueArmEdgeTriggered,
+};
+
 /* -------------------------------------------------------------------------- */
+/* The event buffer starts at the size requested when the queue is
+ * created. It is doubled after a poll fills it, and halved after a
+ * sustained run of polls that use no more than a quarter of it, but
+ * is never made smaller than the requested size. The occupancy
+ * histogram records the number of events returned by each poll. */
+
+struct Ert_FileEventQueueStatistics
+{
+    struct Ert_Histogram mOccupancy;
+    uint64_t             mFullPolls;
+    unsigned             mGrowths;
+    unsigned             mShrinks;
+};
+
 struct Ert_FileEventQueue
 {
-    struct Ert_File     mFile_;
-    struct Ert_File    *mFile;
-    struct epoll_event *mQueue;
-    int                 mQueueSize;
-    int                 mQueuePending;
-    int                 mNumArmed;
-    int                 mNumPending;
+    enum Ert_FileEventQueueEngine    mEngine;
+    struct Ert_File                  mFile_;
+    struct Ert_File                 *mFile;
+    struct Ert_FileEventQueueUring  *mUring;
+    struct Ert_FileEventQueueTimers *mTimers;
+    struct Ert_FileEventQueuePool   *mPool;
+    struct epoll_event              *mQueue;
+    int                              mQueueSize;
+    int                              mQueueMinSize;
+    int                              mQueueResize;
+    int                              mQueueIdlePolls;
+    int                              mQueuePending;
+    int                              mNumArmed;
+    int                              mNumPending;
+
+    struct Ert_FileEventQueueStatistics mStatistics;
 };
 
 struct Ert_FileEventQueueActivity
@@ -94,15 +151,69 @@ struct Ert_FileEventQueueActivity
     struct Ert_File                        *mFile;
     struct epoll_event                     *mPending;
     unsigned                                mArmed;
+    enum Ert_FileEventQueueArmMode          mArmMode;
+    unsigned                                mUringSlot;
+    bool                                   *mDispatching;
     struct Ert_FileEventQueueActivityMethod mMethod;
 };
 
+/* -------------------------------------------------------------------------- */
+/* Timers are dispatched by the queue using the same method signature
+ * as activities. All the timers of a queue share a single timerfd(2),
+ * which is only reprogrammed when the earliest deadline changes, so
+ * arming and disarming a timer usually requires no system call. Timers
+ * are one-shot, and are disarmed before their method is called. */
+
+struct Ert_FileEventQueueTimer
+{
+    struct Ert_FileEventQueue              *mQueue;
+    struct Ert_MonotonicTime                mDeadline;
+    uint64_t                                mSequence;
+    size_t                                  mHeapIndex;
+    bool                                    mArmed;
+    struct Ert_FileEventQueueActivityMethod mMethod;
+};
+
+/* -------------------------------------------------------------------------- */
+/* A worker pool dispatches the activities of a queue using several
+ * threads that all wait on the same epoll(7) instance, so that a slow
+ * method only stalls the worker that is running it. Each worker takes
+ * one event at a time, and all activities are registered using
+ * EPOLLONESHOT so that an event is delivered to only one worker, and
+ * an activity is never dispatched concurrently with itself. Persistent
+ * activities are enabled again after their methods return.
+ *
+ * The pool must be created and closed while no activities are armed.
+ * While the pool is running, an activity can be armed or disarmed from
+ * any thread, and an event that was delivered before the activity was
+ * disarmed is discarded. Disarming does not wait for a method that is
+ * already running. An activity must only be closed by its own method,
+ * or after the pool is closed. The pool requires the epoll(7) engine,
+ * and the queue must not be polled directly while the pool is running. */
+
+struct Ert_FileEventQueuePool
+{
+    struct Ert_FileEventQueue *mQueue;
+    pthread_mutex_t            mMutex_;
+    pthread_mutex_t           *mMutex;
+    struct Ert_Pipe            mStopPipe_;
+    struct Ert_Pipe           *mStopPipe;
+    struct Ert_Thread         *mThreads;
+    unsigned                   mNumThreads;
+};
+
 /* -------------------------------------------------------------------------- */
 ERT_CHECKED int
 ert_createFileEventQueue(
     struct Ert_FileEventQueue *self,
     int                        aQueueSize);
 
+ERT_CHECKED int
+ert_createFileEventQueueEngine(
+    struct Ert_FileEventQueue     *self,
+    int                            aQueueSize,
+    enum Ert_FileEventQueueEngine  aEngine);
+
 ERT_CHECKED struct Ert_FileEventQueue *
 ert_closeFileEventQueue(
     struct Ert_FileEventQueue *self);
@@ -112,6 +223,10 @@ ert_pollFileEventQueueActivity(
     struct Ert_FileEventQueue *self,
     const struct Ert_Duration *aTimeout);
 
+const struct Ert_FileEventQueueStatistics *
+ert_ownFileEventQueueStatistics(
+    const struct Ert_FileEventQueue *self);
+
 /* -------------------------------------------------------------------------- */
 ERT_CHECKED int
 ert_createFileEventQueueActivity(
@@ -125,10 +240,58 @@ ert_armFileEventQueueActivity(
     enum Ert_FileEventQueuePollTrigger      aTrigger,
     struct Ert_FileEventQueueActivityMethod aMethod);
 
+ERT_CHECKED int
+ert_armFileEventQueueActivityMode(
+    struct Ert_FileEventQueueActivity      *self,
+    enum Ert_FileEventQueuePollTrigger      aTrigger,
+    enum Ert_FileEventQueueArmMode          aMode,
+    struct Ert_FileEventQueueActivityMethod aMethod);
+
+void
+ert_disarmFileEventQueueActivity(
+    struct Ert_FileEventQueueActivity *self);
+
 ERT_CHECKED struct Ert_FileEventQueueActivity *
 ert_closeFileEventQueueActivity(
     struct Ert_FileEventQueueActivity *self);
 
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_createFileEventQueueTimer(
+    struct Ert_FileEventQueueTimer *self,
+    struct Ert_FileEventQueue      *aQueue);
+
+ERT_CHECKED int
+ert_armFileEventQueueTimer(
+    struct Ert_FileEventQueueTimer         *self,
+    struct Ert_Duration                     aTimeout,
+    struct Ert_FileEventQueueActivityMethod aMethod);
+
+ERT_CHECKED int
+ert_armFileEventQueueTimerDeadline(
+    struct Ert_FileEventQueueTimer         *self,
+    const struct Ert_Deadline              *aDeadline,
+    struct Ert_FileEventQueueActivityMethod aMethod);
+
+void
+ert_disarmFileEventQueueTimer(
+    struct Ert_FileEventQueueTimer *self);
+
+ERT_CHECKED struct Ert_FileEventQueueTimer *
+ert_closeFileEventQueueTimer(
+    struct Ert_FileEventQueueTimer *self);
+
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_createFileEventQueuePool(
+    struct Ert_FileEventQueuePool *self,
+    struct Ert_FileEventQueue     *aQueue,
+    unsigned                       aNumThreads);
+
+ERT_CHECKED struct Ert_FileEventQueuePool *
+ert_closeFileEventQueuePool(
+    struct Ert_FileEventQueuePool *self);
+
 /* -------------------------------------------------------------------------- */
 
 ERT_END_C_SCOPE;
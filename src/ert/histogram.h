@@ -0,0 +1,90 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_HISTOGRAM_H
+#define ERT_HISTOGRAM_H
+
+#include "ert/compiler.h"
+
+#include <stdint.h>
+
+/* -------------------------------------------------------------------------- */
+ERT_BEGIN_C_SCOPE;
+
+/* -------------------------------------------------------------------------- */
+/* Histograms are bucketed logarithmically so that recording a sample
+ * is cheap, and so that a small fixed number of buckets can span a
+ * wide range of values. Bucket zero counts samples with value zero,
+ * and bucket n counts samples in the range [2^(n-1), 2^n). The last
+ * bucket also counts all the samples that are larger. */
+
+#define ERT_HISTOGRAM_BUCKETS 48
+
+struct Ert_Histogram
+{
+    uint64_t mCount;
+    uint64_t mSum;
+    uint64_t mMax;
+    uint64_t mBuckets[ERT_HISTOGRAM_BUCKETS];
+};
+
+/* -------------------------------------------------------------------------- */
+void
+ert_clearHistogram(
+    struct Ert_Histogram *self);
+
+void
+ert_recordHistogram(
+    struct Ert_Histogram *self,
+    uint64_t              aValue);
+
+void
+ert_mergeHistogram(
+    struct Ert_Histogram       *self,
+    const struct Ert_Histogram *aOther);
+
+ERT_CHECKED uint64_t
+ert_fetchHistogramBucketLimit(
+    unsigned aBucket);
+
+ERT_CHECKED uint64_t
+ert_fetchHistogramPercentile(
+    const struct Ert_Histogram *self,
+    unsigned                    aPercentile);
+
+ERT_CHECKED int
+ert_printHistogram(
+    const struct Ert_Histogram *self,
+    int                         aFd,
+    const char                 *aName);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_HISTOGRAM_H */
@@ -0,0 +1,61 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_MALLOC_H
+#define ERT_MALLOC_H
+
+#include "ert/compiler.h"
+
+ERT_BEGIN_C_SCOPE;
+
+/* -------------------------------------------------------------------------- */
+/* Allocation telemetry
+ *
+ * The allocators interposed by the library can optionally count calls,
+ * bytes allocated and freed, and the distribution of allocation sizes,
+ * in each thread. If aSampleInterval is non-zero, the call stack of
+ * every aSampleInterval-th allocation in each thread is also sampled.
+ * Telemetry is disabled by default, and costs only a test of a flag
+ * in each allocator call while disabled. */
+
+void
+ert_enableMallocTelemetry(
+    unsigned aSampleInterval);
+
+void
+ert_disableMallocTelemetry(void);
+
+ERT_CHECKED int
+ert_printMallocTelemetry(
+    int aFd);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_MALLOC_H */
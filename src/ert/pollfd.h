@@ -32,6 +32,8 @@
 #include "ert/compiler.h"
 #include "ert/timekeeping.h"
 #include "ert/method.h"
+#include "ert/file.h"
+#include "ert/histogram.h"
 
 #include <stdbool.h>
 #include <limits.h>
@@ -95,6 +97,7 @@
 ERT_BEGIN_C_SCOPE;
 
 struct pollfd;
+struct epoll_event;
 
 /* -------------------------------------------------------------------------- */
 struct Ert_PollFdAction
@@ -102,23 +105,63 @@ struct Ert_PollFdAction
     struct Ert_PollFdCallbackMethod mAction;
 };
 
+/* Timer actions are kept in a binary heap ordered by deadline, so the
+ * period and mark time are private to the poll loop. Each timer is
+ * disarmed when the poll loop is created. Use ert_armPollFdTimerAction()
+ * and ert_disarmPollFdTimerAction() to change the period of a timer,
+ * and ert_rearmPollFdTimerAction() to restart its period. */
+
 struct Ert_PollFdTimerAction
 {
     struct Ert_PollFdCallbackMethod mAction;
-    struct Ert_Duration             mPeriod;
-    struct Ert_EventClockTime       mSince;
+    struct Ert_Duration             mPeriod_;
+    struct Ert_EventClockTime       mSince_;
+};
+
+/* Runtime actions are registered with ert_addPollFdAction() and
+ * are monitored using epoll(7) so that the cost of dispatching them
+ * is proportional to the number that are ready, rather than the
+ * number that are registered. The storage is owned by the caller
+ * and must remain valid until ert_removePollFdAction(). */
+
+struct Ert_PollFdRuntimeAction
+{
+    struct Ert_PollFdCallbackMethod  mAction;
+    const char                      *mName;
+    struct Ert_PollFd               *mPollFd;
+    struct epoll_event              *mPending;
+    int                              mFd;
+    unsigned                         mEvents;
+    unsigned                         mRevents;
+};
+
+/* Dispatch statistics are only collected once enabled using
+ * ert_enablePollFdStatistics(). All times are measured in nanoseconds
+ * using the event clock. The dispatch delay is measured from the time
+ * that the poll returned, and the timer lateness is measured from the
+ * timer deadline, to the time that the callback is invoked. Runtime
+ * actions are accumulated together into a single set of statistics. */
+
+struct Ert_PollFdStatistics
+{
+    struct Ert_Histogram mDispatchDelay;
+    struct Ert_Histogram mCallbackTime;
+    struct Ert_Histogram mTimerLateness;
 };
 
 struct Ert_PollFd
 {
     struct pollfd                     *mPoll;
+    struct pollfd                     *mPollFds;
     struct Ert_PollFdCompletionMethod  mCompletionQuery;
 
     struct
     {
-        struct Ert_PollFdAction *mActions;
-        const char * const      *mNames;
-        size_t                   mSize;
+        struct Ert_PollFdAction     *mActions;
+        const char * const          *mNames;
+        size_t                       mSize;
+
+        struct Ert_PollFdStatistics *mStatistics;
     } mFdActions;
 
     struct
@@ -126,7 +169,24 @@ struct Ert_PollFd
         struct Ert_PollFdTimerAction *mActions;
         const char * const           *mNames;
         size_t                        mSize;
+
+        size_t                       *mQueue;
+        size_t                       *mQueueIndex;
+        size_t                        mQueueSize;
+
+        struct Ert_PollFdStatistics  *mStatistics;
     } mTimerActions;
+
+    struct
+    {
+        struct Ert_File              mFile_;
+        struct Ert_File             *mFile;
+        struct epoll_event          *mQueue;
+        size_t                       mQueueSize;
+        size_t                       mSize;
+
+        struct Ert_PollFdStatistics *mStatistics;
+    } mRuntimeActions;
 };
 
 struct Ert_PollEventText
@@ -170,6 +230,66 @@ ERT_CHECKED struct Ert_PollFd *
 ert_closePollFd(
     struct Ert_PollFd *self);
 
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_addPollFdAction(
+    struct Ert_PollFd               *self,
+    struct Ert_PollFdRuntimeAction  *aAction,
+    const char                      *aName,
+    int                              aFd,
+    unsigned                         aEvents,
+    struct Ert_PollFdCallbackMethod  aMethod);
+
+ERT_CHECKED int
+ert_removePollFdAction(
+    struct Ert_PollFd              *self,
+    struct Ert_PollFdRuntimeAction *aAction);
+
+/* -------------------------------------------------------------------------- */
+void
+ert_armPollFdTimerAction(
+    struct Ert_PollFd   *self,
+    size_t               aTimer,
+    struct Ert_Duration  aPeriod);
+
+void
+ert_rearmPollFdTimerAction(
+    struct Ert_PollFd *self,
+    size_t             aTimer);
+
+void
+ert_disarmPollFdTimerAction(
+    struct Ert_PollFd *self,
+    size_t             aTimer);
+
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_enablePollFdStatistics(
+    struct Ert_PollFd *self);
+
+void
+ert_clearPollFdStatistics(
+    struct Ert_PollFd *self);
+
+const struct Ert_PollFdStatistics *
+ert_ownPollFdActionStatistics(
+    const struct Ert_PollFd *self,
+    size_t                   aAction);
+
+const struct Ert_PollFdStatistics *
+ert_ownPollFdTimerActionStatistics(
+    const struct Ert_PollFd *self,
+    size_t                   aTimer);
+
+const struct Ert_PollFdStatistics *
+ert_ownPollFdRuntimeActionStatistics(
+    const struct Ert_PollFd *self);
+
+ERT_CHECKED int
+ert_printPollFdStatistics(
+    const struct Ert_PollFd *self,
+    int                      aFd);
+
 /* -------------------------------------------------------------------------- */
 const char *
 ert_createPollEventText(
@@ -125,6 +125,10 @@ Ert_PrintfMethodPtr_(const struct Ert_PrintfMethod &aMethod)
     })
 
 /* -------------------------------------------------------------------------- */
+/* A format that uses PRIs_Ert_Method is translated once, and the
+ * translation is cached against the address of the format, so such
+ * formats must be string literals. */
+
 #define PRIs_Ert_Method "%%p<struct Ert_PrintfMethod>%%"
 #define FMTs_Ert_Method(Object_, Method_) ( \
         Ert_PrintfMethod((Object_), (Method_)) )
@@ -146,6 +150,14 @@ int
 ert_dprintf(int aFd, const char *aFmt, ...)
     __attribute__ ((__format__(__printf__, 2, 3)));
 
+/* Format the output into a buffer, and write the buffer to the file
+ * descriptor. Unlike dprintf(3), this does not race with fork(2), and
+ * retries writes that are interrupted. */
+
+ERT_CHECKED int
+ert_writeFdPrintf(int aFd, const char *aFmt, ...)
+    __attribute__ ((__format__(__printf__, 2, 3)));
+
 /* -------------------------------------------------------------------------- */
 int
 ert_vfprintf(FILE *aFile, const char *aFmt, va_list);
@@ -335,6 +335,20 @@ ert_purgeProcessOrphanedFds(void);
 unsigned
 ert_ownProcessSignalContext(void);
 
+/* Defer the delivery of signals to critical sections protected by
+ * Ert_ThreadSigMutex, and to the allocators, instead of blocking signals
+ * on entry to each critical section. This avoids two pthread_sigmask()
+ * system calls for each critical section, but is only safe while all
+ * signal handlers are installed through this library, because only those
+ * handlers check for, and defer signals within, critical sections. So
+ * deferral is suspended while any handler installed directly using
+ * sigaction(2), or the signal(3) family, remains installed. Signals that
+ * are still deferred when deferral is disabled are raised again when the
+ * critical section ends. */
+
+void
+ert_deferProcessSignals(bool aDefer);
+
 ERT_CHECKED int
 ert_watchProcessChildren(struct Ert_WatchProcessMethod aMethod);
 
@@ -0,0 +1,109 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_SHAREDLATCH_H
+#define ERT_SHAREDLATCH_H
+
+#include "ert/compiler.h"
+#include "ert/eventlatch.h"
+#include "ert/file.h"
+
+ERT_BEGIN_C_SCOPE;
+
+struct Ert_Duration;
+
+/* A shared latch is an event latch that can be set and reset from
+ * several processes. The setting is held in a futex word that is
+ * placed in memory shared between the processes, either a MAP_SHARED
+ * region or a memfd, so that setting the latch requires only an atomic
+ * exchange, and waking waiters only when there are any.
+ *
+ * Create the latch before forking the processes that use it, so that
+ * each process inherits a handle to the shared state. If the latch is
+ * created with ERT_SHAREDLATCH_EVENTFD, an eventfd(2) becomes readable
+ * when the latch is set, so that the latch can also be monitored using
+ * Ert_PollFd or Ert_FileEventQueue. Remember to include mEventFile in
+ * the whitelist of file descriptors retained by ert_forkProcessChild(). */
+
+#define ERT_SHAREDLATCH_EVENTFD 0x80000000u
+
+struct Ert_SharedLatchState
+{
+    int      mWord;
+    unsigned mWaiters;
+};
+
+struct Ert_SharedLatch
+{
+    struct Ert_SharedLatchState *mState;
+    struct Ert_SharedLatchState *mMap;
+    struct Ert_File              mEventFile_;
+    struct Ert_File             *mEventFile;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Create a shared latch using the state at aState, which must be in
+ * memory shared with the other processes. If aState is null, the state
+ * is placed in an anonymous shared mapping that is inherited across
+ * fork(). */
+
+ERT_CHECKED int
+ert_createSharedLatch(
+    struct Ert_SharedLatch      *self,
+    struct Ert_SharedLatchState *aState,
+    unsigned                     aFlags);
+
+ERT_CHECKED struct Ert_SharedLatch *
+ert_closeSharedLatch(
+    struct Ert_SharedLatch *self);
+
+ERT_CHECKED enum Ert_EventLatchSetting
+ert_setSharedLatch(
+    struct Ert_SharedLatch *self);
+
+ERT_CHECKED enum Ert_EventLatchSetting
+ert_resetSharedLatch(
+    struct Ert_SharedLatch *self);
+
+ERT_CHECKED enum Ert_EventLatchSetting
+ert_ownSharedLatchSetting(
+    const struct Ert_SharedLatch *self);
+
+/* Wait for the latch to be set, returning 1 if the latch is set, or 0
+ * if the timeout expires first. Waiting does not reset the latch. */
+
+ERT_CHECKED int
+ert_waitSharedLatch(
+    struct Ert_SharedLatch    *self,
+    const struct Ert_Duration *aTimeout);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_SHAREDLATCH_H */
@@ -0,0 +1,97 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_SLAB_H
+#define ERT_SLAB_H
+
+#include "ert/compiler.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+ERT_BEGIN_C_SCOPE;
+
+/* A slab pool is a cache of fixed size objects, carved from slabs that
+ * are mapped directly using mmap(2). Allocating and freeing objects
+ * uses neither locks nor signal masking, so that objects can be
+ * allocated and freed in signal handlers, and in the child after
+ * fork(2).
+ *
+ * Free objects are kept in a lock-free list shared by all threads,
+ * fronted by a magazine of objects in each thread. Objects held in
+ * the magazine of a terminating thread are returned to the shared
+ * list. Slabs are only released when the pool is closed.
+ *
+ * Pools with static storage duration can be initialised using
+ * ERT_SLABPOOL_INITIALIZER(), and need never be closed. */
+
+#define ERT_SLABPOOL_SLABS 256
+
+#define ERT_SLABPOOL_ALIGN 16
+
+#define ERT_SLABPOOL_SIZE_(Size_) \
+    (((Size_) + ERT_SLABPOOL_ALIGN - 1) & ~ (size_t) (ERT_SLABPOOL_ALIGN - 1))
+
+#define ERT_SLABPOOL_INITIALIZER(Size_)                 \
+{                                                       \
+    .mSize = ERT_SLABPOOL_SIZE_((Size_) ? (Size_) : 1), \
+}
+
+struct Ert_SlabPool
+{
+    size_t   mSize;
+    uint64_t mRegistration;
+    uint64_t mFreeList;
+    unsigned mNumSlabs;
+    void    *mSlabs[ERT_SLABPOOL_SLABS];
+};
+
+/* -------------------------------------------------------------------------- */
+ERT_CHECKED int
+ert_createSlabPool(
+    struct Ert_SlabPool *self,
+    size_t               aSize);
+
+ERT_CHECKED struct Ert_SlabPool *
+ert_closeSlabPool(
+    struct Ert_SlabPool *self);
+
+ERT_CHECKED void *
+ert_allocSlab(
+    struct Ert_SlabPool *self);
+
+void
+ert_freeSlab(
+    struct Ert_SlabPool *self,
+    void                *aObject);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_SLAB_H */
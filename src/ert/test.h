@@ -30,13 +30,14 @@
 #define ERT_TEST_H
 
 #include "ert/compiler.h"
+#include "ert/options.h"
 
 #include <inttypes.h>
 #include <stdbool.h>
 
 ERT_BEGIN_C_SCOPE;
 
-struct Ert_ErrorFrame;
+struct Ert_ErrorFrameSite;
 
 struct Ert_TestModule
 {
@@ -62,17 +63,80 @@ enum Ert_TestLevel
 };
 
 /* -------------------------------------------------------------------------- */
-bool
-ert_testSleep(enum Ert_TestLevel aLevel);
+/* Test Hooks
+ *
+ * The hooks are placed on the success paths of production code, so each
+ * is reduced to a predicted false branch on a global, and only calls out
+ * of line when test mode, or error injection, has been enabled. Defining
+ * ERT_NTEST, for example using configure --disable-test-hooks, removes
+ * the hooks entirely. */
+
+struct Ert_TestState;
+
+extern struct Ert_TestState *gErtTestState_;
 
 bool
-ert_testAction(enum Ert_TestLevel aLevel);
+ert_testSleep_(enum Ert_TestLevel aLevel);
 
 bool
-ert_testMode(enum Ert_TestLevel aLevel);
+ert_testAction_(enum Ert_TestLevel aLevel);
 
 bool
-ert_testFinally(const struct Ert_ErrorFrame *aFrame);
+ert_testFinally_(const struct Ert_ErrorFrameSite *aSite);
+
+#ifdef ERT_NTEST
+
+static inline bool
+ert_testMode(enum Ert_TestLevel aLevel)
+{
+    return false;
+}
+
+static inline bool
+ert_testAction(enum Ert_TestLevel aLevel)
+{
+    return false;
+}
+
+static inline bool
+ert_testSleep(enum Ert_TestLevel aLevel)
+{
+    return false;
+}
+
+static inline bool
+ert_testFinally(const struct Ert_ErrorFrameSite *aSite)
+{
+    return false;
+}
+
+#else
+
+static inline bool
+ert_testMode(enum Ert_TestLevel aLevel)
+{
+    return __builtin_expect(aLevel <= gErtOptions_.mTest, 0);
+}
+
+static inline bool
+ert_testAction(enum Ert_TestLevel aLevel)
+{
+    return ert_testMode(aLevel) && ert_testAction_(aLevel);
+}
+
+static inline bool
+ert_testSleep(enum Ert_TestLevel aLevel)
+{
+    return ert_testMode(aLevel) && ert_testSleep_(aLevel);
+}
+
+static inline bool
+ert_testFinally(const struct Ert_ErrorFrameSite *aSite)
+{
+    return __builtin_expect( !! gErtTestState_, 0) && ert_testFinally_(aSite);
+}
+
+#endif
 
 uint64_t
 ert_testErrorLevel(void);
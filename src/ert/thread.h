@@ -146,13 +146,22 @@ struct Ert_Tid;
 struct Ert_ThreadSigMask
 {
     sigset_t mSigSet;
+    bool     mDeferred;
 };
 
+/* Use Ert_ThreadSigMaskDefer to exclude the delivery of all signals
+ * within a critical section. When signal deferral is enabled, this
+ * only increments a per-thread counter, and signals delivered through
+ * the dispatchers installed by the library are queued and replayed
+ * when the outermost critical section ends. Otherwise this is the same
+ * as Ert_ThreadSigMaskBlock with all signals. */
+
 enum Ert_ThreadSigMaskAction
 {
     Ert_ThreadSigMaskUnblock = -1,
     Ert_ThreadSigMaskSet     =  0,
     Ert_ThreadSigMaskBlock   = +1,
+    Ert_ThreadSigMaskDefer   = +2,
 };
 
 struct Ert_ThreadSigMutex
@@ -408,6 +417,23 @@ ERT_CHECKED int
 ert_waitThreadSigMask(
     const int *aSigList);
 
+/* -------------------------------------------------------------------------- */
+void
+ert_enableThreadSigMaskDefer_(
+    void (*aReplay)(int aSigNum, siginfo_t *aSigInfo, void *aSigContext));
+
+bool
+ert_deferThreadSigMaskSignal_(
+    int              aSigNum,
+    const siginfo_t *aSigInfo,
+    void            *aSigContext);
+
+/* Discard the signals deferred by the parent in the forked child,
+ * which does not inherit the signals pending in the parent. */
+
+void
+ert_clearThreadSigMaskDefer_(void);
+
 /* -------------------------------------------------------------------------- */
 
 ERT_END_C_SCOPE;
@@ -0,0 +1,134 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#ifndef ERT_THREADSTATISTICS_H
+#define ERT_THREADSTATISTICS_H
+
+#include "ert/compiler.h"
+#include "ert/queue.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+ERT_BEGIN_C_SCOPE;
+
+/* -------------------------------------------------------------------------- */
+/* Thread statistics are recorded by each thread into its own block
+ * without synchronisation. The blocks are mapped directly using mmap(2)
+ * so that recording never calls the allocator, and are linked into a
+ * list protected by a mutex so that they can be summarised. When a
+ * thread terminates, its block is merged into the block of exited
+ * threads using the merge function.
+ *
+ * Each thread also marks when it is recording, or reading, the
+ * statistics so that calls made in the process, for example by a
+ * signal handler, are not themselves recorded. The owner of the
+ * statistics keeps this state in an Ert_ThreadStatisticsThread with
+ * thread storage duration.
+ *
+ * Statistics with static storage duration are initialised using
+ * ERT_THREADSTATISTICS_INITIALIZER(), and are never closed. */
+
+struct Ert_ThreadStatisticsThread
+{
+    void    *mBlock;
+    unsigned mBusy;
+};
+
+struct Ert_ThreadStatisticsBlock_
+{
+    LIST_ENTRY(Ert_ThreadStatisticsBlock_) mList;
+
+    struct Ert_ThreadStatistics       *mStatistics;
+    struct Ert_ThreadStatisticsThread *mThread;
+
+    char mData[] __attribute__((__aligned__(16)));
+};
+
+#define ERT_THREADSTATISTICS_INITIALIZER(Exited_, Merge_)       \
+{                                                               \
+    .mSize   = sizeof(*(Exited_)),                              \
+    .mExited = (Exited_),                                       \
+    .mMerge  = (Merge_),                                        \
+    .mMutex  = PTHREAD_MUTEX_INITIALIZER,                       \
+}
+
+struct Ert_ThreadStatistics
+{
+    size_t          mSize;
+    void           *mExited;
+    void          (*mMerge)(void *self, const void *aOther);
+    unsigned        mKeyed;
+    pthread_key_t   mKey;
+    pthread_mutex_t mMutex;
+
+    LIST_HEAD(, Ert_ThreadStatisticsBlock_) mList;
+};
+
+/* -------------------------------------------------------------------------- */
+/* Return the block of the calling thread, creating it if necessary, so
+ * that the caller can record statistics. Return null if the thread is
+ * already busy with the statistics, or if the block cannot be created,
+ * or if the thread has no block and is running a signal handler.
+ * If a block is returned, the caller must call ert_endThreadStatistics()
+ * when done. */
+
+ERT_CHECKED void *
+ert_beginThreadStatistics(
+    struct Ert_ThreadStatistics       *self,
+    struct Ert_ThreadStatisticsThread *aThread);
+
+void
+ert_endThreadStatistics(
+    struct Ert_ThreadStatisticsThread *aThread);
+
+/* -------------------------------------------------------------------------- */
+/* Lock the statistics so that the blocks of the exited threads, and
+ * of the live threads, can be read consistently. Iterate over the
+ * blocks of the live threads using ert_nextThreadStatistics(). */
+
+ERT_CHECKED pthread_mutex_t *
+ert_lockThreadStatistics(
+    struct Ert_ThreadStatistics       *self,
+    struct Ert_ThreadStatisticsThread *aThread);
+
+ERT_CHECKED pthread_mutex_t *
+ert_unlockThreadStatistics(
+    struct Ert_ThreadStatisticsThread *aThread,
+    pthread_mutex_t                   *aLock);
+
+ERT_CHECKED const void *
+ert_nextThreadStatistics(
+    struct Ert_ThreadStatistics *self,
+    const void                  *aBlock);
+
+/* -------------------------------------------------------------------------- */
+
+ERT_END_C_SCOPE;
+
+#endif /* ERT_THREADSTATISTICS_H */
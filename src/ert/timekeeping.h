@@ -108,6 +108,15 @@ ERT_CHECKED int
 ert_procUptime(struct Ert_Duration *aUptime, const char *aFileName);
 #endif
 
+/* -------------------------------------------------------------------------- */
+#ifdef __linux__
+ERT_CHECKED int
+ert_setTimerSlack(struct Ert_Duration aSlack);
+
+ERT_CHECKED int
+ert_fetchTimerSlack(struct Ert_Duration *aSlack);
+#endif
+
 /* -------------------------------------------------------------------------- */
 struct Ert_Duration
 ert_lapTimeSince(
@@ -33,6 +33,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 
 /* -------------------------------------------------------------------------- */
 #define EVENTLATCH_DISABLE_BIT_ 0
@@ -49,11 +50,12 @@ ert_createEventLatch(
 {
     int rc = -1;
 
-    self->mMutex = ert_createThreadSigMutex(&self->mMutex_);
-    self->mEvent = 0;
-    self->mPipe  = 0;
-    self->mName  = 0;
-    self->mList  = (struct Ert_EventLatchListEntry)
+    self->mMutex      = ert_createThreadSigMutex(&self->mMutex_);
+    self->mEvent      = 0;
+    self->mSignalling = 0;
+    self->mPipe       = 0;
+    self->mName       = 0;
+    self->mList       = (struct Ert_EventLatchListEntry)
     {
         .mMethod = Ert_EventLatchMethodNil(),
         .mLatch = self,
@@ -103,14 +105,47 @@ ert_printEventLatch(
     return fprintf(aFile, "<%p %s>", self, self->mName);
 }
 
+/* -------------------------------------------------------------------------- */
+static enum Ert_EventLatchSetting
+fetchEventLatchSetting_(unsigned aEvent)
+{
+    enum Ert_EventLatchSetting setting;
+
+    if (aEvent & EVENTLATCH_DISABLE_MASK_)
+        setting = Ert_EventLatchSettingDisabled;
+    else
+        setting = (aEvent & EVENTLATCH_DATA_MASK_)
+            ? Ert_EventLatchSettingOn
+            : Ert_EventLatchSettingOff;
+
+    return setting;
+}
+
+static unsigned
+loadEventLatch_(const struct Ert_EventLatch *self)
+{
+    return __atomic_load_n(&self->mEvent, __ATOMIC_ACQUIRE);
+}
+
 /* -------------------------------------------------------------------------- */
 static int
 signalEventLatch_(struct Ert_EventLatch *self)
 {
     int rc = -1;
 
-    if (self->mPipe)
+    /* Announce the signal before loading the event pipe, so that an
+     * unbinding thread that clears the event pipe will wait for the
+     * signal to complete before releasing it. */
+
+    __atomic_add_fetch(&self->mSignalling, 1, __ATOMIC_SEQ_CST);
+
+    struct Ert_EventPipe *pipe = __atomic_load_n(
+        &self->mPipe, __ATOMIC_SEQ_CST);
+
+    if (pipe)
     {
+        ert_readyEventPipeLatch_(pipe, &self->mList);
+
         int signalled;
 
         do
@@ -118,7 +153,7 @@ signalEventLatch_(struct Ert_EventLatch *self)
             signalled = -1;
 
             ERT_ERROR_IF(
-                (signalled = ert_setEventPipe(self->mPipe),
+                (signalled = ert_setEventPipe(pipe),
                  -1 == signalled && EINTR != errno));
 
         } while (-1 == signalled);
@@ -128,7 +163,10 @@ signalEventLatch_(struct Ert_EventLatch *self)
 
 Ert_Finally:
 
-    ERT_FINALLY({});
+    ERT_FINALLY
+    ({
+        __atomic_sub_fetch(&self->mSignalling, 1, __ATOMIC_RELEASE);
+    });
 
     return rc;
 }
@@ -144,33 +182,43 @@ bindEventLatchPipe_(
 
     struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
 
-    enum Ert_EventLatchSetting setting;
-
-    unsigned event = self->mEvent;
-
-    if (event & EVENTLATCH_DISABLE_MASK_)
-        setting = Ert_EventLatchSettingDisabled;
-    else
-        setting = (event & EVENTLATCH_DATA_MASK_)
-            ? Ert_EventLatchSettingOn
-            : Ert_EventLatchSettingOff;
+    enum Ert_EventLatchSetting setting =
+        fetchEventLatchSetting_(loadEventLatch_(self));
 
     if (self->mPipe != aPipe)
     {
-        if (self->mPipe)
+        struct Ert_EventPipe *pipe = self->mPipe;
+
+        if (pipe)
         {
-            ert_detachEventPipeLatch_(self->mPipe, &self->mList);
+            /* Wait for signals that might have loaded the event pipe
+             * before it was cleared to complete. These only take the
+             * signal mutex of the event pipe, which is never held while
+             * latches are polled, so they complete promptly even if
+             * this is called from the method of a latch. */
+
+            __atomic_store_n(&self->mPipe, 0, __ATOMIC_SEQ_CST);
+
+            while (__atomic_load_n(&self->mSignalling, __ATOMIC_ACQUIRE))
+                sched_yield();
+
+            ert_detachEventPipeLatch_(pipe, &self->mList);
             self->mList.mMethod = Ert_EventLatchMethodNil();
         }
 
-        self->mPipe = aPipe;
-
-        if (self->mPipe)
+        if (aPipe)
         {
             self->mList.mMethod = aMethod;
-            ert_attachEventPipeLatch_(self->mPipe, &self->mList);
+            ert_attachEventPipeLatch_(aPipe, &self->mList);
+
+            /* Publish the event pipe before checking the latch again,
+             * so that either this thread, or a thread that concurrently
+             * sets the latch, will signal the event pipe. */
+
+            __atomic_store_n(&self->mPipe, aPipe, __ATOMIC_SEQ_CST);
 
-            if (Ert_EventLatchSettingOff != setting)
+            if (Ert_EventLatchSettingOff !=
+                    fetchEventLatchSetting_(loadEventLatch_(self)))
                 ERT_ERROR_IF(
                     signalEventLatch_(self));
         }
@@ -216,24 +264,19 @@ ert_disableEventLatch(
 
     struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
 
-    enum Ert_EventLatchSetting setting;
+    unsigned event = __atomic_fetch_or(
+        &self->mEvent, EVENTLATCH_DISABLE_MASK_, __ATOMIC_SEQ_CST);
 
-    unsigned event = self->mEvent;
+    enum Ert_EventLatchSetting setting = fetchEventLatchSetting_(event);
 
-    if (event & EVENTLATCH_DISABLE_MASK_)
-        setting = Ert_EventLatchSettingDisabled;
-    else
-    {
-        setting = (event & EVENTLATCH_DATA_MASK_)
-            ? Ert_EventLatchSettingOn
-            : Ert_EventLatchSettingOff;
+    /* The latch remains disabled even if the event pipe cannot be
+     * signalled, because other threads might already have observed
+     * the new setting. */
 
+    if (Ert_EventLatchSettingDisabled != setting)
         ERT_ERROR_IF(
             signalEventLatch_(self));
 
-        self->mEvent = event ^ EVENTLATCH_DISABLE_MASK_;
-    }
-
     rc = setting;
 
 Ert_Finally:
@@ -253,34 +296,38 @@ ert_setEventLatch(
 {
     enum Ert_EventLatchSetting rc = Ert_EventLatchSettingError;
 
-    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
+    /* Setting a latch that is already set, or disabled, only requires
+     * the state to be loaded. Otherwise the first thread to set the
+     * data bit signals the event pipe. The data bit is never cleared
+     * again here, because other threads might already have observed
+     * it, and signalling restarts if interrupted. */
 
-    enum Ert_EventLatchSetting setting;
+    unsigned event = loadEventLatch_(self);
 
-    unsigned event = self->mEvent;
+    enum Ert_EventLatchSetting setting;
 
-    if (event & EVENTLATCH_DISABLE_MASK_)
-        setting = Ert_EventLatchSettingDisabled;
-    else if (event & EVENTLATCH_DATA_MASK_)
-        setting = Ert_EventLatchSettingOn;
-    else
+    while (1)
     {
-        setting = Ert_EventLatchSettingOff;
+        setting = fetchEventLatchSetting_(event);
 
-        ERT_ERROR_IF(
-            signalEventLatch_(self));
+        if (Ert_EventLatchSettingOff != setting)
+            break;
 
-        self->mEvent = event ^ EVENTLATCH_DATA_MASK_;
+        if (__atomic_compare_exchange_n(
+                &self->mEvent, &event, event | EVENTLATCH_DATA_MASK_,
+                false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+        {
+            ERT_ERROR_IF(
+                signalEventLatch_(self));
+            break;
+        }
     }
 
     rc = setting;
 
 Ert_Finally:
 
-    ERT_FINALLY
-    ({
-        lock = ert_unlockThreadSigMutex(lock);
-    });
+    ERT_FINALLY({});
 
     return rc;
 }
@@ -290,69 +337,32 @@ enum Ert_EventLatchSetting
 ert_resetEventLatch(
     struct Ert_EventLatch *self)
 {
-    enum Ert_EventLatchSetting rc = Ert_EventLatchSettingError;
-
-    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
+    unsigned event = loadEventLatch_(self);
 
     enum Ert_EventLatchSetting setting;
 
-    unsigned event = self->mEvent;
-
-    if (event & EVENTLATCH_DISABLE_MASK_)
-        setting = Ert_EventLatchSettingDisabled;
-    else if ( ! (event & EVENTLATCH_DATA_MASK_))
-        setting = Ert_EventLatchSettingOff;
-    else
+    while (1)
     {
-        setting = Ert_EventLatchSettingOn;
+        setting = fetchEventLatchSetting_(event);
 
-        self->mEvent = event ^ EVENTLATCH_DATA_MASK_;
-    }
-
-    rc = setting;
+        if (Ert_EventLatchSettingOn != setting)
+            break;
 
-Ert_Finally:
-
-    ERT_FINALLY
-    ({
-        lock = ert_unlockThreadSigMutex(lock);
-    });
+        if (__atomic_compare_exchange_n(
+                &self->mEvent, &event, event & ~ EVENTLATCH_DATA_MASK_,
+                false, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+            break;
+    }
 
-    return rc;
+    return setting;
 }
 
 /* -------------------------------------------------------------------------- */
 enum Ert_EventLatchSetting
 ert_ownEventLatchSetting(
-    const struct Ert_EventLatch *self_)
+    const struct Ert_EventLatch *self)
 {
-    enum Ert_EventLatchSetting rc = Ert_EventLatchSettingError;
-
-    struct Ert_EventLatch *self = (struct Ert_EventLatch *) self_;
-
-    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
-
-    enum Ert_EventLatchSetting setting;
-
-    unsigned event = self->mEvent;
-
-    if (event & EVENTLATCH_DISABLE_MASK_)
-        setting = Ert_EventLatchSettingDisabled;
-    else
-        setting = (event & EVENTLATCH_DATA_MASK_)
-            ? Ert_EventLatchSettingOn
-            : Ert_EventLatchSettingOff;
-
-    rc = setting;
-
-Ert_Finally:
-
-    ERT_FINALLY
-    ({
-        lock = ert_unlockThreadSigMutex(lock);
-    });
-
-    return rc;
+    return fetchEventLatchSetting_(loadEventLatch_(self));
 }
 
 /* -------------------------------------------------------------------------- */
@@ -31,6 +31,9 @@
 #include "ert/error.h"
 
 #include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/eventfd.h>
 
 /* -------------------------------------------------------------------------- */
 int
@@ -41,15 +44,45 @@ ert_createEventPipe(
     int rc = -1;
 
     self->mPipe      = 0;
-    self->mSignalled = false;
-    self->mMutex     = ert_createThreadSigMutex(&self->mMutex_);
+    self->mEventFile = 0;
+    self->mFile      = 0;
+    self->mSignalled   = false;
+    self->mMutex       = ert_createThreadSigMutex(&self->mMutex_);
+    self->mSignalMutex = ert_createThreadSigMutex(&self->mSignalMutex_);
 
     LIST_INIT(&self->mLatchList_.mList);
     self->mLatchList = &self->mLatchList_;
+    self->mReadyList = 0;
 
-    ERT_ERROR_IF(
-        ert_createPipe(&self->mPipe_, aFlags));
-    self->mPipe = &self->mPipe_;
+    if ( ! (aFlags & ERT_EVENTPIPE_EVENTFD))
+    {
+        ERT_ERROR_IF(
+            ert_createPipe(&self->mPipe_, aFlags));
+        self->mPipe = &self->mPipe_;
+        self->mFile = self->mPipe->mRdFile;
+    }
+    else
+    {
+        aFlags &= ~ ERT_EVENTPIPE_EVENTFD;
+
+        ERT_ERROR_IF(
+            aFlags & ~ (O_CLOEXEC | O_NONBLOCK),
+            {
+                errno = EINVAL;
+            });
+
+        /* The eventfd(2) flags share the values of the corresponding
+         * open(2) flags. */
+
+        ERT_ERROR_IF(
+            ert_createFile(
+                &self->mEventFile_,
+                eventfd(0,
+                        (aFlags & O_CLOEXEC  ? EFD_CLOEXEC  : 0) |
+                        (aFlags & O_NONBLOCK ? EFD_NONBLOCK : 0))));
+        self->mEventFile = &self->mEventFile_;
+        self->mFile      = self->mEventFile;
+    }
 
     rc = 0;
 
@@ -75,8 +108,14 @@ ert_closeEventPipe(
             ert_ensure(LIST_EMPTY(&self->mLatchList->mList));
         self->mLatchList = 0;
 
-        self->mPipe  = ert_closePipe(self->mPipe);
-        self->mMutex = ert_destroyThreadSigMutex(self->mMutex);
+        ert_ensure( ! self->mReadyList);
+
+        self->mFile      = 0;
+        self->mPipe      = ert_closePipe(self->mPipe);
+        self->mEventFile = ert_closeFile(self->mEventFile);
+        self->mMutex     = ert_destroyThreadSigMutex(self->mMutex);
+
+        self->mSignalMutex = ert_destroyThreadSigMutex(self->mSignalMutex);
     }
 
     return 0;
@@ -89,7 +128,8 @@ ert_setEventPipe(
 {
     int rc = -1;
 
-    struct Ert_ThreadSigMutex *lock = ert_lockThreadSigMutex(self->mMutex);
+    struct Ert_ThreadSigMutex *lock =
+        ert_lockThreadSigMutex(self->mSignalMutex);
 
     int signalled = 0;
 
@@ -98,15 +138,30 @@ ert_setEventPipe(
         /* Use write() so that the caller can optionally restart the
          * the operation on EINTR. */
 
-        char buf[1] = { 0 };
+        if (self->mEventFile)
+        {
+            uint64_t count = 1;
 
-        ssize_t rv = 0;
-        ERT_ERROR_IF(
-            (rv = write(self->mPipe->mWrFile->mFd, buf, sizeof(buf)),
-             1 != rv),
-            {
-                errno = -1 == rv ? errno : EIO;
-            });
+            ssize_t rv = 0;
+            ERT_ERROR_IF(
+                (rv = write(self->mEventFile->mFd, &count, sizeof(count)),
+                 sizeof(count) != rv),
+                {
+                    errno = -1 == rv ? errno : EIO;
+                });
+        }
+        else
+        {
+            char buf[1] = { 0 };
+
+            ssize_t rv = 0;
+            ERT_ERROR_IF(
+                (rv = write(self->mPipe->mWrFile->mFd, buf, sizeof(buf)),
+                 1 != rv),
+                {
+                    errno = -1 == rv ? errno : EIO;
+                });
+        }
 
         self->mSignalled = true;
         signalled        = 1;
@@ -131,6 +186,9 @@ resetEventPipe_(
 {
     int rc = -1;
 
+    struct Ert_ThreadSigMutex *lock =
+        ert_lockThreadSigMutex(self->mSignalMutex);
+
     int signalled = 0;
 
     if (self->mSignalled)
@@ -138,17 +196,34 @@ resetEventPipe_(
         /* Use read() so that the caller can optionally restart the
          * the operation on EINTR. */
 
-        char buf[1];
+        if (self->mEventFile)
+        {
+            uint64_t count;
 
-        ssize_t rv = 0;
-        ERT_ERROR_IF(
-            (rv = read(self->mPipe->mRdFile->mFd, buf, sizeof(buf)),
-             1 != rv),
-            {
-                errno = -1 == rv ? errno : EIO;
-            });
+            ssize_t rv = 0;
+            ERT_ERROR_IF(
+                (rv = read(self->mEventFile->mFd, &count, sizeof(count)),
+                 sizeof(count) != rv),
+                {
+                    errno = -1 == rv ? errno : EIO;
+                });
 
-        ert_ensure( ! buf[0]);
+            ert_ensure(1 == count);
+        }
+        else
+        {
+            char buf[1];
+
+            ssize_t rv = 0;
+            ERT_ERROR_IF(
+                (rv = read(self->mPipe->mRdFile->mFd, buf, sizeof(buf)),
+                 1 != rv),
+                {
+                    errno = -1 == rv ? errno : EIO;
+                });
+
+            ert_ensure( ! buf[0]);
+        }
 
         self->mSignalled = false;
         signalled        = 1;
@@ -158,7 +233,10 @@ resetEventPipe_(
 
 Ert_Finally:
 
-    ERT_FINALLY({});
+    ERT_FINALLY
+    ({
+        lock = ert_unlockThreadSigMutex(lock);
+    });
 
     return rc;
 }
@@ -188,6 +266,64 @@ Ert_Finally:
     return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+/* Ready List
+ *
+ * Latches push themselves onto the ready list of the event pipe when
+ * they are signalled, which might happen concurrently in many threads,
+ * or in signal handlers, so entries are pushed without locking. Entries
+ * are only ever removed by taking the whole list while holding the
+ * mutex of the event pipe, which avoids the ABA problem. An entry is
+ * pushed at most once until it is taken from the list again. */
+
+static void
+pushEventPipeReadyList_(
+    struct Ert_EventPipe           *self,
+    struct Ert_EventLatchListEntry *aEntry)
+{
+    struct Ert_EventLatchListEntry *head = __atomic_load_n(
+        &self->mReadyList, __ATOMIC_RELAXED);
+
+    do
+        aEntry->mReadyNext = head;
+    while ( ! __atomic_compare_exchange_n(
+                &self->mReadyList, &head, aEntry,
+                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static struct Ert_EventLatchListEntry *
+takeEventPipeReadyList_(
+    struct Ert_EventPipe *self)
+{
+    /* Reverse the list so that latches are polled in the order in
+     * which they were signalled. */
+
+    struct Ert_EventLatchListEntry *ready = __atomic_exchange_n(
+        &self->mReadyList, 0, __ATOMIC_ACQUIRE);
+
+    struct Ert_EventLatchListEntry *list = 0;
+
+    while (ready)
+    {
+        struct Ert_EventLatchListEntry *next = ready->mReadyNext;
+
+        ready->mReadyNext = list;
+        list              = ready;
+        ready             = next;
+    }
+
+    return list;
+}
+
+void
+ert_readyEventPipeLatch_(
+    struct Ert_EventPipe           *self,
+    struct Ert_EventLatchListEntry *aEntry)
+{
+    if ( ! __atomic_exchange_n(&aEntry->mReady, true, __ATOMIC_SEQ_CST))
+        pushEventPipeReadyList_(self, aEntry);
+}
+
 /* -------------------------------------------------------------------------- */
 void
 ert_attachEventPipeLatch_(
@@ -211,6 +347,27 @@ ert_detachEventPipeLatch_(
 
     LIST_REMOVE(aEntry, mEntry);
 
+    /* The latch has stopped signalling the event pipe, so it cannot be
+     * pushed onto the ready list again, but it might remain there from
+     * an earlier signal. */
+
+    if (__atomic_load_n(&aEntry->mReady, __ATOMIC_SEQ_CST))
+    {
+        struct Ert_EventLatchListEntry *ready = takeEventPipeReadyList_(self);
+
+        while (ready)
+        {
+            struct Ert_EventLatchListEntry *next = ready->mReadyNext;
+
+            if (ready != aEntry)
+                pushEventPipeReadyList_(self, ready);
+
+            ready = next;
+        }
+
+        aEntry->mReady = false;
+    }
+
     lock = ert_unlockThreadSigMutex(lock);
 }
 
@@ -225,40 +382,74 @@ ert_pollEventPipe(
 
     int pollCount = 0;
 
-    if (self->mSignalled)
+    /* Reset the event pipe before taking the ready list, so that a
+     * latch that is signalled while the ready list is being polled
+     * will signal the event pipe again. */
+
+    int signalled = -1;
+
+    ERT_ERROR_IF(
+        (signalled = resetEventPipe_(self),
+         -1 == signalled));
+
+    if (signalled)
     {
-        struct Ert_EventLatchListEntry *iter;
+        struct Ert_EventLatchListEntry *ready = takeEventPipeReadyList_(self);
 
         int called = 0;
 
-        LIST_FOREACH(iter, &self->mLatchList->mList, mEntry)
+        while (ready)
         {
-            called = -1;
+            struct Ert_EventLatchListEntry *entry = ready;
 
-            ERT_ERROR_IF(
-                (called = ert_pollEventLatchListEntry(iter, aPollTime),
-                 -1 == called && ! pollCount));
+            ready = entry->mReadyNext;
+
+            /* Clear the ready flag before polling the latch, so that if
+             * the latch is set again after it is reset, it will be
+             * pushed onto the ready list again. */
+
+            __atomic_store_n(&entry->mReady, false, __ATOMIC_SEQ_CST);
+
+            called = ert_pollEventLatchListEntry(entry, aPollTime);
 
             if (-1 == called)
-                break;
+            {
+                /* Return the latch, and those not yet polled, to the
+                 * ready list so that they will be polled again. */
 
-            if (0 < called)
-                ++pollCount;
-        }
+                ert_readyEventPipeLatch_(self, entry);
 
-        /* Leave the event pipe set if any one latch could not be polled.
-         * In particular, if the latch poll returns EINTR, the event
-         * pipe will remain set and cause the pipe the be polled again. */
+                while (ready)
+                {
+                    struct Ert_EventLatchListEntry *next = ready->mReadyNext;
 
-        if (-1 != called)
-        {
-            int signalled = -1;
+                    pushEventPipeReadyList_(self, ready);
+                    ready = next;
+                }
 
-            ERT_ERROR_IF(
-                (signalled = resetEventPipe_(self),
-                 -1 == signalled));
+                /* Set the event pipe again so that the latches that
+                 * could not be polled will be polled again. In
+                 * particular, if the latch poll returns EINTR, this
+                 * causes the pipe to be polled again. */
+
+                do
+                {
+                    signalled = -1;
+
+                    ERT_ERROR_IF(
+                        (signalled = ert_setEventPipe(self),
+                         -1 == signalled && EINTR != errno));
 
-            ert_ensure(0 < signalled);
+                } while (-1 == signalled);
+
+                ERT_ERROR_IF(
+                    ! pollCount);
+
+                break;
+            }
+
+            if (0 < called)
+                ++pollCount;
         }
     }
 
@@ -803,6 +803,30 @@ Ert_Finally:
     return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+int
+ert_pollFds(
+    struct pollfd *aPollFds, size_t aNumFds,
+    const struct Ert_Duration *aTimeout)
+{
+    /* Use ppoll(2) rather than poll(2) so that the timeout is not
+     * truncated to milliseconds. A truncated timeout causes the caller
+     * to wake before the deadline, only to poll again for the remaining
+     * fraction of a millisecond. The accuracy of the wake up is then
+     * governed by the timer slack of the thread. */
+
+    struct timespec  timeout_;
+    struct timespec *timeout = 0;
+
+    if (aTimeout)
+    {
+        timeout_ = ert_timeSpecFromNanoSeconds(aTimeout->duration);
+        timeout  = &timeout_;
+    }
+
+    return ppoll(aPollFds, aNumFds, timeout, 0);
+}
+
 /* -------------------------------------------------------------------------- */
 static ERT_CHECKED int
 waitFdReady_(int aFd, unsigned aPollMask, const struct Ert_Duration *aTimeout)
@@ -846,11 +870,7 @@ waitFdReady_(int aFd, unsigned aPollMask, const struct Ert_Duration *aTimeout)
                 break;
         });
 
-        int timeout_ms;
-
-        if ( ! aTimeout)
-            timeout_ms = -1;
-        else
+        if (aTimeout)
         {
             if (ert_deadlineTimeExpired(&since, timeout, &remaining, &tm))
             {
@@ -862,18 +882,12 @@ waitFdReady_(int aFd, unsigned aPollMask, const struct Ert_Duration *aTimeout)
 
                 break;
             }
-
-            uint64_t remaining_ms = ERT_MSECS(remaining.duration).ms;
-
-            timeout_ms = remaining_ms;
-
-            if (0 > timeout_ms || timeout_ms != remaining_ms)
-                timeout_ms = INT_MAX;
         }
 
         int events;
         ERT_ERROR_IF(
-            (events = poll(pollfd, ERT_NUMBEROF(pollfd), timeout_ms),
+            (events = ert_pollFds(
+                pollfd, ERT_NUMBEROF(pollfd), aTimeout ? &remaining : 0),
              -1 == events && EINTR != errno));
 
         switch (events)
@@ -29,6 +29,7 @@
 
 #include "ert/fdset.h"
 #include "ert/file.h"
+#include "ert/slab.h"
 #include "ert/error.h"
 
 #include <stdlib.h>
@@ -54,6 +55,13 @@ rankFdSetElement_(
 RB_GENERATE_STATIC(
     Ert_FdSetTree_, Ert_FdSetElement_, mTree, rankFdSetElement_)
 
+/* Allocate the elements from a slab pool rather than using malloc(),
+ * so that fd sets can be manipulated without blocking signals, and
+ * in the child after fork(). */
+
+static struct Ert_SlabPool fdSetElementPool_ =
+    ERT_SLABPOOL_INITIALIZER(sizeof(struct Ert_FdSetElement_));
+
 /* -------------------------------------------------------------------------- */
 int
 ert_printFdSet(
@@ -161,7 +169,7 @@ ert_clearFdSet(
 
             struct Ert_FdSetElement_ *parent = RB_PARENT(elem, mTree);
 
-            free(elem);
+            ert_freeSlab(&fdSetElementPool_, elem);
 
             if (parent)
             {
@@ -216,7 +224,7 @@ ert_invertFdSet(
                 if ( ! next->mRange.mLhs)
                 {
                     RB_REMOVE(Ert_FdSetTree_, &self->mRoot, next);
-                    free(next);
+                    ert_freeSlab(&fdSetElementPool_, next);
                     next = 0;
                 }
                 else
@@ -239,7 +247,7 @@ ert_invertFdSet(
             if (prev->mRange.mLhs)
             {
                 ERT_ERROR_UNLESS(
-                    elem = malloc(sizeof(*elem)));
+                    elem = ert_allocSlab(&fdSetElementPool_));
 
                 elem->mRange = Ert_FdRange(0, prev->mRange.mLhs - 1);
 
@@ -271,7 +279,7 @@ Ert_Finally:
 
     ERT_FINALLY
     ({
-        free(elem);
+        ert_freeSlab(&fdSetElementPool_, elem);
     });
 
     return rc;
@@ -335,7 +343,7 @@ ert_insertFdSetRange(
     struct Ert_FdSetElement_ *elem = 0;
 
     ERT_ERROR_UNLESS(
-        elem = malloc(sizeof(*elem)));
+        elem = ert_allocSlab(&fdSetElementPool_));
 
     elem->mRange = aRange;
 
@@ -368,7 +376,7 @@ ert_insertFdSetRange(
         RB_REMOVE(Ert_FdSetTree_, &self->mRoot, elem);
 
         prev->mRange.mRhs = elem->mRange.mRhs;
-        free(elem);
+        ert_freeSlab(&fdSetElementPool_, elem);
 
         elem = prev;
     }
@@ -378,7 +386,7 @@ ert_insertFdSetRange(
         RB_REMOVE(Ert_FdSetTree_, &self->mRoot, elem);
 
         next->mRange.mLhs = elem->mRange.mLhs;
-        free(elem);
+        ert_freeSlab(&fdSetElementPool_, elem);
 
         elem = next;
     }
@@ -394,7 +402,7 @@ Ert_Finally:
         if (inserted && elem)
             RB_REMOVE(Ert_FdSetTree_, &self->mRoot, elem);
 
-        free(elem);
+        ert_freeSlab(&fdSetElementPool_, elem);
     });
 
     return rc;
@@ -453,7 +461,7 @@ ert_removeFdSetRange(
 
     case 3:
         RB_REMOVE(Ert_FdSetTree_, &self->mRoot, elem);
-        free(elem);
+        ert_freeSlab(&fdSetElementPool_, elem);
         break;
 
     case 2:
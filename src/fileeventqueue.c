@@ -29,13 +29,31 @@
 
 #include "ert/fileeventqueue.h"
 #include "ert/error.h"
+#include "ert/fd.h"
 #include "ert/timescale.h"
 #include "ert/timekeeping.h"
+#include "ert/deadline.h"
+#include "ert/thread.h"
 
 #include "malloc_.h"
 
-#include <limits.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <endian.h>
+
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+#define FILEEVENTQUEUE_MAX_SIZE_    (64 * 1024)
+#define FILEEVENTQUEUE_IDLE_POLLS_  64
 
 /* -------------------------------------------------------------------------- */
 static uint32_t pollTriggers_[Ert_FileEventQueuePollTriggers] =
@@ -46,6 +64,17 @@ static uint32_t pollTriggers_[Ert_FileEventQueuePollTriggers] =
                                                               | EPOLLIN),
 };
 
+/* -------------------------------------------------------------------------- */
+static pthread_mutex_t *
+lockFileEventQueuePool_(struct Ert_FileEventQueue *self)
+{
+    /* The state of the activities of a queue served by a worker pool
+     * is protected by the mutex of the pool, because activities can be
+     * armed and disarmed concurrently with the workers. */
+
+    return self->mPool ? ert_lockMutex(self->mPool->mMutex) : 0;
+}
+
 /* -------------------------------------------------------------------------- */
 static void
 ert_markFileEventQueueActivityPending_(
@@ -55,341 +84,2070 @@ ert_markFileEventQueueActivityPending_(
     ert_ensure(self->mArmed);
     ert_ensure( ! self->mPending);
 
-    self->mPending = aPollEvent;
+    self->mPending = aPollEvent;
+}
+
+/* -------------------------------------------------------------------------- */
+/* io_uring Engine
+ *
+ * Each armed activity is lodged as an IORING_OP_POLL_ADD request, and
+ * purged using IORING_OP_POLL_REMOVE. The submission entries are only
+ * queued in the ring, and are submitted together with the wait for
+ * completions, so that a single io_uring_enter(2) is required for each
+ * poll of the queue. The submission ring is only flushed early if it
+ * fills before the next poll.
+ *
+ * Completions are copied into the same array of struct epoll_event as
+ * used by the epoll(7) engine, so that pending activities are tracked
+ * and dispatched in the same way regardless of the engine.
+ *
+ * The kernel might post the completion of a poll request after the
+ * activity has been purged and closed, so the user data of each poll
+ * request refers to a slot rather than to the activity itself. A slot
+ * is only recycled once the final completion of its poll request has
+ * been reaped, and the slot of a purged activity is cleared so that the
+ * stale completion is discarded. Slot zero is reserved to mark the
+ * completion of the removal requests, and is never allocated. */
+
+#if defined(__NR_io_uring_setup) && defined(IORING_ENTER_EXT_ARG)
+
+struct FileEventQueueUringSlot_
+{
+    struct Ert_FileEventQueueActivity *mActivity;
+    unsigned                           mNext;
+};
+
+struct Ert_FileEventQueueUring
+{
+    void                *mRing;
+    size_t               mRingSize;
+    void                *mCompletionRing;
+    size_t               mCompletionRingSize;
+    struct io_uring_sqe *mEntries;
+    size_t               mEntriesSize;
+
+    struct
+    {
+        unsigned *mHead;
+        unsigned *mTail;
+        unsigned *mFlags;
+        unsigned *mArray;
+        unsigned  mMask;
+        unsigned  mSize;
+        unsigned  mPending;
+        unsigned  mRemoveFlags;
+    } mSubmit;
+
+    struct
+    {
+        unsigned            *mHead;
+        unsigned            *mTail;
+        struct io_uring_cqe *mEntries;
+        unsigned             mMask;
+    } mComplete;
+
+    struct FileEventQueueUringSlot_ *mSlots;
+    unsigned                         mNumSlots;
+    unsigned                         mFreeSlot;
+
+    unsigned                         mEdgePollFlags;
+};
+
+/* -------------------------------------------------------------------------- */
+static struct Ert_FileEventQueueUring *
+closeFileEventQueueUring_(struct Ert_FileEventQueueUring *self)
+{
+    if (self)
+    {
+        if (self->mEntries)
+            ERT_ABORT_IF(
+                munmap(self->mEntries, self->mEntriesSize));
+
+        if (self->mCompletionRing && self->mCompletionRing != self->mRing)
+            ERT_ABORT_IF(
+                munmap(self->mCompletionRing, self->mCompletionRingSize));
+
+        if (self->mRing)
+            ERT_ABORT_IF(
+                munmap(self->mRing, self->mRingSize));
+
+        free(self->mSlots);
+        free(self);
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+createFileEventQueueUring_(struct Ert_FileEventQueue *self, int aQueueSize)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueueUring *uring = 0;
+
+    struct io_uring_params params = { };
+
+    int ringFd = syscall(__NR_io_uring_setup, aQueueSize, &params);
+
+    /* Fall back to the epoll(7) engine if io_uring(7) is not provided
+     * by the kernel, has been disabled, or is too old to provide
+     * timed waits and reliable delivery of completions. */
+
+    if (-1 == ringFd)
+    {
+        ERT_ERROR_UNLESS(
+            ENOSYS == errno || EPERM == errno || EACCES == errno);
+    }
+    else
+    {
+        ERT_ERROR_IF(
+            ert_createFile(&self->mFile_, ringFd));
+        self->mFile = &self->mFile_;
+
+        unsigned features = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+        if (features == (params.features & features))
+        {
+            ERT_ERROR_UNLESS(
+                (uring = malloc(sizeof(*uring))));
+
+            *uring = (struct Ert_FileEventQueueUring) { };
+
+            uring->mRingSize =
+                params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            uring->mCompletionRingSize =
+                params.cq_off.cqes +
+                params.cq_entries * sizeof(struct io_uring_cqe);
+            uring->mEntriesSize =
+                params.sq_entries * sizeof(struct io_uring_sqe);
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                if (uring->mRingSize < uring->mCompletionRingSize)
+                    uring->mRingSize = uring->mCompletionRingSize;
+            }
+
+            void *ring;
+
+            ERT_ERROR_IF(
+                (ring = mmap(
+                    0, uring->mRingSize,
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd, IORING_OFF_SQ_RING),
+                 MAP_FAILED == ring));
+            uring->mRing = ring;
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+                uring->mCompletionRing = uring->mRing;
+            else
+            {
+                ERT_ERROR_IF(
+                    (ring = mmap(
+                        0, uring->mCompletionRingSize,
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_CQ_RING),
+                     MAP_FAILED == ring));
+                uring->mCompletionRing = ring;
+            }
+
+            ERT_ERROR_IF(
+                (ring = mmap(
+                    0, uring->mEntriesSize,
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ringFd, IORING_OFF_SQES),
+                 MAP_FAILED == ring));
+            uring->mEntries = ring;
+
+            char *submitRing   = uring->mRing;
+            char *completeRing = uring->mCompletionRing;
+
+            uring->mSubmit.mHead  = (void *) (submitRing + params.sq_off.head);
+            uring->mSubmit.mTail  = (void *) (submitRing + params.sq_off.tail);
+            uring->mSubmit.mFlags = (void *) (submitRing + params.sq_off.flags);
+            uring->mSubmit.mArray = (void *) (submitRing + params.sq_off.array);
+            uring->mSubmit.mMask  =
+                * (unsigned *) (submitRing + params.sq_off.ring_mask);
+            uring->mSubmit.mSize  = params.sq_entries;
+            uring->mSubmit.mPending = *uring->mSubmit.mTail;
+
+            /* Where possible, avoid posting completions for successful
+             * removal requests, since these carry no information. */
+
+#ifdef IOSQE_CQE_SKIP_SUCCESS
+            if (params.features & IORING_FEAT_CQE_SKIP)
+                uring->mSubmit.mRemoveFlags = IOSQE_CQE_SKIP_SUCCESS;
+#endif
+
+            /* Multishot poll requests were introduced in the same
+             * kernel release as IORING_FEAT_RSRC_TAGS. They provide
+             * edge-triggered notification, so are only used for edge
+             * triggered activities. Other persistent activities lodge
+             * a new one-shot poll request each time they are
+             * dispatched, but this does not require an additional
+             * system call since the request is submitted together
+             * with the next wait. */
+
+#if defined(IORING_POLL_ADD_MULTI) && defined(IORING_FEAT_RSRC_TAGS)
+            if (params.features & IORING_FEAT_RSRC_TAGS)
+                uring->mEdgePollFlags = IORING_POLL_ADD_MULTI;
+#endif
+
+            uring->mComplete.mHead    =
+                (void *) (completeRing + params.cq_off.head);
+            uring->mComplete.mTail    =
+                (void *) (completeRing + params.cq_off.tail);
+            uring->mComplete.mEntries =
+                (void *) (completeRing + params.cq_off.cqes);
+            uring->mComplete.mMask    =
+                * (unsigned *) (completeRing + params.cq_off.ring_mask);
+
+            self->mUring  = uring;
+            self->mEngine = Ert_FileEventQueueUringEngine;
+
+            uring = 0;
+        }
+        else
+        {
+            self->mFile = ert_closeFile(self->mFile);
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        uring = closeFileEventQueueUring_(uring);
+
+        if (rc)
+            self->mFile = ert_closeFile(self->mFile);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+enterFileEventQueueUring_(struct Ert_FileEventQueue *self,
+                          unsigned                   aFlags,
+                          unsigned                   aMinComplete,
+                          const struct Ert_Duration *aTimeout)
+{
+    struct Ert_FileEventQueueUring *uring = self->mUring;
+
+    unsigned submitHead = __atomic_load_n(
+        uring->mSubmit.mHead, __ATOMIC_ACQUIRE);
+
+    __atomic_store_n(
+        uring->mSubmit.mTail, uring->mSubmit.mPending, __ATOMIC_RELEASE);
+
+    unsigned flags = aFlags;
+
+    struct
+    {
+        int64_t tv_sec;
+        int64_t tv_nsec;
+    } timeSpec;
+
+    struct io_uring_getevents_arg eventsArg = { };
+
+    if ((flags & IORING_ENTER_GETEVENTS) && aTimeout)
+    {
+        struct Ert_NanoSeconds timeout = aTimeout->duration;
+
+        timeSpec.tv_sec  = timeout.ns / (1000 * 1000 * 1000);
+        timeSpec.tv_nsec = timeout.ns % (1000 * 1000 * 1000);
+
+        eventsArg.ts = (uintptr_t) &timeSpec;
+
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    return syscall(
+        __NR_io_uring_enter,
+        self->mFile->mFd,
+        uring->mSubmit.mPending - submitHead,
+        aMinComplete,
+        flags,
+        (flags & IORING_ENTER_EXT_ARG) ? &eventsArg : 0,
+        sizeof(eventsArg));
+}
+
+/* -------------------------------------------------------------------------- */
+static struct io_uring_sqe *
+acquireFileEventQueueUringEntry_(struct Ert_FileEventQueue *self)
+{
+    struct io_uring_sqe *entry = 0;
+
+    struct Ert_FileEventQueueUring *uring = self->mUring;
+
+    /* Only flush the submission ring if it is full. Otherwise defer
+     * the submission until the next time that the queue is polled. */
+
+    while (uring->mSubmit.mPending -
+           __atomic_load_n(uring->mSubmit.mHead, __ATOMIC_ACQUIRE) >=
+           uring->mSubmit.mSize)
+    {
+        ERT_ERROR_IF(
+            -1 == enterFileEventQueueUring_(self, 0, 0, 0) && EINTR != errno);
+    }
+
+    unsigned index = uring->mSubmit.mPending++ & uring->mSubmit.mMask;
+
+    uring->mSubmit.mArray[index] = index;
+
+    entry  = &uring->mEntries[index];
+    *entry = (struct io_uring_sqe) { };
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return entry;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+lodgeFileEventQueueUringActivity_(struct Ert_FileEventQueue         *self,
+                                  struct Ert_FileEventQueueActivity *aEvent)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueueUring *uring = self->mUring;
+
+    ert_ensure( ! aEvent->mUringSlot);
+
+    if ( ! uring->mFreeSlot)
+    {
+        unsigned numSlots = uring->mNumSlots ? 2 * uring->mNumSlots : 8;
+
+        struct FileEventQueueUringSlot_ *slots;
+
+        ERT_ERROR_UNLESS(
+            (slots = realloc(uring->mSlots, sizeof(*slots) * numSlots)));
+
+        /* Slot zero is never placed on the free list since it is
+         * reserved to mark the completion of removal requests. */
+
+        unsigned firstSlot = uring->mNumSlots ? uring->mNumSlots : 1;
+
+        for (unsigned ix = numSlots; ix-- > firstSlot; )
+        {
+            slots[ix].mActivity = 0;
+            slots[ix].mNext     = uring->mFreeSlot;
+
+            uring->mFreeSlot = ix;
+        }
+
+        if ( ! uring->mNumSlots)
+            slots[0] = (struct FileEventQueueUringSlot_) { };
+
+        uring->mSlots    = slots;
+        uring->mNumSlots = numSlots;
+    }
+
+    struct io_uring_sqe *entry;
+    ERT_ERROR_UNLESS(
+        (entry = acquireFileEventQueueUringEntry_(self)));
+
+    unsigned slot = uring->mFreeSlot;
+
+    uring->mFreeSlot = uring->mSlots[slot].mNext;
+
+    uring->mSlots[slot].mActivity = aEvent;
+    uring->mSlots[slot].mNext     = 0;
+
+    aEvent->mUringSlot = slot;
+
+    uint32_t pollEvents = aEvent->mArmed;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+    pollEvents = (pollEvents << 16) | (pollEvents >> 16);
+#endif
+
+    entry->opcode        = IORING_OP_POLL_ADD;
+    entry->fd            = aEvent->mFile->mFd;
+    entry->poll32_events = pollEvents;
+    entry->user_data     = slot;
+
+    if (Ert_FileEventQueueArmEdgeTriggered == aEvent->mArmMode)
+        entry->len = uring->mEdgePollFlags;
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+purgeFileEventQueueUringActivity_(struct Ert_FileEventQueue         *self,
+                                  struct Ert_FileEventQueueActivity *aEvent)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueueUring *uring = self->mUring;
+
+    /* Once the completion has been reaped, there is no outstanding
+     * poll request to remove. Otherwise, the slot is retained until
+     * the completion of the poll request is eventually reaped. */
+
+    unsigned slot = aEvent->mUringSlot;
+
+    if (slot)
+    {
+        struct io_uring_sqe *entry;
+        ERT_ERROR_UNLESS(
+            (entry = acquireFileEventQueueUringEntry_(self)));
+
+        uring->mSlots[slot].mActivity = 0;
+        aEvent->mUringSlot = 0;
+
+        entry->opcode    = IORING_OP_POLL_REMOVE;
+        entry->flags     = uring->mSubmit.mRemoveFlags;
+        entry->fd        = -1;
+        entry->addr      = slot;
+        entry->user_data = 0;
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+waitFileEventQueueUring_(struct Ert_FileEventQueue *self,
+                         const struct Ert_Duration *aTimeout)
+{
+    struct Ert_FileEventQueueUring *uring = self->mUring;
+
+    unsigned completeHead = *uring->mComplete.mHead;
+    unsigned completeTail = __atomic_load_n(
+        uring->mComplete.mTail, __ATOMIC_ACQUIRE);
+
+    /* Only wait if there are no completions ready to be reaped. Pending
+     * submissions are always flushed since the poll requests they
+     * contain might complete immediately. A wait that times out is
+     * reported as ETIME if nothing was submitted. */
+
+    unsigned minComplete =
+        completeHead == completeTail &&
+        ( ! aTimeout || aTimeout->duration.ns);
+
+    bool expired = false;
+
+    if (minComplete ||
+        uring->mSubmit.mPending != __atomic_load_n(
+            uring->mSubmit.mHead, __ATOMIC_ACQUIRE))
+    {
+        if (-1 == enterFileEventQueueUring_(
+                self,
+                minComplete ? IORING_ENTER_GETEVENTS : 0,
+                minComplete,
+                aTimeout))
+        {
+            if (ETIME != errno)
+                return -1;
+
+            expired = true;
+        }
+
+        completeTail = __atomic_load_n(
+            uring->mComplete.mTail, __ATOMIC_ACQUIRE);
+    }
+
+    /* Completions that do not fit are left in the ring, to be reaped
+     * the next time that the queue is polled. Completions that could
+     * not be posted because the ring was full are held by the kernel
+     * until the ring is drained, so flush these into the ring to avoid
+     * having stale completions delay the delivery of events. */
+
+    int polledEvents = 0;
+
+    while (1)
+    {
+        while (completeHead != completeTail &&
+               self->mQueueSize > polledEvents)
+        {
+            const struct io_uring_cqe *completion =
+                &uring->mComplete.mEntries[
+                    completeHead++ & uring->mComplete.mMask];
+
+            unsigned slot = completion->user_data;
+
+            if (slot)
+            {
+                struct Ert_FileEventQueueActivity *event =
+                    uring->mSlots[slot].mActivity;
+
+                /* A multishot poll request remains active, and retains
+                 * its slot, until its final completion is posted. */
+
+                bool more = completion->flags & IORING_CQE_F_MORE;
+
+                if ( ! more)
+                {
+                    uring->mSlots[slot].mActivity = 0;
+                    uring->mSlots[slot].mNext     = uring->mFreeSlot;
+
+                    uring->mFreeSlot = slot;
+                }
+
+                if (event)
+                {
+                    if ( ! more)
+                        event->mUringSlot = 0;
+
+                    self->mQueue[polledEvents++] = (struct epoll_event)
+                    {
+                        .events = 0 > completion->res ? EPOLLERR
+                                                      : completion->res,
+                        .data   = { .ptr = event },
+                    };
+                }
+            }
+        }
+
+        __atomic_store_n(
+            uring->mComplete.mHead, completeHead, __ATOMIC_RELEASE);
+
+        if (self->mQueueSize == polledEvents || completeHead != completeTail)
+            break;
+
+        if ( ! (IORING_SQ_CQ_OVERFLOW & __atomic_load_n(
+                    uring->mSubmit.mFlags, __ATOMIC_ACQUIRE)))
+            break;
+
+        if (-1 == enterFileEventQueueUring_(
+                self, IORING_ENTER_GETEVENTS, 0, 0))
+        {
+            if (polledEvents)
+                break;
+
+            return -1;
+        }
+
+        completeTail = __atomic_load_n(
+            uring->mComplete.mTail, __ATOMIC_ACQUIRE);
+    }
+
+    /* If the wait was only satisfied by stale completions, report the
+     * wait as interrupted so that the caller will wait again. */
+
+    if (minComplete && ! expired && ! polledEvents)
+    {
+        errno = EINTR;
+        return -1;
+    }
+
+    return polledEvents;
+}
+
+#else
+
+static struct Ert_FileEventQueueUring *
+closeFileEventQueueUring_(struct Ert_FileEventQueueUring *self)
+{
+    return 0;
+}
+
+static ERT_CHECKED int
+createFileEventQueueUring_(struct Ert_FileEventQueue *self, int aQueueSize)
+{
+    return 0;
+}
+
+static ERT_CHECKED int
+lodgeFileEventQueueUringActivity_(struct Ert_FileEventQueue         *self,
+                                  struct Ert_FileEventQueueActivity *aEvent)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static ERT_CHECKED int
+purgeFileEventQueueUringActivity_(struct Ert_FileEventQueue         *self,
+                                  struct Ert_FileEventQueueActivity *aEvent)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+static int
+waitFileEventQueueUring_(struct Ert_FileEventQueue *self,
+                         const struct Ert_Duration *aTimeout)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* Timer Queue
+ *
+ * The armed timers of a queue are kept in a binary min-heap ordered by
+ * deadline, so that the earliest deadline is always at the root. The
+ * heap is indexed from one, and each timer records its location in
+ * the heap so that it can be disarmed without searching. Timers that
+ * are not in the heap are marked with an index of zero.
+ *
+ * The timerfd(2) is created when the first timer is created, and is
+ * watched by a persistent level-triggered activity of the queue. The
+ * timerfd is programmed with the absolute deadline at the root of the
+ * heap, and is only reprogrammed when that deadline changes. Expired
+ * timers are dispatched together, and the timerfd is reprogrammed once
+ * after all of them have been dispatched.
+ *
+ * The timers are protected by a mutex because the methods running in
+ * the threads of a worker pool can arm and disarm timers concurrently,
+ * but the mutex is not held while the method of a timer is called. */
+
+struct Ert_FileEventQueueTimers
+{
+    struct Ert_File                    mFile_;
+    struct Ert_File                   *mFile;
+    pthread_mutex_t                    mMutex_;
+    pthread_mutex_t                   *mMutex;
+    struct Ert_FileEventQueueActivity  mActivity_;
+    struct Ert_FileEventQueueActivity *mActivity;
+
+    struct Ert_FileEventQueueTimer   **mHeap;
+    size_t                             mHeapSize;
+    size_t                             mHeapCapacity;
+
+    uint64_t                           mExpiry;
+    uint64_t                           mSequence;
+    unsigned                           mNumArmed;
+    bool                               mDispatching;
+};
+
+/* -------------------------------------------------------------------------- */
+static bool
+fileEventQueueTimerPrecedes_(const struct Ert_FileEventQueueTimer *aLhs,
+                             const struct Ert_FileEventQueueTimer *aRhs)
+{
+    /* Break ties using the sequence in which the timers were armed
+     * so that timers with the same deadline are dispatched in order. */
+
+    uint64_t lhsDeadline = aLhs->mDeadline.monotonic.ns;
+    uint64_t rhsDeadline = aRhs->mDeadline.monotonic.ns;
+
+    return lhsDeadline != rhsDeadline ? lhsDeadline < rhsDeadline
+                                      : aLhs->mSequence < aRhs->mSequence;
+}
+
+static void
+placeFileEventQueueTimer_(struct Ert_FileEventQueueTimers *self,
+                          size_t                           aSlot,
+                          struct Ert_FileEventQueueTimer  *aTimer)
+{
+    self->mHeap[aSlot] = aTimer;
+    aTimer->mHeapIndex = aSlot;
+}
+
+static void
+siftFileEventQueueTimers_(struct Ert_FileEventQueueTimers *self, size_t aSlot)
+{
+    struct Ert_FileEventQueueTimer **heap  = self->mHeap;
+    struct Ert_FileEventQueueTimer  *timer = heap[aSlot];
+
+    size_t slot = aSlot;
+
+    while (1 < slot)
+    {
+        size_t parent = slot / 2;
+
+        if ( ! fileEventQueueTimerPrecedes_(timer, heap[parent]))
+            break;
+
+        placeFileEventQueueTimer_(self, slot, heap[parent]);
+        slot = parent;
+    }
+
+    while (1)
+    {
+        size_t child = 2 * slot;
+
+        if (child > self->mHeapSize)
+            break;
+
+        if (child + 1 <= self->mHeapSize &&
+            fileEventQueueTimerPrecedes_(heap[child+1], heap[child]))
+            ++child;
+
+        if ( ! fileEventQueueTimerPrecedes_(heap[child], timer))
+            break;
+
+        placeFileEventQueueTimer_(self, slot, heap[child]);
+        slot = child;
+    }
+
+    placeFileEventQueueTimer_(self, slot, timer);
+}
+
+static void
+removeFileEventQueueTimer_(struct Ert_FileEventQueueTimers *self,
+                           struct Ert_FileEventQueueTimer  *aTimer)
+{
+    size_t slot = aTimer->mHeapIndex;
+
+    if (slot)
+    {
+        ert_ensure(self->mHeap[slot] == aTimer);
+
+        aTimer->mHeapIndex = 0;
+
+        size_t last = self->mHeapSize--;
+
+        if (last != slot)
+        {
+            placeFileEventQueueTimer_(self, slot, self->mHeap[last]);
+            siftFileEventQueueTimers_(self, slot);
+        }
+    }
+}
+
+static ERT_CHECKED int
+insertFileEventQueueTimer_(struct Ert_FileEventQueueTimers *self,
+                           struct Ert_FileEventQueueTimer  *aTimer)
+{
+    int rc = -1;
+
+    ert_ensure( ! aTimer->mHeapIndex);
+
+    if (self->mHeapSize + 1 >= self->mHeapCapacity)
+    {
+        size_t capacity = self->mHeapCapacity ? 2 * self->mHeapCapacity : 64;
+
+        struct Ert_FileEventQueueTimer **heap;
+
+        ERT_ERROR_UNLESS(
+            (heap = realloc(self->mHeap, sizeof(*heap) * capacity)));
+
+        self->mHeap         = heap;
+        self->mHeapCapacity = capacity;
+    }
+
+    aTimer->mSequence = ++self->mSequence;
+
+    placeFileEventQueueTimer_(self, ++self->mHeapSize, aTimer);
+    siftFileEventQueueTimers_(self, aTimer->mHeapIndex);
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+programFileEventQueueTimers_(struct Ert_FileEventQueueTimers *self)
+{
+    int rc = -1;
+
+    /* Defer reprogramming the timerfd until all the expired timers have
+     * been dispatched, since their methods will typically rearm them. */
+
+    if ( ! self->mDispatching)
+    {
+        uint64_t expiry = self->mHeapSize
+            ? self->mHeap[1]->mDeadline.monotonic.ns
+            : 0;
+
+        if (expiry != self->mExpiry)
+        {
+            struct itimerspec timerSpec =
+            {
+                .it_value = ert_timeSpecFromNanoSeconds(
+                    Ert_NanoSeconds(expiry)),
+            };
+
+            ERT_ERROR_IF(
+                timerfd_settime(
+                    self->mFile->mFd, TFD_TIMER_ABSTIME, &timerSpec, 0));
+
+            self->mExpiry = expiry;
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+dispatchFileEventQueueTimers_(void *self_)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueue       *self   = self_;
+    struct Ert_FileEventQueueTimers *timers = self->mTimers;
+
+    pthread_mutex_t *lock = 0;
+
+    /* The timerfd is non-blocking, and might have been reprogrammed
+     * since it became readable, so it is not an error for the read to
+     * find no expirations. */
+
+    uint64_t expirations;
+
+    ERT_ERROR_IF(
+        -1 == read(timers->mFile->mFd, &expirations, sizeof(expirations)) &&
+        EAGAIN != errno);
+
+    /* Only dispatch the timers that have expired by the time the read
+     * completes so that a timer that is rearmed with a zero timeout by
+     * its own method cannot starve the queue. */
+
+    struct Ert_MonotonicTime now = ert_monotonicTime();
+
+    lock = ert_lockMutex(timers->mMutex);
+
+    timers->mDispatching = true;
+
+    while (timers->mHeapSize &&
+           timers->mHeap[1]->mDeadline.monotonic.ns <= now.monotonic.ns)
+    {
+        struct Ert_FileEventQueueTimer *timer = timers->mHeap[1];
+
+        struct Ert_FileEventQueueActivityMethod method = timer->mMethod;
+
+        removeFileEventQueueTimer_(timers, timer);
+
+        ert_ensure(timers->mNumArmed);
+
+        --timers->mNumArmed;
+
+        timer->mArmed  = false;
+        timer->mMethod = Ert_FileEventQueueActivityMethodNil();
+
+        lock = ert_unlockMutex(lock);
+
+        ERT_ERROR_IF(
+            ert_callFileEventQueueActivityMethod(method));
+
+        lock = ert_lockMutex(timers->mMutex);
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if ( ! lock)
+            lock = ert_lockMutex(timers->mMutex);
+
+        timers->mDispatching = false;
+
+        if (programFileEventQueueTimers_(timers))
+            rc = -1;
+
+        lock = ert_unlockMutex(lock);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct Ert_FileEventQueueTimers *
+closeFileEventQueueTimers_(struct Ert_FileEventQueueTimers *self)
+{
+    if (self)
+    {
+        ert_ensure( ! self->mNumArmed);
+        ert_ensure( ! self->mHeapSize);
+
+        self->mActivity = ert_closeFileEventQueueActivity(self->mActivity);
+        self->mFile     = ert_closeFile(self->mFile);
+        self->mMutex    = ert_destroyMutex(self->mMutex);
+
+        free(self->mHeap);
+        free(self);
+    }
+
+    return 0;
+}
+
+static ERT_CHECKED int
+createFileEventQueueTimers_(struct Ert_FileEventQueue *self)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueueTimers *timers = 0;
+
+    ERT_ERROR_UNLESS(
+        (timers = malloc(sizeof(*timers))));
+
+    *timers = (struct Ert_FileEventQueueTimers) { };
+
+    timers->mMutex = ert_createMutex(&timers->mMutex_);
+
+    ERT_ERROR_IF(
+        ert_createFile(
+            &timers->mFile_,
+            timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)));
+    timers->mFile = &timers->mFile_;
+
+    ERT_ERROR_IF(
+        ert_createFileEventQueueActivity(
+            &timers->mActivity_, self, timers->mFile));
+    timers->mActivity = &timers->mActivity_;
+
+    /* The method outlives this stack frame, so construct it directly
+     * rather than using a trampoline. */
+
+    ERT_ERROR_IF(
+        ert_armFileEventQueueActivityMode(
+            timers->mActivity,
+            Ert_FileEventQueuePollRead,
+            Ert_FileEventQueueArmLevelTriggered,
+            Ert_FileEventQueueActivityMethod_(
+                self, dispatchFileEventQueueTimers_)));
+
+    /* Timers might be created concurrently by the methods running in
+     * the threads of a worker pool, so only install the timer queue if
+     * no other thread has done so already. */
+
+    if (__sync_bool_compare_and_swap(&self->mTimers, 0, timers))
+        timers = 0;
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        timers = closeFileEventQueueTimers_(timers);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createFileEventQueue(struct Ert_FileEventQueue *self, int aQueueSize)
+{
+    return ert_createFileEventQueueEngine(
+        self, aQueueSize, Ert_FileEventQueueEpollEngine);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createFileEventQueueEngine(struct Ert_FileEventQueue     *self,
+                               int                            aQueueSize,
+                               enum Ert_FileEventQueueEngine  aEngine)
+{
+    int rc = -1;
+
+    ert_ensure(0 < aQueueSize);
+
+    self->mEngine         = Ert_FileEventQueueEpollEngine;
+    self->mFile           = 0;
+    self->mUring          = 0;
+    self->mTimers         = 0;
+    self->mPool           = 0;
+    self->mQueue          = 0;
+    self->mQueueSize      = 0;
+    self->mQueueMinSize   = 0;
+    self->mQueueResize    = 0;
+    self->mQueueIdlePolls = 0;
+    self->mQueuePending   = 0;
+    self->mNumArmed       = 0;
+    self->mNumPending     = 0;
+
+    self->mStatistics = (struct Ert_FileEventQueueStatistics) { };
+
+    ERT_ERROR_UNLESS(
+        (self->mQueue = malloc(sizeof(*self->mQueue) * aQueueSize)));
+
+    self->mQueueSize    = aQueueSize;
+    self->mQueueMinSize = aQueueSize;
+    self->mQueueResize  = aQueueSize;
+
+    if (Ert_FileEventQueueUringEngine == aEngine)
+        ERT_ERROR_IF(
+            createFileEventQueueUring_(self, aQueueSize));
+
+    if ( ! self->mUring)
+    {
+        ERT_ERROR_IF(
+            ert_createFile(
+                &self->mFile_,
+                epoll_create1(EPOLL_CLOEXEC)));
+        self->mFile = &self->mFile_;
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if (rc)
+        {
+            while (ert_closeFileEventQueue(self))
+                break;
+        }
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+ert_controlFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
+                                   struct Ert_FileEventQueueActivity *aEvent,
+                                   uint32_t                           aEvents,
+                                   int                                aCtlOp)
+{
+    int rc = -1;
+
+    ert_ensure( ! self->mUring);
+
+    struct epoll_event pollEvent =
+    {
+        .events = aEvents,
+        .data   = { .ptr = aEvent },
+    };
+
+    ERT_ERROR_IF(
+        epoll_ctl(self->mFile->mFd, aCtlOp, aEvent->mFile->mFd, &pollEvent));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+ert_attachFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
+                                  struct Ert_FileEventQueueActivity *aEvent)
+{
+    /* Poll requests submitted to io_uring(7) are self-contained, so
+     * there is no need to register the file descriptor beforehand. */
+
+    return self->mUring
+        ? 0
+        : ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_ADD);
+}
+
+static ERT_CHECKED int
+ert_detachFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
+                              struct Ert_FileEventQueueActivity *aEvent)
+{
+    return self->mUring
+        ? 0
+        : ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_DEL);
+}
+
+/* -------------------------------------------------------------------------- */
+struct Ert_FileEventQueue *
+ert_closeFileEventQueue(struct Ert_FileEventQueue *self)
+{
+    if (self)
+    {
+        ert_ensure( ! self->mPool);
+
+        self->mTimers = closeFileEventQueueTimers_(self->mTimers);
+
+        ert_ensure( ! self->mNumArmed);
+        ert_ensure( ! self->mNumPending);
+
+        self->mUring = closeFileEventQueueUring_(self->mUring);
+        self->mFile  = ert_closeFile(self->mFile);
+
+        free(self->mQueue);
+        self->mQueue        = 0;
+        self->mQueueSize    = 0;
+        self->mQueuePending = 0;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static uint32_t
+ert_fetchFileEventQueueActivityPollEvents_(
+    const struct Ert_FileEventQueue         *self,
+    const struct Ert_FileEventQueueActivity *aEvent)
+{
+    uint32_t pollEvents = aEvent->mArmed;
+
+    switch (aEvent->mArmMode)
+    {
+    default:
+        ert_ensure(0);
+
+    case Ert_FileEventQueueArmOneShot:
+        pollEvents |= EPOLLONESHOT;
+        break;
+
+    case Ert_FileEventQueueArmLevelTriggered:
+        break;
+
+    case Ert_FileEventQueueArmEdgeTriggered:
+        pollEvents |= EPOLLET;
+        break;
+    }
+
+    /* When the queue is served by a worker pool, persistent activities
+     * are also registered using EPOLLONESHOT so that each event is
+     * delivered to only one worker, and the activity is only enabled
+     * again after its method returns. */
+
+    if (self->mPool)
+        pollEvents |= EPOLLONESHOT;
+
+    return pollEvents;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+ert_lodgeFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
+                                 struct Ert_FileEventQueueActivity *aEvent)
+{
+    int rc = -1;
+
+    ert_ensure(aEvent->mArmed);
+
+    /* An activity that is armed while a worker is running its method
+     * is only enabled once the method returns, so that the activity is
+     * never dispatched concurrently with itself. */
+
+    if (self->mUring)
+        ERT_ERROR_IF(
+            lodgeFileEventQueueUringActivity_(self, aEvent));
+    else if ( ! aEvent->mDispatching)
+        ERT_ERROR_IF(
+            ert_controlFileEventQueueActivity_(
+                self,
+                aEvent,
+                ert_fetchFileEventQueueActivityPollEvents_(self, aEvent),
+                EPOLL_CTL_MOD));
+
+    /* Activities can be armed concurrently by the methods running in
+     * the threads of a worker pool. */
+
+    __sync_add_and_fetch(&self->mNumArmed, 1);
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+ert_purgeFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
+                                 struct Ert_FileEventQueueActivity *aEvent,
+                                 struct epoll_event                *aPollEvent)
+{
+    if (self->mUring)
+        ERT_ABORT_IF(
+            purgeFileEventQueueUringActivity_(self, aEvent));
+    else
+        ERT_ABORT_IF(
+            ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_MOD));
+
+    /* A one-shot activity is no longer counted as armed once it is
+     * pending, but a persistent activity remains armed throughout. */
+
+    if ( ! aPollEvent || Ert_FileEventQueueArmOneShot != aEvent->mArmMode)
+    {
+        int numArmed = __sync_sub_and_fetch(&self->mNumArmed, 1);
+
+        ert_ensure(0 <= numArmed);
+    }
+
+    if (aPollEvent)
+    {
+        ert_ensure(&self->mQueue[0]               <= aPollEvent &&
+               &self->mQueue[self->mQueueSize] > aPollEvent);
+
+        *aPollEvent = (struct epoll_event) { };
+
+        --self->mNumPending;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static int
+waitFileEventQueue_(struct Ert_FileEventQueue *self,
+                    const struct Ert_Duration *aTimeout)
+{
+    if (self->mUring)
+        return waitFileEventQueueUring_(self, aTimeout);
+
+    /* The timeout of epoll_wait(2) is truncated to milliseconds, so
+     * prefer epoll_pwait2(2) which accepts a timespec. On kernels that
+     * do not provide epoll_pwait2(2), wait for the epoll file descriptor
+     * using ppoll(2), then retrieve the events without waiting. */
+
+    int timeout_ms = aTimeout ? 0 : -1;
+
+    if (aTimeout && aTimeout->duration.ns)
+    {
+#ifdef __NR_epoll_pwait2
+        static bool noEpollPwait2_;
+
+        if ( ! __atomic_load_n(&noEpollPwait2_, __ATOMIC_RELAXED))
+        {
+            struct Ert_NanoSeconds timeout = aTimeout->duration;
+
+            /* The kernel uses struct __kernel_timespec which has
+             * 64 bit fields even on 32 bit architectures. */
+
+            struct
+            {
+                int64_t tv_sec;
+                int64_t tv_nsec;
+            } timeSpec =
+            {
+                .tv_sec  = timeout.ns / (1000 * 1000 * 1000),
+                .tv_nsec = timeout.ns % (1000 * 1000 * 1000),
+            };
+
+            int polledEvents = syscall(
+                __NR_epoll_pwait2,
+                self->mFile->mFd,
+                self->mQueue, self->mQueueSize, &timeSpec, 0, 0);
+
+            if (-1 != polledEvents || ENOSYS != errno)
+                return polledEvents;
+
+            __atomic_store_n(&noEpollPwait2_, true, __ATOMIC_RELAXED);
+        }
+#endif
+
+        struct pollfd pollFd =
+        {
+            .fd     = self->mFile->mFd,
+            .events = POLLIN,
+        };
+
+        int ready = ert_pollFds(&pollFd, 1, aTimeout);
+
+        if (0 >= ready)
+            return ready;
+    }
+
+    return epoll_wait(
+        self->mFile->mFd, self->mQueue, self->mQueueSize, timeout_ms);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+recordFileEventQueueOccupancy_(struct Ert_FileEventQueue *self,
+                               int                        aPolledEvents)
+{
+    ert_recordHistogram(&self->mStatistics.mOccupancy, aPolledEvents);
+
+    /* Schedule the event buffer to grow as soon as a poll fills it, but
+     * only shrink it after a run of polls with low occupancy, to avoid
+     * oscillating. The buffer is only resized once all the events have
+     * been dispatched, since pending activities refer to it. */
+
+    if (self->mQueueSize == aPolledEvents)
+    {
+        ++self->mStatistics.mFullPolls;
+
+        self->mQueueIdlePolls = 0;
+
+        if (FILEEVENTQUEUE_MAX_SIZE_ / 2 >= self->mQueueSize)
+            self->mQueueResize = 2 * self->mQueueSize;
+    }
+    else if (self->mQueueSize / 4 < aPolledEvents ||
+             self->mQueueMinSize == self->mQueueSize)
+    {
+        self->mQueueIdlePolls = 0;
+    }
+    else if (FILEEVENTQUEUE_IDLE_POLLS_ <= ++self->mQueueIdlePolls)
+    {
+        self->mQueueIdlePolls = 0;
+
+        self->mQueueResize = self->mQueueSize / 2;
+
+        if (self->mQueueMinSize > self->mQueueResize)
+            self->mQueueResize = self->mQueueMinSize;
+    }
+}
+
+static void
+resizeFileEventQueue_(struct Ert_FileEventQueue *self)
+{
+    ert_ensure( ! self->mQueuePending);
+    ert_ensure( ! self->mNumPending);
+
+    if (self->mQueueResize != self->mQueueSize)
+    {
+        /* If the buffer cannot be resized, continue to use the existing
+         * buffer since this does not compromise correctness. */
+
+        struct epoll_event *queue = realloc(
+            self->mQueue, sizeof(*queue) * self->mQueueResize);
+
+        if ( ! queue)
+            self->mQueueResize = self->mQueueSize;
+        else
+        {
+            if (self->mQueueResize > self->mQueueSize)
+                ++self->mStatistics.mGrowths;
+            else
+                ++self->mStatistics.mShrinks;
+
+            self->mQueue     = queue;
+            self->mQueueSize = self->mQueueResize;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+const struct Ert_FileEventQueueStatistics *
+ert_ownFileEventQueueStatistics(const struct Ert_FileEventQueue *self)
+{
+    return &self->mStatistics;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+ert_dispatchFileEventQueueActivity_(struct Ert_FileEventQueueActivity *self)
+{
+    int rc = -1;
+
+    struct Ert_FileEventQueueActivityMethod method = self->mMethod;
+
+    ert_ensure(self->mArmed);
+    ert_ensure(self->mPending);
+    ert_ensure( ! ert_ownFileEventQueueActivityMethodNil(method));
+
+    self->mPending = 0;
+
+    /* A one-shot activity is disarmed before its method is called. A
+     * persistent activity whose io_uring(7) poll request has completed
+     * is lodged again beforehand, because the method might disarm or
+     * close the activity. */
+
+    if (Ert_FileEventQueueArmOneShot == self->mArmMode)
+    {
+        self->mArmed  = 0;
+        self->mMethod = Ert_FileEventQueueActivityMethodNil();
+    }
+    else if (self->mQueue->mUring && ! self->mUringSlot)
+    {
+        ERT_ERROR_IF(
+            lodgeFileEventQueueUringActivity_(self->mQueue, self));
+    }
+
+    rc = ert_callFileEventQueueActivityMethod(method);
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_pollFileEventQueueActivity(struct Ert_FileEventQueue *self,
+                               const struct Ert_Duration *aTimeout)
+{
+    int rc = -1;
+
+    ert_ensure( ! self->mPool);
+
+    if ( ! self->mQueuePending)
+    {
+        struct Ert_EventClockTime since = ERT_EVENTCLOCKTIME_INIT;
+        struct Ert_Duration       remaining;
+
+        int polledEvents;
+
+        resizeFileEventQueue_(self);
+
+        while (1)
+        {
+            const struct Ert_Duration *timeout = 0;
+
+            if (aTimeout)
+            {
+                (void) ert_deadlineTimeExpired(
+                    &since, *aTimeout, &remaining, 0);
+
+                timeout = &remaining;
+            }
+
+            ERT_ERROR_IF(
+                (polledEvents = waitFileEventQueue_(self, timeout),
+                 -1 == polledEvents && EINTR != errno));
+
+            if (0 <= polledEvents)
+                break;
+
+            /* Indefinite waits will always terminate if the wait was
+             * interrupted by EINTR. */
+
+            if ( ! timeout)
+            {
+                polledEvents = 0;
+                break;
+            }
+        }
+
+        for (int ix = 0; ix < polledEvents; ++ix)
+        {
+            struct Ert_FileEventQueueActivity *event =
+                self->mQueue[ix].data.ptr;
+
+            /* A multishot io_uring(7) poll request can post more than
+             * one completion for the same activity, so merge these
+             * into a single pending event. */
+
+            if (event->mPending)
+            {
+                event->mPending->events |= self->mQueue[ix].events;
+
+                self->mQueue[ix] = (struct epoll_event) { };
+                continue;
+            }
+
+            ert_markFileEventQueueActivityPending_(event, &self->mQueue[ix]);
+
+            if (Ert_FileEventQueueArmOneShot == event->mArmMode)
+            {
+                ert_ensure(self->mNumArmed);
+
+                --self->mNumArmed;
+            }
+
+            ++self->mNumPending;
+        }
+
+        self->mQueuePending = polledEvents;
+
+        recordFileEventQueueOccupancy_(self, polledEvents);
+    }
+
+    while (self->mQueuePending)
+    {
+        int eventIndex = --self->mQueuePending;
+
+        struct Ert_FileEventQueueActivity *event =
+            self->mQueue[eventIndex].data.ptr;
+
+        if (event)
+        {
+            --self->mNumPending;
+
+            ERT_ERROR_IF(
+                ert_dispatchFileEventQueueActivity_(event));
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createFileEventQueueActivity(struct Ert_FileEventQueueActivity *self,
+                                 struct Ert_FileEventQueue         *aQueue,
+                                 struct Ert_File                   *aFile)
+{
+    int rc = -1;
+
+    self->mQueue     = aQueue;
+    self->mFile      = aFile;
+    self->mArmed     = 0;
+    self->mArmMode   = Ert_FileEventQueueArmOneShot;
+    self->mPending   = 0;
+    self->mUringSlot   = 0;
+    self->mDispatching = 0;
+    self->mMethod      = Ert_FileEventQueueActivityMethodNil();
+
+    ERT_ERROR_IF(
+        ert_attachFileEventQueueActivity_(self->mQueue, self));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_armFileEventQueueActivity(struct Ert_FileEventQueueActivity      *self,
+                              enum Ert_FileEventQueuePollTrigger      aTrigger,
+                              struct Ert_FileEventQueueActivityMethod aMethod)
+{
+    return ert_armFileEventQueueActivityMode(
+        self, aTrigger, Ert_FileEventQueueArmOneShot, aMethod);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_armFileEventQueueActivityMode(
+    struct Ert_FileEventQueueActivity      *self,
+    enum Ert_FileEventQueuePollTrigger      aTrigger,
+    enum Ert_FileEventQueueArmMode          aMode,
+    struct Ert_FileEventQueueActivityMethod aMethod)
+{
+    int rc = -1;
+
+    pthread_mutex_t *lock = lockFileEventQueuePool_(self->mQueue);
+
+    ert_ensure( ! self->mArmed);
+    ert_ensure( ! self->mPending);
+    ert_ensure(ert_ownFileEventQueueActivityMethodNil(self->mMethod));
+
+    self->mArmed   = pollTriggers_[aTrigger];
+    self->mArmMode = aMode;
+    self->mMethod  = aMethod;
+
+    ERT_ERROR_IF(
+        ert_lodgeFileEventQueueActivity_(self->mQueue, self),
+        {
+            self->mArmed  = 0;
+            self->mMethod = Ert_FileEventQueueActivityMethodNil();
+        });
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        lock = ert_unlockMutex(lock);
+    });
+
+    return rc;
 }
 
 /* -------------------------------------------------------------------------- */
-static ERT_CHECKED int
-ert_disarmFileEventQueueActivity_(struct Ert_FileEventQueueActivity *self)
+void
+ert_disarmFileEventQueueActivity(struct Ert_FileEventQueueActivity *self)
 {
-    struct Ert_FileEventQueueActivityMethod method = self->mMethod;
+    pthread_mutex_t *lock = lockFileEventQueuePool_(self->mQueue);
 
-    ert_ensure(self->mArmed);
-    ert_ensure(self->mPending);
-    ert_ensure( ! ert_ownFileEventQueueActivityMethodNil(method));
+    if (self->mArmed)
+        ert_purgeFileEventQueueActivity_(self->mQueue, self, self->mPending);
 
     self->mArmed   = 0;
     self->mPending = 0;
     self->mMethod  = Ert_FileEventQueueActivityMethodNil();
 
-    return ert_callFileEventQueueActivityMethod(method);
+    lock = ert_unlockMutex(lock);
 }
 
 /* -------------------------------------------------------------------------- */
-int
-ert_createFileEventQueue(struct Ert_FileEventQueue *self, int aQueueSize)
+struct Ert_FileEventQueueActivity *
+ert_closeFileEventQueueActivity(struct Ert_FileEventQueueActivity *self)
 {
-    int rc = -1;
+    if (self)
+    {
+        ert_disarmFileEventQueueActivity(self);
 
-    ert_ensure(0 < aQueueSize);
+        /* If the activity is closed by its own method, tell the worker
+         * running the method not to refer to the activity again. */
 
-    self->mFile         = 0;
-    self->mQueue        = 0;
-    self->mQueueSize    = 0;
-    self->mQueuePending = 0;
-    self->mNumArmed     = 0;
-    self->mNumPending   = 0;
+        pthread_mutex_t *lock = lockFileEventQueuePool_(self->mQueue);
 
-    ERT_ERROR_UNLESS(
-        (self->mQueue = malloc(sizeof(*self->mQueue) * aQueueSize)));
+        if (self->mDispatching)
+            *self->mDispatching = false;
 
-    self->mQueueSize = aQueueSize;
+        self->mDispatching = 0;
 
-    ERT_ERROR_IF(
-        ert_createFile(
-            &self->mFile_,
-            epoll_create1(EPOLL_CLOEXEC)));
-    self->mFile = &self->mFile_;
+        lock = ert_unlockMutex(lock);
+
+        ERT_ABORT_IF(
+            ert_detachFileEventQueueActivity_(self->mQueue, self));
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createFileEventQueueTimer(struct Ert_FileEventQueueTimer *self,
+                              struct Ert_FileEventQueue      *aQueue)
+{
+    int rc = -1;
+
+    self->mQueue     = aQueue;
+    self->mDeadline  = (struct Ert_MonotonicTime) { };
+    self->mSequence  = 0;
+    self->mHeapIndex = 0;
+    self->mArmed     = false;
+    self->mMethod    = Ert_FileEventQueueActivityMethodNil();
+
+    if ( ! self->mQueue->mTimers)
+        ERT_ERROR_IF(
+            createFileEventQueueTimers_(self->mQueue));
 
     rc = 0;
 
 Ert_Finally:
 
-    ERT_FINALLY
-    ({
-        if (rc)
-        {
-            while (ert_closeFileEventQueue(self))
-                break;
-        }
-    });
+    ERT_FINALLY({});
 
     return rc;
 }
 
 /* -------------------------------------------------------------------------- */
 static ERT_CHECKED int
-ert_controlFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
-                                   struct Ert_FileEventQueueActivity *aEvent,
-                                   uint32_t                           aEvents,
-                                   int                                aCtlOp)
+ert_lodgeFileEventQueueTimer_(struct Ert_FileEventQueueTimer          *self,
+                              const struct Ert_Duration               *aTimeout,
+                              struct Ert_FileEventQueueActivityMethod  aMethod)
 {
     int rc = -1;
 
-    struct epoll_event pollEvent =
+    struct Ert_FileEventQueueTimers *timers = self->mQueue->mTimers;
+
+    pthread_mutex_t *lock = ert_lockMutex(timers->mMutex);
+
+    ert_ensure( ! self->mArmed);
+    ert_ensure( ! self->mHeapIndex);
+    ert_ensure(ert_ownFileEventQueueActivityMethodNil(self->mMethod));
+    ert_ensure( ! ert_ownFileEventQueueActivityMethodNil(aMethod));
+
+    /* A timer without a timeout is armed, but never expires, so there
+     * is no need to place it in the heap. */
+
+    if (aTimeout)
     {
-        .events = aEvents,
-        .data   = { .ptr = aEvent },
-    };
+        self->mDeadline = (struct Ert_MonotonicTime) {
+            .monotonic = Ert_NanoSeconds(
+                ert_monotonicTime().monotonic.ns + aTimeout->duration.ns) };
 
-    ERT_ERROR_IF(
-        epoll_ctl(self->mFile->mFd, aCtlOp, aEvent->mFile->mFd, &pollEvent));
+        ERT_ERROR_IF(
+            insertFileEventQueueTimer_(timers, self));
+
+        ERT_ERROR_IF(
+            programFileEventQueueTimers_(timers),
+            {
+                removeFileEventQueueTimer_(timers, self);
+            });
+    }
+
+    self->mArmed  = true;
+    self->mMethod = aMethod;
+
+    ++timers->mNumArmed;
 
     rc = 0;
 
 Ert_Finally:
 
-    ERT_FINALLY({});
+    ERT_FINALLY
+    ({
+        lock = ert_unlockMutex(lock);
+    });
 
     return rc;
 }
 
 /* -------------------------------------------------------------------------- */
-static ERT_CHECKED int
-ert_attachFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
-                                  struct Ert_FileEventQueueActivity *aEvent)
-{
-    return ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_ADD);
-}
-
-static ERT_CHECKED int
-ert_detachFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
-                              struct Ert_FileEventQueueActivity *aEvent)
+int
+ert_armFileEventQueueTimer(struct Ert_FileEventQueueTimer         *self,
+                           struct Ert_Duration                     aTimeout,
+                           struct Ert_FileEventQueueActivityMethod aMethod)
 {
-    return ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_DEL);
+    return ert_lodgeFileEventQueueTimer_(self, &aTimeout, aMethod);
 }
 
 /* -------------------------------------------------------------------------- */
-struct Ert_FileEventQueue *
-ert_closeFileEventQueue(struct Ert_FileEventQueue *self)
+int
+ert_armFileEventQueueTimerDeadline(
+    struct Ert_FileEventQueueTimer         *self,
+    const struct Ert_Deadline              *aDeadline,
+    struct Ert_FileEventQueueActivityMethod aMethod)
 {
-    if (self)
+    /* The deadline is measured using the event clock, but the timer
+     * is measured using the monotonic clock, so translate the time
+     * remaining before the deadline expires. A deadline that has not
+     * yet been started is measured from now, and a deadline without
+     * a duration never expires. */
+
+    struct Ert_Duration  timeout_ = Ert_ZeroDuration;
+    struct Ert_Duration *timeout  = &timeout_;
+
+    if ( ! aDeadline->mDuration)
+        timeout = 0;
+    else if ( ! aDeadline->mExpired)
     {
-        ert_ensure( ! self->mNumArmed);
-        ert_ensure( ! self->mNumPending);
+        if ( ! aDeadline->mSince.eventclock.ns)
+            timeout_ = *aDeadline->mDuration;
+        else
+        {
+            uint64_t expiry =
+                aDeadline->mSince.eventclock.ns +
+                aDeadline->mDuration->duration.ns;
 
-        self->mFile = ert_closeFile(self->mFile);
+            uint64_t now = ert_eventclockTime().eventclock.ns;
 
-        free(self->mQueue);
-        self->mQueue        = 0;
-        self->mQueueSize    = 0;
-        self->mQueuePending = 0;
+            if (expiry > now)
+                timeout_ = Ert_Duration(Ert_NanoSeconds(expiry - now));
+        }
     }
 
-    return 0;
+    return ert_lodgeFileEventQueueTimer_(self, timeout, aMethod);
 }
 
 /* -------------------------------------------------------------------------- */
-static ERT_CHECKED int
-ert_lodgeFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
-                                 struct Ert_FileEventQueueActivity *aEvent)
+void
+ert_disarmFileEventQueueTimer(struct Ert_FileEventQueueTimer *self)
 {
-    int rc = -1;
+    struct Ert_FileEventQueueTimers *timers = self->mQueue->mTimers;
 
-    ert_ensure(aEvent->mArmed);
+    pthread_mutex_t *lock = ert_lockMutex(timers->mMutex);
 
-    ERT_ERROR_IF(
-        ert_controlFileEventQueueActivity_(
-            self, aEvent, aEvent->mArmed | EPOLLONESHOT, EPOLL_CTL_MOD));
+    if (self->mArmed)
+    {
+        ert_ensure(timers->mNumArmed);
 
-    ++self->mNumArmed;
+        --timers->mNumArmed;
 
-    rc = 0;
+        /* Failing to reprogram the timerfd is benign because the timer
+         * queue tolerates the timerfd firing early. */
 
-Ert_Finally:
+        if (self->mHeapIndex)
+        {
+            removeFileEventQueueTimer_(timers, self);
 
-    ERT_FINALLY({});
+            if (programFileEventQueueTimers_(timers))
+                timers->mExpiry = 0;
+        }
+    }
 
-    return rc;
+    self->mArmed  = false;
+    self->mMethod = Ert_FileEventQueueActivityMethodNil();
+
+    lock = ert_unlockMutex(lock);
 }
 
 /* -------------------------------------------------------------------------- */
-static void
-ert_purgeFileEventQueueActivity_(struct Ert_FileEventQueue         *self,
-                                 struct Ert_FileEventQueueActivity *aEvent,
-                                 struct epoll_event                *aPollEvent)
+struct Ert_FileEventQueueTimer *
+ert_closeFileEventQueueTimer(struct Ert_FileEventQueueTimer *self)
 {
-    ert_ensure(self->mNumArmed);
-
-    ERT_ABORT_IF(
-        ert_controlFileEventQueueActivity_(self, aEvent, 0, EPOLL_CTL_MOD));
-
-    --self->mNumArmed;
-
-    if (aPollEvent)
-    {
-        ert_ensure(&self->mQueue[0]               <= aPollEvent &&
-               &self->mQueue[self->mQueueSize] > aPollEvent);
-
-        *aPollEvent = (struct epoll_event) { };
+    if (self)
+        ert_disarmFileEventQueueTimer(self);
 
-        --self->mNumPending;
-    }
+    return 0;
 }
 
 /* -------------------------------------------------------------------------- */
-int
-ert_pollFileEventQueueActivity(struct Ert_FileEventQueue *self,
-                               const struct Ert_Duration *aTimeout)
+/* Worker Pool
+ *
+ * The read end of the stop pipe is registered with the epoll(7) instance
+ * without EPOLLONESHOT, and is never drained, so that once the pipe is
+ * written every worker in turn receives the event and stops. The stop
+ * event is recognised because its user data refers to the pool rather
+ * than to an activity. */
+
+static ERT_CHECKED int
+runFileEventQueueWorker_(void *self_)
 {
     int rc = -1;
 
-    if ( ! self->mQueuePending)
+    struct Ert_FileEventQueuePool *self  = self_;
+    struct Ert_FileEventQueue     *queue = self->mQueue;
+
+    pthread_mutex_t *lock = 0;
+
+    while (1)
     {
-        int timeout_ms = -1;
+        /* Take only one event at a time so that the events that are
+         * ready are shared among the idle workers, rather than being
+         * held by a worker that is running a slow method. */
 
-        struct Ert_EventClockTime since = ERT_EVENTCLOCKTIME_INIT;
-        struct Ert_Duration       remaining;
+        struct epoll_event pollEvent;
 
         int polledEvents;
 
-        while (1)
-        {
-            if (aTimeout)
-            {
-                if (ert_deadlineTimeExpired(&since, *aTimeout, &remaining, 0))
-                    timeout_ms = 0;
-                else
-                {
-                    struct Ert_MilliSeconds timeoutDuration =
-                        ERT_MSECS(remaining.duration);
+        ERT_ERROR_IF(
+            (polledEvents = epoll_wait(queue->mFile->mFd, &pollEvent, 1, -1),
+             -1 == polledEvents && EINTR != errno));
 
-                    timeout_ms = timeoutDuration.ms;
+        if (1 != polledEvents)
+            continue;
 
-                    if (0 > timeout_ms || timeoutDuration.ms != timeout_ms)
-                        timeout_ms = INT_MAX;
-                }
-            }
+        if (self == pollEvent.data.ptr)
+            break;
 
-            ERT_ERROR_IF(
-                (polledEvents = epoll_wait(
-                   self->mFile->mFd,
-                   self->mQueue, self->mQueueSize, timeout_ms),
-                 -1 == polledEvents && EINTR != errno));
+        struct Ert_FileEventQueueActivity *event = pollEvent.data.ptr;
 
-            if (0 <= polledEvents)
-                break;
+        /* Discard an event that was delivered before the activity was
+         * disarmed, or while its method is running in another worker
+         * after the activity was disarmed and armed again. The worker
+         * running the method will enable the activity again. */
 
-            /* Indefinite waits will always terminate if the wait was
-             * interrupted by EINTR. */
+        lock = ert_lockMutex(self->mMutex);
 
-            if (0 > timeout_ms)
-            {
-                polledEvents = 0;
-                break;
-            }
+        if ( ! event->mArmed || event->mDispatching)
+        {
+            lock = ert_unlockMutex(lock);
+            continue;
         }
 
-        for (int ix = 0; ix < polledEvents; ++ix)
+        struct Ert_FileEventQueueActivityMethod method = event->mMethod;
+
+        bool dispatching = true;
+
+        event->mDispatching = &dispatching;
+
+        if (Ert_FileEventQueueArmOneShot == event->mArmMode)
         {
-            struct Ert_FileEventQueueActivity *event =
-                self->mQueue[ix].data.ptr;
+            int numArmed = __sync_sub_and_fetch(&queue->mNumArmed, 1);
 
-            ert_markFileEventQueueActivityPending_(event, &self->mQueue[ix]);
-        }
+            ert_ensure(0 <= numArmed);
 
-        self->mQueuePending = polledEvents;
+            event->mArmed  = 0;
+            event->mMethod = Ert_FileEventQueueActivityMethodNil();
+        }
 
-        ert_ensure(self->mNumArmed >= polledEvents);
+        lock = ert_unlockMutex(lock);
 
-        self->mNumArmed   -= polledEvents;
-        self->mNumPending += polledEvents;
-    }
+        /* Run the method in its own error frame sequence, so that the
+         * frames of a failed method are logged and then discarded
+         * rather than accumulating in the worker. */
 
-    while (self->mQueuePending)
-    {
-        int eventIndex = --self->mQueuePending;
+        struct Ert_ErrorFrameSequence frameSequence =
+            ert_pushErrorFrameSequence();
 
-        struct Ert_FileEventQueueActivity *event =
-            self->mQueue[eventIndex].data.ptr;
+        int err = ert_callFileEventQueueActivityMethod(method);
 
-        if (event)
+        if (err)
         {
-            --self->mNumPending;
+            err = errno ? errno : EIO;
 
-            ERT_ERROR_IF(
-                ert_disarmFileEventQueueActivity_(event));
+            ert_logErrorFrameSequence(0);
         }
+
+        ert_popErrorFrameSequence(frameSequence);
+
+        /* Enable the activity again if it is still armed once the method
+         * returns, unless the method closed the activity. This is done
+         * even if the method failed, so that the file descriptor is not
+         * left without a poller. */
+
+        lock = ert_lockMutex(self->mMutex);
+
+        if (dispatching)
+            event->mDispatching = 0;
+
+        if (dispatching && event->mArmed)
+            ERT_ERROR_IF(
+                ert_controlFileEventQueueActivity_(
+                    queue,
+                    event,
+                    ert_fetchFileEventQueueActivityPollEvents_(queue, event),
+                    EPOLL_CTL_MOD));
+
+        lock = ert_unlockMutex(lock);
+
+        /* There is no caller to receive the error from the method, so
+         * report the failure and keep the worker running to serve the
+         * other activities. */
+
+        if (err)
+            ert_warn(err, "Unable to call worker pool activity method");
     }
 
     rc = 0;
 
 Ert_Finally:
 
-    ERT_FINALLY({});
+    ERT_FINALLY
+    ({
+        lock = ert_unlockMutex(lock);
+    });
 
     return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+rearmFileEventQueueTimers_(struct Ert_FileEventQueue *self)
+{
+    /* The activity of the timer queue remains armed throughout, so
+     * register it again when the queue enters or leaves pool mode. */
+
+    return ! self->mTimers
+        ? 0
+        : ert_controlFileEventQueueActivity_(
+            self,
+            self->mTimers->mActivity,
+            ert_fetchFileEventQueueActivityPollEvents_(
+                self, self->mTimers->mActivity),
+            EPOLL_CTL_MOD);
+}
+
 /* -------------------------------------------------------------------------- */
 int
-ert_createFileEventQueueActivity(struct Ert_FileEventQueueActivity *self,
-                                 struct Ert_FileEventQueue         *aQueue,
-                                 struct Ert_File                   *aFile)
+ert_createFileEventQueuePool(struct Ert_FileEventQueuePool *self,
+                             struct Ert_FileEventQueue     *aQueue,
+                             unsigned                       aNumThreads)
 {
     int rc = -1;
 
-    self->mQueue   = aQueue;
-    self->mFile    = aFile;
-    self->mArmed   = 0;
-    self->mPending = 0;
-    self->mMethod  = Ert_FileEventQueueActivityMethodNil();
+    self->mQueue      = aQueue;
+    self->mMutex      = 0;
+    self->mStopPipe   = 0;
+    self->mThreads    = 0;
+    self->mNumThreads = 0;
+
+    ert_ensure(aNumThreads);
+    ert_ensure( ! aQueue->mPool);
+    ert_ensure( ! aQueue->mQueuePending);
+    ert_ensure(aQueue->mNumArmed == ( ! aQueue->mTimers ? 0 : 1));
 
     ERT_ERROR_IF(
-        ert_attachFileEventQueueActivity_(self->mQueue, self));
+        aQueue->mUring,
+        {
+            errno = EINVAL;
+        });
 
-    rc = 0;
+    ERT_ERROR_UNLESS(
+        (self->mMutex = ert_createMutex(&self->mMutex_)));
 
-Ert_Finally:
+    ERT_ERROR_IF(
+        ert_createPipe(&self->mStopPipe_, O_CLOEXEC | O_NONBLOCK));
+    self->mStopPipe = &self->mStopPipe_;
 
-    ERT_FINALLY({});
+    {
+        struct epoll_event pollEvent =
+        {
+            .events = EPOLLIN,
+            .data   = { .ptr = self },
+        };
+
+        ERT_ERROR_IF(
+            epoll_ctl(
+                aQueue->mFile->mFd,
+                EPOLL_CTL_ADD, self->mStopPipe->mRdFile->mFd, &pollEvent));
+    }
 
-    return rc;
-}
+    ERT_ERROR_UNLESS(
+        (self->mThreads = malloc(sizeof(*self->mThreads) * aNumThreads)));
 
-/* -------------------------------------------------------------------------- */
-int
-ert_armFileEventQueueActivity(struct Ert_FileEventQueueActivity      *self,
-                              enum Ert_FileEventQueuePollTrigger      aTrigger,
-                              struct Ert_FileEventQueueActivityMethod aMethod)
-{
-    int rc = -1;
+    aQueue->mPool = self;
 
-    ert_ensure( ! self->mArmed);
-    ert_ensure( ! self->mPending);
-    ert_ensure(ert_ownFileEventQueueActivityMethodNil(self->mMethod));
+    ERT_ERROR_IF(
+        rearmFileEventQueueTimers_(aQueue));
 
-    self->mArmed  = pollTriggers_[aTrigger];
-    self->mMethod = aMethod;
+    /* The method outlives this stack frame, so construct it directly
+     * rather than using a trampoline. */
 
-    ERT_ERROR_IF(
-        ert_lodgeFileEventQueueActivity_(self->mQueue, self));
+    for (unsigned ix = 0; aNumThreads > ix; ++ix)
+    {
+        ERT_ERROR_UNLESS(
+            ert_createThread(
+                &self->mThreads[ix],
+                "fileeventqueue",
+                0,
+                Ert_ThreadMethod_(self, runFileEventQueueWorker_)));
+
+        ++self->mNumThreads;
+    }
 
     rc = 0;
 
 Ert_Finally:
 
-    ERT_FINALLY({});
+    ERT_FINALLY
+    ({
+        if (rc)
+        {
+            while (ert_closeFileEventQueuePool(self))
+                break;
+        }
+    });
 
     return rc;
 }
 
 /* -------------------------------------------------------------------------- */
-struct Ert_FileEventQueueActivity *
-ert_closeFileEventQueueActivity(struct Ert_FileEventQueueActivity *self)
+struct Ert_FileEventQueuePool *
+ert_closeFileEventQueuePool(struct Ert_FileEventQueuePool *self)
 {
     if (self)
     {
-        if (self->mArmed)
-            ert_purgeFileEventQueueActivity_(
-                self->mQueue, self, self->mPending);
+        if (self->mNumThreads)
+        {
+            ssize_t wrLen;
 
-        self->mArmed   = 0;
-        self->mPending = 0;
-        self->mMethod  = Ert_FileEventQueueActivityMethodNil();
+            ERT_ABORT_IF(
+                (wrLen = ert_writeFile(
+                    self->mStopPipe->mWrFile, "", 1, 0),
+                 1 != wrLen));
 
-        ERT_ABORT_IF(
-            ert_detachFileEventQueueActivity_(self->mQueue, self));
+            for (unsigned ix = 0; self->mNumThreads > ix; ++ix)
+                while (ert_closeThread(&self->mThreads[ix]))
+                    break;
+
+            self->mNumThreads = 0;
+        }
+
+        free(self->mThreads);
+        self->mThreads = 0;
+
+        if (self == self->mQueue->mPool)
+        {
+            ert_ensure(self->mQueue->mNumArmed ==
+                       ( ! self->mQueue->mTimers ? 0 : 1));
+
+            self->mQueue->mPool = 0;
+
+            ERT_ABORT_IF(
+                rearmFileEventQueueTimers_(self->mQueue));
+        }
+
+        if (self->mStopPipe)
+        {
+            ERT_ABORT_IF(
+                epoll_ctl(
+                    self->mQueue->mFile->mFd,
+                    EPOLL_CTL_DEL, self->mStopPipe->mRdFile->mFd, 0));
+
+            self->mStopPipe = ert_closePipe(self->mStopPipe);
+        }
+
+        self->mMutex = ert_destroyMutex(self->mMutex);
     }
 
     return 0;
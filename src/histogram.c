@@ -0,0 +1,183 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/histogram.h"
+#include "ert/error.h"
+#include "ert/printf.h"
+
+#include <string.h>
+#include <inttypes.h>
+
+/* -------------------------------------------------------------------------- */
+static unsigned
+histogramBucket_(uint64_t aValue)
+{
+    unsigned bucket =
+        aValue ? sizeof(unsigned long long) * 8 - __builtin_clzll(aValue) : 0;
+
+    return ERT_HISTOGRAM_BUCKETS > bucket ? bucket : ERT_HISTOGRAM_BUCKETS - 1;
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_clearHistogram(
+    struct Ert_Histogram *self)
+{
+    memset(self, 0, sizeof(*self));
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_recordHistogram(
+    struct Ert_Histogram *self,
+    uint64_t              aValue)
+{
+    ++self->mCount;
+    ++self->mBuckets[histogramBucket_(aValue)];
+
+    self->mSum += aValue;
+
+    if (self->mMax < aValue)
+        self->mMax = aValue;
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_mergeHistogram(
+    struct Ert_Histogram       *self,
+    const struct Ert_Histogram *aOther)
+{
+    self->mCount += aOther->mCount;
+    self->mSum   += aOther->mSum;
+
+    if (self->mMax < aOther->mMax)
+        self->mMax = aOther->mMax;
+
+    for (unsigned bucket = 0; ERT_HISTOGRAM_BUCKETS > bucket; ++bucket)
+        self->mBuckets[bucket] += aOther->mBuckets[bucket];
+}
+
+/* -------------------------------------------------------------------------- */
+uint64_t
+ert_fetchHistogramBucketLimit(
+    unsigned aBucket)
+{
+    ert_ensure(ERT_HISTOGRAM_BUCKETS > aBucket);
+
+    return ERT_HISTOGRAM_BUCKETS - 1 > aBucket
+        ? (UINT64_C(1) << aBucket) - 1
+        : UINT64_MAX;
+}
+
+/* -------------------------------------------------------------------------- */
+uint64_t
+ert_fetchHistogramPercentile(
+    const struct Ert_Histogram *self,
+    unsigned                    aPercentile)
+{
+    ert_ensure(100 >= aPercentile);
+
+    /* Find the bucket containing the sample at the requested rank,
+     * and report the largest value that the bucket can hold. This
+     * overestimates the percentile by less than a factor of two, but
+     * never by more than the largest sample actually recorded. */
+
+    uint64_t rank  = (self->mCount * aPercentile + 99) / 100;
+    uint64_t limit = 0;
+
+    if (rank)
+    {
+        uint64_t count = 0;
+
+        for (unsigned bucket = 0; ERT_HISTOGRAM_BUCKETS > bucket; ++bucket)
+        {
+            count += self->mBuckets[bucket];
+
+            if (count >= rank)
+            {
+                limit = ert_fetchHistogramBucketLimit(bucket);
+                break;
+            }
+        }
+
+        if (limit > self->mMax)
+            limit = self->mMax;
+    }
+
+    return limit;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_printHistogram(
+    const struct Ert_Histogram *self,
+    int                         aFd,
+    const char                 *aName)
+{
+    int rc = -1;
+
+    ERT_ERROR_IF(
+        ert_writeFdPrintf(
+            aFd,
+            "%s count %" PRIu64
+            " mean %" PRIu64
+            " max %" PRIu64
+            " p50 %" PRIu64
+            " p90 %" PRIu64
+            " p99 %" PRIu64 "\n",
+            aName,
+            self->mCount,
+            self->mCount ? self->mSum / self->mCount : 0,
+            self->mMax,
+            ert_fetchHistogramPercentile(self, 50),
+            ert_fetchHistogramPercentile(self, 90),
+            ert_fetchHistogramPercentile(self, 99)));
+
+    for (unsigned bucket = 0; ERT_HISTOGRAM_BUCKETS > bucket; ++bucket)
+    {
+        if (self->mBuckets[bucket])
+            ERT_ERROR_IF(
+                ert_writeFdPrintf(
+                    aFd,
+                    "%s le %" PRIu64 " %" PRIu64 "\n",
+                    aName,
+                    ert_fetchHistogramBucketLimit(bucket),
+                    self->mBuckets[bucket]));
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
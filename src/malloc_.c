@@ -28,8 +28,18 @@
 */
 
 #include "malloc_.h"
+#include "ert/malloc.h"
+#include "ert/histogram.h"
+#include "ert/threadstatistics.h"
 #include "ert/thread.h"
+#include "ert/process.h"
 #include "ert/error.h"
+#include "ert/printf.h"
+
+#include <execinfo.h>
+#include <inttypes.h>
+
+#include <sys/resource.h>
 
 /* -------------------------------------------------------------------------- */
 /* Memory allocators
@@ -44,11 +54,282 @@
  * running in other threads are synchronised by the mutex in the
  * allocator itself.
  *
+ * If signal deferral has been enabled using ert_deferProcessSignals(),
+ * the depth of the critical section serves as an in-allocator flag that
+ * the signal dispatchers check, so that no system calls are made in
+ * the common case. Deferral is suspended while any handler installed
+ * directly, rather than through this library, remains installed because
+ * such a handler would run in the middle of the allocator. Otherwise
+ * signals are blocked using the signal mask.
+ *
  * Allocators preserve the error frame sequence because allocators
  * are called during teardown in the unit test framework (eg gtest),
  * and its worth trying to preserve the error frame sequence so that
  * it can be logged. */
 
+/* -------------------------------------------------------------------------- */
+/* Allocation Telemetry
+ *
+ * Telemetry is recorded by each thread using Ert_ThreadStatistics, whose
+ * blocks are mapped directly so that recording telemetry never recurses
+ * into the allocator.
+ *
+ * Allocations made while recording or printing telemetry, for example
+ * by backtrace() or ert_writeFdPrintf(), are not themselves recorded. */
+
+enum MallocTelemetryCall_
+{
+    MallocTelemetryMalloc_,
+    MallocTelemetryCalloc_,
+    MallocTelemetryRealloc_,
+    MallocTelemetryMemalign_,
+    MallocTelemetryValloc_,
+    MallocTelemetryPvalloc_,
+    MallocTelemetryFree_,
+    MallocTelemetryCalls_,
+};
+
+static const char *mallocTelemetryCallName_[MallocTelemetryCalls_] =
+{
+    [MallocTelemetryMalloc_]   = "malloc",
+    [MallocTelemetryCalloc_]   = "calloc",
+    [MallocTelemetryRealloc_]  = "realloc",
+    [MallocTelemetryMemalign_] = "memalign",
+    [MallocTelemetryValloc_]   = "valloc",
+    [MallocTelemetryPvalloc_]  = "pvalloc",
+    [MallocTelemetryFree_]     = "free",
+};
+
+#define MALLOC_TELEMETRY_SAMPLES_ 16
+#define MALLOC_TELEMETRY_DEPTH_   8
+
+struct MallocTelemetrySample_
+{
+    size_t mSize;
+    int    mDepth;
+    void  *mFrames[MALLOC_TELEMETRY_DEPTH_];
+};
+
+struct MallocTelemetry_
+{
+    uint64_t mCalls[MallocTelemetryCalls_];
+    uint64_t mAllocated;
+    uint64_t mFreed;
+    int64_t  mInFlight;
+    int64_t  mPeak;
+
+    struct Ert_Histogram mSizes;
+
+    unsigned                      mCountdown;
+    unsigned                      mNumSamples;
+    struct MallocTelemetrySample_ mSamples[MALLOC_TELEMETRY_SAMPLES_];
+};
+
+static void
+mergeMallocTelemetry_(
+    void       *self_,
+    const void *aOther_)
+{
+    struct MallocTelemetry_       *self   = self_;
+    const struct MallocTelemetry_ *aOther = aOther_;
+
+    for (unsigned ix = 0; MallocTelemetryCalls_ > ix; ++ix)
+        self->mCalls[ix] += aOther->mCalls[ix];
+
+    self->mAllocated += aOther->mAllocated;
+    self->mFreed     += aOther->mFreed;
+    self->mInFlight  += aOther->mInFlight;
+
+    if (self->mPeak < aOther->mPeak)
+        self->mPeak = aOther->mPeak;
+
+    ert_mergeHistogram(&self->mSizes, &aOther->mSizes);
+}
+
+static struct
+{
+    unsigned mEnabled;
+    unsigned mSampleInterval;
+
+    struct MallocTelemetry_     mExited;
+    struct Ert_ThreadStatistics mStatistics;
+
+} mallocTelemetry_ =
+{
+    .mStatistics = ERT_THREADSTATISTICS_INITIALIZER(
+        &mallocTelemetry_.mExited, mergeMallocTelemetry_),
+};
+
+static __thread struct Ert_ThreadStatisticsThread mallocThreadTelemetry_;
+
+static size_t
+fetchMallocTelemetrySize_(void *aBlock)
+{
+    return
+        aBlock &&
+        __atomic_load_n(&mallocTelemetry_.mEnabled, __ATOMIC_RELAXED)
+        ? malloc_usable_size(aBlock)
+        : 0;
+}
+
+static void
+recordMallocTelemetry_(
+    enum MallocTelemetryCall_  aCall,
+    size_t                     aSize,
+    void                      *aBlock,
+    size_t                     aFreed)
+{
+    if (__atomic_load_n(&mallocTelemetry_.mEnabled, __ATOMIC_RELAXED))
+    {
+        struct MallocTelemetry_ *self = ert_beginThreadStatistics(
+            &mallocTelemetry_.mStatistics, &mallocThreadTelemetry_);
+
+        if (self)
+        {
+            size_t allocated = aBlock ? malloc_usable_size(aBlock) : 0;
+
+            ++self->mCalls[aCall];
+
+            self->mAllocated += allocated;
+            self->mFreed     += aFreed;
+            self->mInFlight  += (int64_t) allocated - (int64_t) aFreed;
+
+            if (self->mPeak < self->mInFlight)
+                self->mPeak = self->mInFlight;
+
+            if (aBlock)
+            {
+                ert_recordHistogram(&self->mSizes, aSize);
+
+                unsigned interval = __atomic_load_n(
+                    &mallocTelemetry_.mSampleInterval, __ATOMIC_RELAXED);
+
+                if (interval && ( ! self->mCountdown || ! --self->mCountdown))
+                {
+                    struct MallocTelemetrySample_ *sample =
+                        &self->mSamples[
+                            self->mNumSamples++ % MALLOC_TELEMETRY_SAMPLES_];
+
+                    sample->mSize  = aSize;
+                    sample->mDepth = backtrace(
+                        sample->mFrames, MALLOC_TELEMETRY_DEPTH_);
+
+                    self->mCountdown = interval;
+                }
+            }
+
+            ert_endThreadStatistics(&mallocThreadTelemetry_);
+        }
+    }
+}
+
+void
+ert_enableMallocTelemetry(
+    unsigned aSampleInterval)
+{
+    /* Call backtrace() once before enabling telemetry because the first
+     * call might load libgcc_s, which must not happen from within
+     * the allocator. */
+
+    if (aSampleInterval)
+    {
+        void *frame[1];
+
+        ++mallocThreadTelemetry_.mBusy;
+        (void) backtrace(frame, ERT_NUMBEROF(frame));
+        --mallocThreadTelemetry_.mBusy;
+    }
+
+    __atomic_store_n(
+        &mallocTelemetry_.mSampleInterval, aSampleInterval, __ATOMIC_RELAXED);
+    __atomic_store_n(&mallocTelemetry_.mEnabled, 1, __ATOMIC_RELEASE);
+}
+
+void
+ert_disableMallocTelemetry(void)
+{
+    __atomic_store_n(&mallocTelemetry_.mEnabled, 0, __ATOMIC_RELEASE);
+}
+
+int
+ert_printMallocTelemetry(
+    int aFd)
+{
+    int rc = -1;
+
+    pthread_mutex_t *lock = ert_lockThreadStatistics(
+        &mallocTelemetry_.mStatistics, &mallocThreadTelemetry_);
+
+    struct MallocTelemetry_ summary = mallocTelemetry_.mExited;
+
+    const struct MallocTelemetry_ *telemetry = 0;
+
+    while ((telemetry = ert_nextThreadStatistics(
+                &mallocTelemetry_.mStatistics, telemetry)))
+        mergeMallocTelemetry_(&summary, telemetry);
+
+    for (unsigned ix = 0; MallocTelemetryCalls_ > ix; ++ix)
+        ERT_ERROR_IF(
+            ert_writeFdPrintf(
+                aFd,
+                "%s calls %" PRIu64 "\n",
+                mallocTelemetryCallName_[ix],
+                summary.mCalls[ix]));
+
+    struct rusage usage;
+    ERT_ERROR_IF(
+        getrusage(RUSAGE_SELF, &usage));
+
+    ERT_ERROR_IF(
+        ert_writeFdPrintf(
+            aFd,
+            "malloc allocated %" PRIu64
+            " freed %" PRIu64
+            " inflight %" PRId64
+            " thread peak %" PRId64
+            " maxrss %ldkB\n",
+            summary.mAllocated,
+            summary.mFreed,
+            summary.mInFlight,
+            summary.mPeak,
+            usage.ru_maxrss));
+
+    ERT_ERROR_IF(
+        ert_printHistogram(&summary.mSizes, aFd, "malloc size"));
+
+    while ((telemetry = ert_nextThreadStatistics(
+                &mallocTelemetry_.mStatistics, telemetry)))
+    {
+        unsigned numSamples = telemetry->mNumSamples;
+
+        if (MALLOC_TELEMETRY_SAMPLES_ < numSamples)
+            numSamples = MALLOC_TELEMETRY_SAMPLES_;
+
+        for (unsigned ix = 0; numSamples > ix; ++ix)
+        {
+            const struct MallocTelemetrySample_ *sample =
+                &telemetry->mSamples[ix];
+
+            ERT_ERROR_IF(
+                ert_writeFdPrintf(
+                    aFd, "malloc sample size %zu\n", sample->mSize));
+
+            backtrace_symbols_fd(sample->mFrames, sample->mDepth, aFd);
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        lock = ert_unlockThreadStatistics(&mallocThreadTelemetry_, lock);
+    });
+
+    return rc;
+}
+
 /* -------------------------------------------------------------------------- */
 void *
 malloc(size_t aSize)
@@ -60,11 +341,13 @@ malloc(size_t aSize)
     struct Ert_ThreadSigMask threadSigMask;
 
     struct Ert_ThreadSigMask *sigMask = ert_pushThreadSigMask(
-        &threadSigMask, Ert_ThreadSigMaskBlock, 0);
+        &threadSigMask, Ert_ThreadSigMaskDefer, 0);
 
     ERT_ERROR_UNLESS(
         (block = __libc_malloc(aSize)));
 
+    recordMallocTelemetry_(MallocTelemetryMalloc_, aSize, block, 0);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -87,11 +370,13 @@ valloc(size_t aSize)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     ERT_ERROR_UNLESS(
         (block = __libc_valloc(aSize)));
 
+    recordMallocTelemetry_(MallocTelemetryValloc_, aSize, block, 0);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -114,11 +399,13 @@ pvalloc(size_t aSize)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     ERT_ERROR_UNLESS(
         (block = __libc_pvalloc(aSize)));
 
+    recordMallocTelemetry_(MallocTelemetryPvalloc_, aSize, block, 0);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -139,7 +426,11 @@ free(void *aBlock)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
+
+    if (aBlock)
+        recordMallocTelemetry_(
+            MallocTelemetryFree_, 0, 0, fetchMallocTelemetrySize_(aBlock));
 
     __libc_free(aBlock);
 
@@ -165,11 +456,13 @@ memalign(size_t aAlign, size_t aSize)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     ERT_ERROR_UNLESS(
         (block = __libc_memalign(aAlign, aSize)));
 
+    recordMallocTelemetry_(MallocTelemetryMemalign_, aSize, block, 0);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -199,11 +492,15 @@ realloc(void *aBlock, size_t aSize)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
+
+    size_t freed = fetchMallocTelemetrySize_(aBlock);
 
     ERT_ERROR_UNLESS(
         (block = __libc_realloc(aBlock, aSize)));
 
+    recordMallocTelemetry_(MallocTelemetryRealloc_, aSize, block, freed);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -226,11 +523,14 @@ calloc(size_t aSize, size_t aElems)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     ERT_ERROR_UNLESS(
         (block = __libc_calloc(aSize, aElems)));
 
+    recordMallocTelemetry_(
+        MallocTelemetryCalloc_, aSize * aElems, block, 0);
+
 Ert_Finally:
 
     ERT_FINALLY
@@ -253,7 +553,7 @@ posix_memalign(void **aBlock, size_t aAlign, size_t aSize)
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     size_t words = aAlign / sizeof(void *);
 
@@ -270,6 +570,8 @@ posix_memalign(void **aBlock, size_t aAlign, size_t aSize)
             rc = errno;
         });
 
+    recordMallocTelemetry_(MallocTelemetryMemalign_, aSize, block, 0);
+
     *aBlock = block;
 
     rc = 0;
@@ -29,10 +29,15 @@
 
 #include "ert/pollfd.h"
 #include "ert/error.h"
+#include "ert/fd.h"
 
+#include "malloc_.h"
+
+#include <stdio.h>
 #include <string.h>
 
 #include <sys/poll.h>
+#include <sys/epoll.h>
 
 /* -------------------------------------------------------------------------- */
 static char *
@@ -85,6 +90,672 @@ ert_createPollEventText(
     return aPollEventText->mText + 1;
 }
 
+/* -------------------------------------------------------------------------- */
+/* Timer Queue
+ *
+ * The armed timer actions are kept in a binary min-heap ordered by
+ * deadline, so that the next deadline is always at the root. The heap
+ * holds timer indices, and mQueueIndex records where each timer is
+ * located in the heap so that an arbitrary timer can be rearmed or
+ * disarmed without searching. Timers that are not in the heap
+ * are marked with an index of mSize. */
+
+static uint64_t
+pollFdTimerDeadline_(const struct Ert_PollFd *self, size_t aTimer)
+{
+    const struct Ert_PollFdTimerAction *timerAction =
+        &self->mTimerActions.mActions[aTimer];
+
+    return timerAction->mSince_.eventclock.ns + timerAction->mPeriod_.duration.ns;
+}
+
+static bool
+pollFdTimerPrecedes_(const struct Ert_PollFd *self, size_t aLhs, size_t aRhs)
+{
+    /* Break ties using the timer index so that timers with the same
+     * deadline are dispatched in the order that they were declared. */
+
+    uint64_t lhsDeadline = pollFdTimerDeadline_(self, aLhs);
+    uint64_t rhsDeadline = pollFdTimerDeadline_(self, aRhs);
+
+    return lhsDeadline != rhsDeadline ? lhsDeadline < rhsDeadline
+                                      : aLhs < aRhs;
+}
+
+static void
+placePollFdTimer_(struct Ert_PollFd *self, size_t aSlot, size_t aTimer)
+{
+    self->mTimerActions.mQueue[aSlot]       = aTimer;
+    self->mTimerActions.mQueueIndex[aTimer] = aSlot;
+}
+
+static void
+siftPollFdTimerQueue_(struct Ert_PollFd *self, size_t aSlot)
+{
+    size_t *queue = self->mTimerActions.mQueue;
+    size_t  timer = queue[aSlot];
+    size_t  slot  = aSlot;
+
+    while (slot)
+    {
+        size_t parent = (slot - 1) / 2;
+
+        if ( ! pollFdTimerPrecedes_(self, timer, queue[parent]))
+            break;
+
+        placePollFdTimer_(self, slot, queue[parent]);
+        slot = parent;
+    }
+
+    while (1)
+    {
+        size_t child = 2 * slot + 1;
+
+        if (child >= self->mTimerActions.mQueueSize)
+            break;
+
+        if (child + 1 < self->mTimerActions.mQueueSize &&
+            pollFdTimerPrecedes_(self, queue[child+1], queue[child]))
+            ++child;
+
+        if ( ! pollFdTimerPrecedes_(self, queue[child], timer))
+            break;
+
+        placePollFdTimer_(self, slot, queue[child]);
+        slot = child;
+    }
+
+    placePollFdTimer_(self, slot, timer);
+}
+
+static void
+removePollFdTimerQueue_(struct Ert_PollFd *self, size_t aTimer)
+{
+    size_t slot = self->mTimerActions.mQueueIndex[aTimer];
+
+    if (self->mTimerActions.mSize != slot)
+    {
+        self->mTimerActions.mQueueIndex[aTimer] = self->mTimerActions.mSize;
+
+        size_t last = --self->mTimerActions.mQueueSize;
+
+        if (last != slot)
+        {
+            placePollFdTimer_(self, slot, self->mTimerActions.mQueue[last]);
+            siftPollFdTimerQueue_(self, slot);
+        }
+    }
+}
+
+static void
+insertPollFdTimerQueue_(struct Ert_PollFd *self, size_t aTimer)
+{
+    struct Ert_PollFdTimerAction *timerAction =
+        &self->mTimerActions.mActions[aTimer];
+
+    /* Initialise the mark time from which the period will be measured,
+     * mirroring the lazy initialisation in ert_deadlineTimeExpired(). */
+
+    if ( ! timerAction->mSince_.eventclock.ns)
+        timerAction->mSince_ = ert_eventclockTime();
+
+    size_t slot = self->mTimerActions.mQueueIndex[aTimer];
+
+    if (self->mTimerActions.mSize == slot)
+    {
+        slot = self->mTimerActions.mQueueSize++;
+        placePollFdTimer_(self, slot, aTimer);
+    }
+
+    siftPollFdTimerQueue_(self, slot);
+}
+
+static const size_t *
+ownPollFdTimerQueueHead_(const struct Ert_PollFd *self)
+{
+    return self->mTimerActions.mQueueSize ? &self->mTimerActions.mQueue[0] : 0;
+}
+
+static void
+schedulePollFdTimer_(struct Ert_PollFd *self, size_t aTimer)
+{
+    if (self->mTimerActions.mActions[aTimer].mPeriod_.duration.ns)
+        insertPollFdTimerQueue_(self, aTimer);
+    else
+        removePollFdTimerQueue_(self, aTimer);
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_armPollFdTimerAction(
+    struct Ert_PollFd   *self,
+    size_t               aTimer,
+    struct Ert_Duration  aPeriod)
+{
+    ert_ensure(self->mTimerActions.mSize > aTimer);
+
+    self->mTimerActions.mActions[aTimer].mPeriod_ = aPeriod;
+
+    schedulePollFdTimer_(self, aTimer);
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_rearmPollFdTimerAction(
+    struct Ert_PollFd *self,
+    size_t             aTimer)
+{
+    ert_ensure(self->mTimerActions.mSize > aTimer);
+
+    self->mTimerActions.mActions[aTimer].mSince_ = ERT_EVENTCLOCKTIME_INIT;
+
+    schedulePollFdTimer_(self, aTimer);
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_disarmPollFdTimerAction(
+    struct Ert_PollFd *self,
+    size_t             aTimer)
+{
+    ert_armPollFdTimerAction(self, aTimer, Ert_ZeroDuration);
+}
+
+/* -------------------------------------------------------------------------- */
+/* Runtime Actions
+ *
+ * Runtime actions are registered with an epoll(7) instance, and the
+ * epoll file descriptor is appended to a copy of the caller's pollfd
+ * array so that both sets of file descriptors are monitored by a
+ * single poll(2). When the epoll file descriptor is readable, only
+ * those runtime actions that are ready are retrieved and dispatched.
+ *
+ * On Linux, the epoll(7) event bits have the same values as their
+ * poll(2) counterparts, so the event masks are used unchanged. */
+
+int
+ert_addPollFdAction(
+    struct Ert_PollFd               *self,
+    struct Ert_PollFdRuntimeAction  *aAction,
+    const char                      *aName,
+    int                              aFd,
+    unsigned                         aEvents,
+    struct Ert_PollFdCallbackMethod  aMethod)
+{
+    int rc = -1;
+
+    aAction->mAction  = aMethod;
+    aAction->mName    = aName;
+    aAction->mPollFd  = 0;
+    aAction->mPending = 0;
+    aAction->mFd      = aFd;
+    aAction->mEvents  = aEvents;
+    aAction->mRevents = 0;
+
+    if ( ! self->mPollFds)
+        ERT_ERROR_UNLESS(
+            (self->mPollFds = malloc(
+                sizeof(*self->mPollFds) * (self->mFdActions.mSize + 1))));
+
+    if ( ! self->mRuntimeActions.mFile)
+    {
+        ERT_ERROR_IF(
+            ert_createFile(
+                &self->mRuntimeActions.mFile_,
+                epoll_create1(EPOLL_CLOEXEC)));
+        self->mRuntimeActions.mFile = &self->mRuntimeActions.mFile_;
+    }
+
+    struct epoll_event pollEvent =
+    {
+        .events = aEvents,
+        .data   = { .ptr = aAction },
+    };
+
+    ERT_ERROR_IF(
+        epoll_ctl(
+            self->mRuntimeActions.mFile->mFd, EPOLL_CTL_ADD, aFd, &pollEvent));
+
+    aAction->mPollFd = self;
+
+    ++self->mRuntimeActions.mSize;
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_removePollFdAction(
+    struct Ert_PollFd              *self,
+    struct Ert_PollFdRuntimeAction *aAction)
+{
+    int rc = -1;
+
+    ert_ensure(self == aAction->mPollFd);
+    ert_ensure(self->mRuntimeActions.mSize);
+
+    ERT_ERROR_IF(
+        epoll_ctl(
+            self->mRuntimeActions.mFile->mFd,
+            EPOLL_CTL_DEL, aAction->mFd, 0));
+
+    /* If the action is removed while events are being dispatched,
+     * clear its pending event so that it will not be dispatched. */
+
+    if (aAction->mPending)
+    {
+        *aAction->mPending = (struct epoll_event) { };
+        aAction->mPending  = 0;
+    }
+
+    aAction->mPollFd = 0;
+
+    --self->mRuntimeActions.mSize;
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Dispatch Statistics
+ *
+ * The statistics for all the actions are allocated together, with the
+ * fd actions first, followed by the timer actions, and finally a single
+ * entry that accumulates the statistics for all the runtime actions.
+ * Unless enabled, the only cost is a test for a null pointer. */
+
+static struct Ert_PollFdStatistics *
+ownPollFdStatistics_(struct Ert_PollFdStatistics *aStatistics, size_t aIndex)
+{
+    return aStatistics ? &aStatistics[aIndex] : 0;
+}
+
+static uint64_t
+pollFdElapsedTime_(uint64_t aSince, uint64_t aUntil)
+{
+    return aUntil > aSince ? aUntil - aSince : 0;
+}
+
+static uint64_t
+startPollFdDispatch_(
+    struct Ert_PollFdStatistics     *aStatistics,
+    const struct Ert_EventClockTime *aPollTime)
+{
+    uint64_t dispatchTime = 0;
+
+    if (aStatistics)
+    {
+        dispatchTime = ert_eventclockTime().eventclock.ns;
+
+        ert_recordHistogram(
+            &aStatistics->mDispatchDelay,
+            pollFdElapsedTime_(aPollTime->eventclock.ns, dispatchTime));
+    }
+
+    return dispatchTime;
+}
+
+static int
+finishPollFdDispatch_(
+    struct Ert_PollFdStatistics *aStatistics,
+    uint64_t                     aDispatchTime,
+    int                          aRc)
+{
+    /* Neither reading the event clock nor recording the sample
+     * modifies errno, so the result of the callback is preserved. */
+
+    if (aStatistics)
+        ert_recordHistogram(
+            &aStatistics->mCallbackTime,
+            pollFdElapsedTime_(
+                aDispatchTime, ert_eventclockTime().eventclock.ns));
+
+    return aRc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_enablePollFdStatistics(
+    struct Ert_PollFd *self)
+{
+    int rc = -1;
+
+    if ( ! self->mFdActions.mStatistics)
+    {
+        size_t numStatistics =
+            self->mFdActions.mSize + self->mTimerActions.mSize + 1;
+
+        struct Ert_PollFdStatistics *statistics;
+
+        ERT_ERROR_UNLESS(
+            (statistics = malloc(sizeof(*statistics) * numStatistics)));
+
+        self->mFdActions.mStatistics      = statistics;
+        self->mTimerActions.mStatistics   =
+            statistics + self->mFdActions.mSize;
+        self->mRuntimeActions.mStatistics =
+            statistics + self->mFdActions.mSize + self->mTimerActions.mSize;
+
+        ert_clearPollFdStatistics(self);
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_clearPollFdStatistics(
+    struct Ert_PollFd *self)
+{
+    if (self->mFdActions.mStatistics)
+    {
+        size_t numStatistics =
+            self->mFdActions.mSize + self->mTimerActions.mSize + 1;
+
+        for (size_t ix = 0; numStatistics > ix; ++ix)
+        {
+            struct Ert_PollFdStatistics *statistics =
+                &self->mFdActions.mStatistics[ix];
+
+            ert_clearHistogram(&statistics->mDispatchDelay);
+            ert_clearHistogram(&statistics->mCallbackTime);
+            ert_clearHistogram(&statistics->mTimerLateness);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+const struct Ert_PollFdStatistics *
+ert_ownPollFdActionStatistics(
+    const struct Ert_PollFd *self,
+    size_t                   aAction)
+{
+    ert_ensure(self->mFdActions.mSize > aAction);
+
+    return ownPollFdStatistics_(self->mFdActions.mStatistics, aAction);
+}
+
+/* -------------------------------------------------------------------------- */
+const struct Ert_PollFdStatistics *
+ert_ownPollFdTimerActionStatistics(
+    const struct Ert_PollFd *self,
+    size_t                   aTimer)
+{
+    ert_ensure(self->mTimerActions.mSize > aTimer);
+
+    return ownPollFdStatistics_(self->mTimerActions.mStatistics, aTimer);
+}
+
+/* -------------------------------------------------------------------------- */
+const struct Ert_PollFdStatistics *
+ert_ownPollFdRuntimeActionStatistics(
+    const struct Ert_PollFd *self)
+{
+    return self->mRuntimeActions.mStatistics;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+printPollFdHistogram_(
+    const struct Ert_Histogram *aHistogram,
+    int                         aFd,
+    const char                 *aKind,
+    const char                 *aName,
+    const char                 *aMeasure)
+{
+    int rc = -1;
+
+    if (aHistogram->mCount)
+    {
+        char name[strlen(aKind) + strlen(aName) + strlen(aMeasure) + 3];
+
+        ERT_ERROR_IF(
+            0 > sprintf(name, "%s %s %s", aKind, aName, aMeasure));
+
+        ERT_ERROR_IF(
+            ert_printHistogram(aHistogram, aFd, name));
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+static ERT_CHECKED int
+printPollFdStatistics_(
+    const struct Ert_PollFdStatistics *aStatistics,
+    int                                aFd,
+    const char                        *aKind,
+    const char                        *aName)
+{
+    int rc = -1;
+
+    ERT_ERROR_IF(
+        printPollFdHistogram_(
+            &aStatistics->mDispatchDelay, aFd, aKind, aName, "dispatch"));
+
+    ERT_ERROR_IF(
+        printPollFdHistogram_(
+            &aStatistics->mCallbackTime, aFd, aKind, aName, "callback"));
+
+    ERT_ERROR_IF(
+        printPollFdHistogram_(
+            &aStatistics->mTimerLateness, aFd, aKind, aName, "lateness"));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+int
+ert_printPollFdStatistics(
+    const struct Ert_PollFd *self,
+    int                      aFd)
+{
+    int rc = -1;
+
+    if (self->mFdActions.mStatistics)
+    {
+        for (size_t ix = 0; self->mFdActions.mSize > ix; ++ix)
+            ERT_ERROR_IF(
+                printPollFdStatistics_(
+                    &self->mFdActions.mStatistics[ix],
+                    aFd, "fd", self->mFdActions.mNames[ix]));
+
+        for (size_t ix = 0; self->mTimerActions.mSize > ix; ++ix)
+            ERT_ERROR_IF(
+                printPollFdStatistics_(
+                    &self->mTimerActions.mStatistics[ix],
+                    aFd, "timer", self->mTimerActions.mNames[ix]));
+
+        ERT_ERROR_IF(
+            printPollFdStatistics_(
+                self->mRuntimeActions.mStatistics, aFd, "runtime", "*"));
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+dispatchPollFdRuntimeActions_(
+    struct Ert_PollFd               *self,
+    const struct Ert_EventClockTime *aPollTime)
+{
+    int rc = -1;
+
+    int polledEvents = 0;
+    int eventIndex   = 0;
+
+    /* Size the event queue to accommodate all the registered actions
+     * so that all the ready actions can be retrieved in one call. The
+     * queue is only resized here because actions might be added
+     * while the queue is being dispatched. */
+
+    size_t queueSize =
+        self->mRuntimeActions.mSize ? self->mRuntimeActions.mSize : 1;
+
+    if (self->mRuntimeActions.mQueueSize < queueSize)
+    {
+        struct epoll_event *queue;
+
+        ERT_ERROR_UNLESS(
+            (queue = realloc(
+                self->mRuntimeActions.mQueue, sizeof(*queue) * queueSize)));
+
+        self->mRuntimeActions.mQueue     = queue;
+        self->mRuntimeActions.mQueueSize = queueSize;
+    }
+
+    ERT_ERROR_IF(
+        (polledEvents = epoll_wait(
+            self->mRuntimeActions.mFile->mFd,
+            self->mRuntimeActions.mQueue,
+            self->mRuntimeActions.mQueueSize, 0),
+         -1 == polledEvents && EINTR != errno));
+
+    if (-1 == polledEvents)
+        polledEvents = 0;
+
+    ert_debug(1, "polled runtime event count %d", polledEvents);
+
+    for (int ix = 0; ix < polledEvents; ++ix)
+    {
+        struct Ert_PollFdRuntimeAction *action =
+            self->mRuntimeActions.mQueue[ix].data.ptr;
+
+        action->mPending = &self->mRuntimeActions.mQueue[ix];
+    }
+
+    while (eventIndex < polledEvents)
+    {
+        struct epoll_event *pollEvent =
+            &self->mRuntimeActions.mQueue[eventIndex++];
+
+        struct Ert_PollFdRuntimeAction *action = pollEvent->data.ptr;
+
+        if (action)
+        {
+            action->mPending = 0;
+            action->mRevents = pollEvent->events & action->mEvents;
+
+            struct Ert_PollEventText pollEventText;
+            struct Ert_PollEventText pollRcvdEventText;
+
+            ert_debug(
+                1,
+                "poll %s %d (%s) (%s)",
+                action->mName,
+                action->mFd,
+                ert_createPollEventText(
+                    &pollEventText, action->mEvents),
+                ert_createPollEventText(
+                    &pollRcvdEventText, pollEvent->events));
+
+            if (action->mRevents &&
+                ! ert_ownPollFdCallbackMethodNil(action->mAction))
+            {
+                struct Ert_PollFdStatistics *statistics =
+                    self->mRuntimeActions.mStatistics;
+
+                uint64_t dispatchTime =
+                    startPollFdDispatch_(statistics, aPollTime);
+
+                ERT_ERROR_IF(
+                    finishPollFdDispatch_(
+                        statistics,
+                        dispatchTime,
+                        ert_callPollFdCallbackMethod(
+                            action->mAction, aPollTime)),
+                    {
+                        ert_warn(
+                            errno,
+                            "Error dispatching %s",
+                            action->mName);
+                    });
+            }
+        }
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        while (eventIndex < polledEvents)
+        {
+            struct Ert_PollFdRuntimeAction *action =
+                self->mRuntimeActions.mQueue[eventIndex++].data.ptr;
+
+            if (action)
+                action->mPending = 0;
+        }
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+static struct pollfd *
+preparePollFds_(struct Ert_PollFd *self, nfds_t *aNumFds)
+{
+    struct pollfd *pollFds = self->mPoll;
+    nfds_t         numFds  = self->mFdActions.mSize;
+
+    /* Only copy the caller's pollfd array if there are runtime actions
+     * that require the epoll file descriptor to be monitored too. */
+
+    if (self->mRuntimeActions.mFile)
+    {
+        pollFds = self->mPollFds;
+
+        if (numFds)
+            memcpy(pollFds, self->mPoll, sizeof(*pollFds) * numFds);
+
+        pollFds[numFds++] = (struct pollfd)
+        {
+            .fd     = self->mRuntimeActions.mFile->mFd,
+            .events = POLLIN,
+        };
+    }
+
+    *aNumFds = numFds;
+
+    return pollFds;
+}
+
 /* -------------------------------------------------------------------------- */
 int
 ert_createPollFd(
@@ -100,7 +771,8 @@ ert_createPollFd(
 {
     int rc = -1;
 
-    self->mPoll = aPoll;
+    self->mPoll     = aPoll;
+    self->mPollFds  = 0;
 
     self->mCompletionQuery = aCompletionQuery;
 
@@ -108,12 +780,54 @@ ert_createPollFd(
     self->mFdActions.mNames   = aFdNames;
     self->mFdActions.mSize    = aNumFdActions;
 
-    self->mTimerActions.mActions = aTimerActions;
-    self->mTimerActions.mNames   = aTimerNames;
-    self->mTimerActions.mSize    = aNumTimerActions;
+    self->mFdActions.mStatistics      = 0;
+    self->mTimerActions.mStatistics   = 0;
+    self->mRuntimeActions.mStatistics = 0;
+
+    self->mTimerActions.mActions    = aTimerActions;
+    self->mTimerActions.mNames      = aTimerNames;
+    self->mTimerActions.mSize       = aNumTimerActions;
+    self->mTimerActions.mQueue      = 0;
+    self->mTimerActions.mQueueIndex = 0;
+    self->mTimerActions.mQueueSize  = 0;
+
+    self->mRuntimeActions.mFile      = 0;
+    self->mRuntimeActions.mQueue     = 0;
+    self->mRuntimeActions.mQueueSize = 0;
+    self->mRuntimeActions.mSize      = 0;
+
+    if (aNumTimerActions)
+    {
+        ERT_ERROR_UNLESS(
+            (self->mTimerActions.mQueue = malloc(
+                sizeof(*self->mTimerActions.mQueue) * aNumTimerActions)));
+
+        ERT_ERROR_UNLESS(
+            (self->mTimerActions.mQueueIndex = malloc(
+                sizeof(*self->mTimerActions.mQueueIndex) * aNumTimerActions)));
+    }
+
+    for (size_t ix = 0; aNumTimerActions > ix; ++ix)
+    {
+        self->mTimerActions.mQueueIndex[ix] = aNumTimerActions;
+
+        aTimerActions[ix].mPeriod_ = Ert_ZeroDuration;
+        aTimerActions[ix].mSince_  = ERT_EVENTCLOCKTIME_INIT;
+    }
 
     rc = 0;
 
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if (rc)
+        {
+            while (ert_closePollFd(self))
+                break;
+        }
+    });
+
     return rc;
 }
 
@@ -122,6 +836,33 @@ struct Ert_PollFd *
 ert_closePollFd(
     struct Ert_PollFd *self)
 {
+    if (self)
+    {
+        ert_ensure( ! self->mRuntimeActions.mSize);
+
+        self->mRuntimeActions.mFile = ert_closeFile(self->mRuntimeActions.mFile);
+
+        free(self->mRuntimeActions.mQueue);
+        self->mRuntimeActions.mQueue     = 0;
+        self->mRuntimeActions.mQueueSize = 0;
+
+        free(self->mPollFds);
+        self->mPollFds = 0;
+
+        free(self->mTimerActions.mQueue);
+        free(self->mTimerActions.mQueueIndex);
+
+        self->mTimerActions.mQueue      = 0;
+        self->mTimerActions.mQueueIndex = 0;
+        self->mTimerActions.mQueueSize  = 0;
+
+        free(self->mFdActions.mStatistics);
+
+        self->mFdActions.mStatistics      = 0;
+        self->mTimerActions.mStatistics   = 0;
+        self->mRuntimeActions.mStatistics = 0;
+    }
+
     return 0;
 }
 
@@ -143,63 +884,35 @@ ert_runPollFdLoop(
 
         polltm = ert_eventclockTime();
 
-        struct Ert_Duration timeout   = Ert_ZeroDuration;
-        size_t          chosen    = self->mTimerActions.mSize;
-        size_t          numActive = 0;
+        struct Ert_Duration timeout = Ert_ZeroDuration;
 
-        for (size_t ix = 0; self->mTimerActions.mSize > ix; ++ix)
+        const size_t *nextTimer = ownPollFdTimerQueueHead_(self);
+
+        if (nextTimer)
         {
-            if (self->mTimerActions.mActions[ix].mPeriod.duration.ns)
-            {
-                ++numActive;
+            struct Ert_PollFdTimerAction *timerAction =
+                &self->mTimerActions.mActions[*nextTimer];
 
-                struct Ert_Duration remaining;
+            (void) ert_deadlineTimeExpired(
+                &timerAction->mSince_, timerAction->mPeriod_, &timeout, &polltm);
 
-                if (ert_deadlineTimeExpired(
-                        &self->mTimerActions.mActions[ix].mSince,
-                        self->mTimerActions.mActions[ix].mPeriod,
-                        &remaining,
-                        &polltm))
-                {
-                    chosen  = ix;
-                    timeout = Ert_ZeroDuration;
-                    break;
-                }
+            ert_debug(
+                1, "choose %s deadline", self->mTimerActions.mNames[*nextTimer]);
 
-                if (timeout.duration.ns >
-                    remaining.duration.ns || ! timeout.duration.ns)
-                {
-                    chosen  = ix;
-                    timeout = remaining;
-                }
-            }
+            ert_debug(
+                1, "poll wait %" PRIs_Ert_Duration, FMTs_Ert_Duration(timeout));
         }
-
-        if (self->mTimerActions.mSize != chosen)
-            ert_debug(1, "choose %s deadline", self->mTimerActions.mNames[chosen]);
-
-        int timeout_ms;
-
-        if ( ! numActive)
-            timeout_ms = -1;
         else
-        {
-            struct Ert_MilliSeconds timeoutDuration =
-                ERT_MSECS(timeout.duration);
+            ert_debug(1, "poll wait indefinitely");
 
-            timeout_ms = timeoutDuration.ms;
-
-            if (0 > timeout_ms || timeoutDuration.ms != timeout_ms)
-                timeout_ms = INT_MAX;
-        }
-
-        ert_debug(1, "poll wait %dms", timeout_ms);
+        nfds_t         numFds;
+        struct pollfd *pollFds = preparePollFds_(self, &numFds);
 
         {
             int events;
             ERT_ERROR_IF(
-                (events = poll(
-                     self->mPoll, self->mFdActions.mSize, timeout_ms),
+                (events = ert_pollFds(
+                    pollFds, numFds, nextTimer ? &timeout : 0),
                  -1 == events && EINTR != errno));
         }
 
@@ -215,14 +928,23 @@ ert_runPollFdLoop(
             while (1)
             {
                 ERT_ERROR_IF(
-                    (events = poll(
-                        self->mPoll, self->mFdActions.mSize, 0),
+                    (events = poll(pollFds, numFds, 0),
                      -1 == events && EINTR != errno));
                 if (-1 != events)
                     break;
             }
         });
 
+        bool runtimeEvents = false;
+
+        if (pollFds != self->mPoll)
+        {
+            for (size_t ix = 0; self->mFdActions.mSize > ix; ++ix)
+                self->mPoll[ix].revents = pollFds[ix].revents;
+
+            runtimeEvents = pollFds[numFds-1].revents;
+        }
+
         {
             /* When processing file descriptor events, do not loop in EINTR
              * but instead allow the polling cycle to be re-run so that
@@ -262,18 +984,39 @@ ert_runPollFdLoop(
 
                     if ( ! ert_ownPollFdCallbackMethodNil(
                              self->mFdActions.mActions[ix].mAction))
+                    {
+                        struct Ert_PollFdStatistics *statistics =
+                            ownPollFdStatistics_(
+                                self->mFdActions.mStatistics, ix);
+
+                        uint64_t dispatchTime =
+                            startPollFdDispatch_(statistics, &polltm);
+
                         ERT_ERROR_IF(
-                            ert_callPollFdCallbackMethod(
-                                self->mFdActions.mActions[ix].mAction, &polltm),
+                            finishPollFdDispatch_(
+                                statistics,
+                                dispatchTime,
+                                ert_callPollFdCallbackMethod(
+                                    self->mFdActions.mActions[ix].mAction,
+                                    &polltm)),
                             {
                                 ert_warn(
                                     errno,
                                     "Error dispatching %s",
                                     self->mFdActions.mNames[ix]);
                             });
+                    }
                 }
             }
 
+            if (runtimeEvents)
+            {
+                ++eventCount;
+
+                ERT_ERROR_IF(
+                    dispatchPollFdRuntimeActions_(self, &polltm));
+            }
+
             /* Ensure that the interpretation of the poll events is being
              * correctly handled, to avoid a busy-wait poll loop. */
 
@@ -284,42 +1027,70 @@ ert_runPollFdLoop(
          * a chance to be recalibrated, and now the timers can be
          * processed. */
 
-        for (size_t ix = 0; self->mTimerActions.mSize > ix; ++ix)
+        /* Each expired timer is moved to its next deadline before its
+         * action is dispatched, so that the action is free to rearm or
+         * disarm any timer. Limit the number of dispatches so that
+         * a timer that is repeatedly triggered cannot starve the
+         * file descriptors. */
+
+        for (size_t dispatched = 0;
+             self->mTimerActions.mSize > dispatched; ++dispatched)
         {
+            nextTimer = ownPollFdTimerQueueHead_(self);
+
+            if ( ! nextTimer)
+                break;
+
+            size_t timer = *nextTimer;
+
             struct Ert_PollFdTimerAction *timerAction =
-                &self->mTimerActions.mActions[ix];
+                &self->mTimerActions.mActions[timer];
 
-            if (timerAction->mPeriod.duration.ns)
-            {
-                if (ert_deadlineTimeExpired(
-                        &timerAction->mSince, timerAction->mPeriod, 0, &polltm))
+            if ( ! ert_deadlineTimeExpired(
+                    &timerAction->mSince_, timerAction->mPeriod_, 0, &polltm))
+                break;
+
+            uint64_t deadline = pollFdTimerDeadline_(self, timer);
+
+            /* Compute the lap time, and as a side-effect set
+             * the deadline for the next timer cycle. This means
+             * that the timer action need not do anything to
+             * prepare for the next timer cycle, unless it needs
+             * to cancel or otherwise reschedule the timer. */
+
+            (void) ert_lapTimeSince(
+                &timerAction->mSince_, timerAction->mPeriod_, &polltm);
+
+            siftPollFdTimerQueue_(self, 0);
+
+            ert_debug(
+                1,
+                "expire %s timer with period %" PRIs_Ert_MilliSeconds,
+                self->mTimerActions.mNames[timer],
+                FMTs_Ert_MilliSeconds(
+                    ERT_MSECS(timerAction->mPeriod_.duration)));
+
+            struct Ert_PollFdStatistics *statistics =
+                ownPollFdStatistics_(self->mTimerActions.mStatistics, timer);
+
+            uint64_t dispatchTime = startPollFdDispatch_(statistics, &polltm);
+
+            if (statistics)
+                ert_recordHistogram(
+                    &statistics->mTimerLateness,
+                    pollFdElapsedTime_(deadline, dispatchTime));
+
+            ERT_ERROR_IF(
+                finishPollFdDispatch_(
+                    statistics,
+                    dispatchTime,
+                    ert_callPollFdCallbackMethod(
+                        timerAction->mAction, &polltm)),
                 {
-                    /* Compute the lap time, and as a side-effect set
-                     * the deadline for the next timer cycle. This means
-                     * that the timer action need not do anything to
-                     * prepare for the next timer cycle, unless it needs
-                     * to cancel or otherwise reschedule the timer. */
-
-                    (void) ert_lapTimeSince(
-                        &timerAction->mSince, timerAction->mPeriod, &polltm);
-
-                    ert_debug(
-                        1,
-                        "expire %s timer with period %" PRIs_Ert_MilliSeconds,
-                        self->mTimerActions.mNames[ix],
-                        FMTs_Ert_MilliSeconds(
-                            ERT_MSECS(timerAction->mPeriod.duration)));
-
-                    ERT_ERROR_IF(
-                        ert_callPollFdCallbackMethod(
-                            timerAction->mAction, &polltm),
-                        {
-                            ert_warn(errno,
-                                 "Error dispatching timer %s",
-                                 self->mTimerActions.mNames[ix]);
-                        });
-                }
-            }
+                    ert_warn(errno,
+                         "Error dispatching timer %s",
+                         self->mTimerActions.mNames[timer]);
+                });
         }
     }
 
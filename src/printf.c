@@ -30,10 +30,13 @@
 #include "ert/printf.h"
 
 #include "ert/error.h"
+#include "ert/fd.h"
 #include "ert/type.h"
 
 #include <printf.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 
 static unsigned moduleInit_;
 static bool     moduleInitPrintf_;
@@ -45,65 +48,156 @@ static bool     moduleInitPrintf_;
 const struct Ert_Type * const ert_printfMethodType_ = ERT_TYPE("PrintfMethod");
 
 /* -------------------------------------------------------------------------- */
-static ERT_CHECKED int
-vprintf_(
-    void       *self,
-    int       (*aPrintf)(void *self, const char *aFmt, va_list aArg),
-    const char *aFmt,
-    va_list     aArg)
+/* Only formats that use PRIs_Ert_Method are translated, and these are
+ * composed with string literals, so each translated format is cached
+ * against the address of the original alone. The cache serves only
+ * formats whose content never changes at that address, such as string
+ * literals. Entries are claimed once and never replaced, so readers
+ * need no lock. */
+
+#define PRINTF_FORMAT_CACHE_SIZE 32
+#define PRINTF_FORMAT_SIZE       256
+
+enum PrintfFormatState
 {
-    int rc = -1;
+    PRINTF_FORMAT_EMPTY,
+    PRINTF_FORMAT_BUSY,
+    PRINTF_FORMAT_READY,
+};
 
-    const char *priPtr = strstr(aFmt, PRINTF_PRI_LEADER);
+struct PrintfFormat
+{
+    enum PrintfFormatState mState;
+    const char            *mFmt;
+    char                   mBuf[PRINTF_FORMAT_SIZE];
+};
 
-    if ( ! priPtr)
-        rc = aPrintf(self, aFmt, aArg);
-    else
+static struct PrintfFormat printfFormatCache_[PRINTF_FORMAT_CACHE_SIZE];
+
+static struct PrintfFormat *
+findPrintfFormat_(const char *aFmt)
+{
+    uintptr_t hash = (uintptr_t) aFmt * UINT64_C(0x9e3779b97f4a7c15);
+
+    return &printfFormatCache_[
+        (hash >> (sizeof(hash) * CHAR_BIT - 8)) % PRINTF_FORMAT_CACHE_SIZE];
+}
+
+static const char *
+lookupPrintfFormat_(const char *aFmt)
+{
+    const char *xlat = 0;
+
+    struct PrintfFormat *format = findPrintfFormat_(aFmt);
+
+    if (PRINTF_FORMAT_READY == __atomic_load_n(
+            &format->mState, __ATOMIC_ACQUIRE))
     {
-        char fmtBuf[strlen(aFmt) + 1];
+        if (format->mFmt == aFmt)
+            xlat = format->mBuf;
+    }
 
-        strcpy(fmtBuf, aFmt);
+    return xlat;
+}
 
-        char *wrPtr = &fmtBuf[priPtr - aFmt];
-        char *rdPtr = wrPtr;
+static void
+cachePrintfFormat_(const char *aFmt, const char *aXlat)
+{
+    struct PrintfFormat *format = findPrintfFormat_(aFmt);
 
-        char *fmtPtr = rdPtr;
+    size_t xlatLen = strlen(aXlat) + 1;
 
-        do
-        {
-            memcpy(wrPtr, rdPtr, fmtPtr - rdPtr);
+    enum PrintfFormatState state = PRINTF_FORMAT_EMPTY;
+
+    if (xlatLen <= sizeof(format->mBuf) &&
+        __atomic_compare_exchange_n(
+            &format->mState, &state, PRINTF_FORMAT_BUSY,
+            false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+        memcpy(format->mBuf, aXlat, xlatLen);
+
+        format->mFmt = aFmt;
+
+        __atomic_store_n(
+            &format->mState, PRINTF_FORMAT_READY, __ATOMIC_RELEASE);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+translatePrintfFormat_(char *aBuf, const char *aFmt, const char *aPriPtr)
+{
+    strcpy(aBuf, aFmt);
+
+    char *wrPtr = &aBuf[aPriPtr - aFmt];
+    char *rdPtr = wrPtr;
+
+    char *fmtPtr = rdPtr;
 
-            wrPtr += fmtPtr - rdPtr;
-            rdPtr  = fmtPtr;
+    do
+    {
+        memcpy(wrPtr, rdPtr, fmtPtr - rdPtr);
+
+        wrPtr += fmtPtr - rdPtr;
+        rdPtr  = fmtPtr;
 
-            do
+        do
+        {
+            if (*rdPtr)
             {
-                if (*rdPtr)
+                if ( ! memcmp(
+                         rdPtr+1,
+                         PRIs_Ert_Method, sizeof(PRIs_Ert_Method)-1))
                 {
-                    if ( ! memcmp(
-                             rdPtr+1,
-                             PRIs_Ert_Method, sizeof(PRIs_Ert_Method)-1))
-                    {
-                        rdPtr += 1 + sizeof(PRIs_Ert_Method) - 1;
+                    rdPtr += 1 + sizeof(PRIs_Ert_Method) - 1;
 
-                        *wrPtr++ = '%';
-                        *wrPtr++ = PRINTF_SPEC_METHOD;
+                    *wrPtr++ = '%';
+                    *wrPtr++ = PRINTF_SPEC_METHOD;
 
-                        break;
-                    }
+                    break;
                 }
+            }
 
-                *wrPtr++ = *rdPtr++;
+            *wrPtr++ = *rdPtr++;
 
-            } while (0);
+        } while (0);
 
-            fmtPtr = strstr(rdPtr, PRINTF_PRI_LEADER);
+        fmtPtr = strstr(rdPtr, PRINTF_PRI_LEADER);
 
-        } while (fmtPtr);
+    } while (fmtPtr);
 
-        memmove(wrPtr, rdPtr, strlen(rdPtr) + 1);
+    memmove(wrPtr, rdPtr, strlen(rdPtr) + 1);
+}
 
-        rc = aPrintf(self, fmtBuf, aArg);
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+vprintf_(
+    void       *self,
+    int       (*aPrintf)(void *self, const char *aFmt, va_list aArg),
+    const char *aFmt,
+    va_list     aArg)
+{
+    int rc = -1;
+
+    const char *xlatFmt = lookupPrintfFormat_(aFmt);
+
+    if (xlatFmt)
+        rc = aPrintf(self, xlatFmt, aArg);
+    else
+    {
+        const char *priPtr = strstr(aFmt, PRINTF_PRI_LEADER);
+
+        if ( ! priPtr)
+            rc = aPrintf(self, aFmt, aArg);
+        else
+        {
+            char fmtBuf[strlen(aFmt) + 1];
+
+            translatePrintfFormat_(fmtBuf, aFmt, priPtr);
+            cachePrintfFormat_(aFmt, fmtBuf);
+
+            rc = aPrintf(self, fmtBuf, aArg);
+        }
     }
 
     return rc;
@@ -224,6 +318,70 @@ ert_dprintf(int aFd, const char *aFmt, ...)
     return rc;
 }
 
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+writeFdPrintf_(int aFd, int aBufLen, const char *aFmt, va_list aArg)
+{
+    int rc = -1;
+
+    char buf[aBufLen + 1];
+
+    ERT_ERROR_IF(
+        aBufLen != ert_vsnprintf(buf, sizeof(buf), aFmt, aArg),
+        {
+            errno = EIO;
+        });
+
+    ssize_t wroteLen = -1;
+    ERT_ERROR_IF(
+        (wroteLen = ert_writeFd(aFd, buf, aBufLen, 0),
+         -1 == wroteLen || aBufLen != wroteLen),
+        {
+            if (-1 != wroteLen)
+                errno = EIO;
+        });
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+int
+ert_writeFdPrintf(int aFd, const char *aFmt, ...)
+{
+    int rc = -1;
+
+    va_list argp;
+    va_list args;
+
+    va_start(argp, aFmt);
+    va_copy(args, argp);
+
+    int bufLen = -1;
+    ERT_ERROR_IF(
+        (bufLen = ert_vsnprintf(0, 0, aFmt, argp),
+         0 > bufLen));
+
+    ERT_ERROR_IF(
+        writeFdPrintf_(aFd, bufLen, aFmt, args));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        va_end(args);
+        va_end(argp);
+    });
+
+    return rc;
+}
+
 /* -------------------------------------------------------------------------- */
 static ERT_CHECKED int
 printf_method_call_(
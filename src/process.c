@@ -35,6 +35,7 @@
 #include "ert/thread.h"
 #include "ert/fdset.h"
 #include "ert/random.h"
+#include "ert/dl.h"
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -50,6 +51,7 @@ struct ProcessLock
     struct Ert_File            mFile_;
     struct Ert_File           *mFile;
     const struct Ert_LockType *mLock;
+    bool                       mShared;
 };
 
 struct Ert_ProcessAppLock
@@ -95,6 +97,8 @@ static struct
 {
     pthread_mutex_t            mMutex_;
     pthread_mutex_t           *mMutex;
+    struct Ert_ThreadSigMask   mSigMask_;
+    struct Ert_ThreadSigMask  *mSigMask;
     struct Ert_Pid             mParentPid;
     struct Ert_RWMutexWriter   mSigVecLock_;
     struct Ert_RWMutexWriter  *mSigVecLock;
@@ -229,10 +233,13 @@ runSigAction_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
 static void
 dispatchSigAction_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
 {
-    ERT_SCOPED_ERRNO
-    ({
-        runSigAction_(aSigNum, aSigInfo, aSigContext);
-    });
+    if ( ! ert_deferThreadSigMaskSignal_(aSigNum, aSigInfo, aSigContext))
+    {
+        ERT_SCOPED_ERRNO
+        ({
+            runSigAction_(aSigNum, aSigInfo, aSigContext);
+        });
+    }
 }
 
 static void
@@ -280,11 +287,44 @@ runSigHandler_(int aSigNum)
 }
 
 static void
-dispatchSigHandler_(int aSigNum)
+dispatchSigHandler_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
+{
+    if ( ! ert_deferThreadSigMaskSignal_(aSigNum, aSigInfo, aSigContext))
+    {
+        ERT_SCOPED_ERRNO
+        ({
+            runSigHandler_(aSigNum);
+        });
+    }
+}
+
+static void
+replaySig_(int aSigNum, siginfo_t *aSigInfo, void *aSigContext)
 {
+    /* Replay a signal that was deferred while the thread was in a
+     * critical section. The original signal context is no longer
+     * available, so the signal handler receives the context of the
+     * replay instead. If the signal action was reset to the default
+     * while the signal was deferred, raise the signal again so that the
+     * default action is taken once the signal is unblocked. */
+
+    struct ProcessSignalVector *sv = &processSignals_.mVector[aSigNum];
+
     ERT_SCOPED_ERRNO
     ({
-        runSigHandler_(aSigNum);
+        struct sigaction action;
+
+        pthread_mutex_t *actionLock = ert_lockMutex(sv->mActionMutex);
+        action = sv->mAction;
+        actionLock = ert_unlockMutex(actionLock);
+
+        if (SIG_DFL == action.sa_handler)
+            ERT_ABORT_IF(
+                raise(aSigNum));
+        else if (action.sa_flags & SA_SIGINFO)
+            runSigAction_(aSigNum, aSigInfo, aSigContext);
+        else
+            runSigHandler_(aSigNum);
     });
 }
 
@@ -309,10 +349,15 @@ changeSigAction_(unsigned          aSigNum,
 
     if (SIG_DFL != nextAction.sa_handler && SIG_IGN != nextAction.sa_handler)
     {
+        /* Both dispatchers receive the signal information and context
+         * so that signals can be deferred. */
+
         if (nextAction.sa_flags & SA_SIGINFO)
             nextAction.sa_sigaction = dispatchSigAction_;
         else
-            nextAction.sa_handler = dispatchSigHandler_;
+            nextAction.sa_sigaction = dispatchSigHandler_;
+
+        nextAction.sa_flags |= SA_SIGINFO;
 
         /* Require that signal delivery not restart system calls.
          * This is important so that event loops have a chance
@@ -399,6 +444,216 @@ ert_ownProcessSignalContext(void)
     return processSignalContext_;
 }
 
+/* -------------------------------------------------------------------------- */
+/* Foreign Signal Handlers
+ *
+ * Deferral relies on the dispatchers installed by this library to check
+ * whether the thread is in a critical section. A handler installed
+ * directly does not, and could run in the middle of a critical section,
+ * including one in the allocators. Track the signals whose handlers were
+ * installed directly, and suspend deferral while there are any so that
+ * critical sections block signals instead.
+ *
+ * Handlers installed before deferral is enabled are found by querying
+ * each signal action. Handlers installed later are noticed by the
+ * interceptors for sigaction(2) and the signal(3) family, though a
+ * critical section that is already running in another thread when the
+ * handler is installed is not interrupted to start blocking signals. */
+
+int
+__sigaction(int                     aSigNum,
+            const struct sigaction *aAction,
+            struct sigaction       *aOldAction);
+
+sighandler_t
+bsd_signal(int aSigNum, sighandler_t aHandler);
+
+static struct
+{
+    unsigned mEnabled;
+    uint64_t mForeign;
+
+} processSignalDefer_;
+
+static bool
+ownSigAction_(const struct sigaction *aAction)
+{
+    return
+        SIG_DFL == aAction->sa_handler ||
+        SIG_IGN == aAction->sa_handler ||
+        ((aAction->sa_flags & SA_SIGINFO) &&
+         (dispatchSigAction_  == aAction->sa_sigaction ||
+          dispatchSigHandler_ == aAction->sa_sigaction));
+}
+
+static uint64_t
+foreignSigBit_(int aSigNum)
+{
+    return 0 < aSigNum && 64 >= aSigNum ? UINT64_C(1) << (aSigNum - 1) : 0;
+}
+
+static bool
+deferProcessSignals_(void)
+{
+    return
+        __atomic_load_n(&processSignalDefer_.mEnabled, __ATOMIC_ACQUIRE) &&
+        ! __atomic_load_n(&processSignalDefer_.mForeign, __ATOMIC_ACQUIRE);
+}
+
+static void
+updateProcessSignalDefer_(void)
+{
+    /* Deferral might be enabled, or a foreign handler installed, in
+     * another thread while this thread is updating the deferral, so
+     * repeat until the outcome is stable. */
+
+    bool defer;
+
+    do
+    {
+        defer = deferProcessSignals_();
+
+        ert_enableThreadSigMaskDefer_(defer ? replaySig_ : 0);
+
+    } while (defer != deferProcessSignals_());
+}
+
+static void
+markForeignSigAction_(int aSigNum)
+{
+    /* Suspend deferral before the foreign handler is installed. */
+
+    __atomic_or_fetch(
+        &processSignalDefer_.mForeign,
+        foreignSigBit_(aSigNum), __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&processSignalDefer_.mEnabled, __ATOMIC_ACQUIRE))
+        updateProcessSignalDefer_();
+}
+
+static void
+reviewForeignSigAction_(int aSigNum)
+{
+    /* Query the action now installed, and resume deferral if no
+     * foreign handlers remain. */
+
+    int err = errno;
+
+    struct sigaction action;
+
+    if ( ! __sigaction(aSigNum, 0, &action))
+    {
+        uint64_t sigBit = foreignSigBit_(aSigNum);
+
+        if (ownSigAction_(&action))
+            __atomic_and_fetch(
+                &processSignalDefer_.mForeign, ~ sigBit, __ATOMIC_SEQ_CST);
+        else
+            __atomic_or_fetch(
+                &processSignalDefer_.mForeign, sigBit, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&processSignalDefer_.mEnabled, __ATOMIC_ACQUIRE))
+            updateProcessSignalDefer_();
+    }
+
+    errno = err;
+}
+
+int
+sigaction(int                     aSigNum,
+          const struct sigaction *aAction,
+          struct sigaction       *aOldAction)
+{
+    bool foreign = aAction && ! ownSigAction_(aAction);
+
+    if (foreign)
+        markForeignSigAction_(aSigNum);
+
+    int rc = __sigaction(aSigNum, aAction, aOldAction);
+
+    if (aAction && (rc || ! foreign))
+        reviewForeignSigAction_(aSigNum);
+
+    return rc;
+}
+
+#define PROCESS_SIGNAL_DEFN_(Name_)                                     \
+                                                                        \
+static uintptr_t Name_ ## _addr_;                                       \
+                                                                        \
+sighandler_t                                                            \
+Name_(int aSigNum, sighandler_t aHandler)                               \
+{                                                                       \
+    if (SIG_DFL  != aHandler &&                                         \
+        SIG_IGN  != aHandler &&                                         \
+        SIG_HOLD != aHandler &&                                         \
+        SIG_ERR  != aHandler)                                           \
+        markForeignSigAction_(aSigNum);                                 \
+                                                                        \
+    sighandler_t prevHandler =                                          \
+        ((sighandler_t (*)(int, sighandler_t)) Name_ ## _addr_)(        \
+            aSigNum, aHandler);                                         \
+                                                                        \
+    reviewForeignSigAction_(aSigNum);                                   \
+                                                                        \
+    return prevHandler;                                                 \
+}                                                                       \
+struct ProcessSignalModule_
+
+PROCESS_SIGNAL_DEFN_(signal);
+PROCESS_SIGNAL_DEFN_(bsd_signal);
+PROCESS_SIGNAL_DEFN_(ssignal);
+PROCESS_SIGNAL_DEFN_(sysv_signal);
+PROCESS_SIGNAL_DEFN_(sigset);
+
+static void
+initProcessSignalFunction_(const char *aName, uintptr_t *aAddr)
+{
+    const char *err;
+
+    char *libName = ert_findDlSymbol(aName, aAddr, &err);
+
+    ert_ensure(libName);
+
+    free(libName);
+}
+
+ERT_EARLY_INITIALISER(
+    processSignal_,
+    ({
+        initProcessSignalFunction_("signal",      &signal_addr_);
+        initProcessSignalFunction_("bsd_signal",  &bsd_signal_addr_);
+        initProcessSignalFunction_("ssignal",     &ssignal_addr_);
+        initProcessSignalFunction_("sysv_signal", &sysv_signal_addr_);
+        initProcessSignalFunction_("sigset",      &sigset_addr_);
+    }),
+    ({ }));
+
+/* -------------------------------------------------------------------------- */
+void
+ert_deferProcessSignals(bool aDefer)
+{
+    if (aDefer)
+    {
+        uint64_t foreign = 0;
+
+        for (int sigNum = 1; 64 >= sigNum; ++sigNum)
+        {
+            struct sigaction action;
+
+            if ( ! __sigaction(sigNum, 0, &action) && ! ownSigAction_(&action))
+                foreign |= foreignSigBit_(sigNum);
+        }
+
+        __atomic_store_n(
+            &processSignalDefer_.mForeign, foreign, __ATOMIC_SEQ_CST);
+    }
+
+    __atomic_store_n(&processSignalDefer_.mEnabled, aDefer, __ATOMIC_RELEASE);
+
+    updateProcessSignalDefer_();
+}
+
 /* -------------------------------------------------------------------------- */
 static struct sigaction processSigPipeAction_ =
 {
@@ -1247,8 +1502,9 @@ createProcessLock_(
 {
     int rc = -1;
 
-    self->mFile = 0;
-    self->mLock = 0;
+    self->mFile   = 0;
+    self->mLock   = 0;
+    self->mShared = false;
 
     ERT_ERROR_IF(
         ert_temporaryFile(&self->mFile_, 0));
@@ -1308,6 +1564,33 @@ unlockProcessLock_(
     self->mLock = 0;
 }
 
+/* -------------------------------------------------------------------------- */
+static void
+shareProcessLock_(
+    struct ProcessLock *self)
+{
+    /* The process lock is a two level lock. Threads within the process
+     * exclude each other using processLock_.mMutex, and the file region
+     * lock is only required once the lock file is shared with forked
+     * processes. Once shared, the lock file remains shared since
+     * there is no reliable way to know when the last child process
+     * has relinquished it.
+     *
+     * This function is called with processLock_.mMutex held. If the
+     * mutex was already held when the fork was initiated, acquire the
+     * file lock now so that it is released when the mutex is
+     * finally released. */
+
+    if ( ! self->mShared)
+    {
+        self->mShared = true;
+
+        if (1 < ert_ownThreadSigMutexLocked(processLock_.mMutex))
+            ERT_ABORT_IF(
+                lockProcessLock_(self));
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 static void
 forkProcessLock_(
@@ -1333,7 +1616,7 @@ ert_acquireProcessAppLock(void)
 
     if (1 == ert_ownThreadSigMutexLocked(processLock_.mMutex))
     {
-        if (processLock_.mLock)
+        if (processLock_.mLock && processLock_.mLock->mShared)
             ERT_ERROR_IF(
                 lockProcessLock_(processLock_.mLock));
     }
@@ -1361,7 +1644,7 @@ ert_releaseProcessAppLock(void)
 
     if (1 == ert_ownThreadSigMutexLocked(lock))
     {
-        if (processLock_.mLock)
+        if (processLock_.mLock && processLock_.mLock->mLock)
             unlockProcessLock_(processLock_.mLock);
     }
 
@@ -2774,6 +3057,8 @@ ert_execShell(const char *aCmd)
 void
 ert_exitProcess(int aStatus)
 {
+    ert_flushErrorLogSink();
+
     _exit(aStatus);
 
     while (1)
@@ -2908,6 +3193,8 @@ killProcess_(int aSigNum, unsigned *aSigTrigger)
 void
 ert_abortProcess(void)
 {
+    ert_flushErrorLogSink();
+
     killProcess_(SIGABRT, &processAbort_);
 }
 
@@ -3112,6 +3399,13 @@ prepareFork_(void)
 
     processFork_.mMutex = ert_lockMutex(&processFork_.mMutex_);
 
+    /* Block signals while the fork is in progress, rather than only
+     * deferring them, so that no signal is delivered until the child
+     * has discarded the signals deferred by the parent. */
+
+    processFork_.mSigMask = ert_pushThreadSigMask(
+        &processFork_.mSigMask_, Ert_ThreadSigMaskBlock, 0);
+
     /* Note that processLock_.mMutex is recursive, meaning that
      * it might already be held by this thread on entry to this function. */
 
@@ -3120,6 +3414,9 @@ prepareFork_(void)
     ert_ensure(
         0 < ert_ownThreadSigMutexLocked(processLock_.mMutex));
 
+    if (processLock_.mLock)
+        shareProcessLock_(processLock_.mLock);
+
     /* Acquire the processSigVecLock_ for writing to ensure that there
      * are no other signal vector activity in progress. The purpose here
      * is to prevent the signal mutexes from being held while a fork is
@@ -3158,6 +3455,8 @@ completeFork_(void)
 
         processFork_.mLock = ert_unlockThreadSigMutex(processLock_.mMutex);
 
+        processFork_.mSigMask = ert_popThreadSigMask(processFork_.mSigMask);
+
         pthread_mutex_t *lock = processFork_.mMutex;
 
         processFork_.mMutex = 0;
@@ -3199,6 +3498,8 @@ postForkChild_(void)
      * that the parent will have terminated and the pid reused by the time
      * the child gets around to checking. */
 
+    ert_clearThreadSigMaskDefer_();
+
     completeFork_();
 }
 
@@ -0,0 +1,339 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/sharedlatch.h"
+#include "ert/timekeeping.h"
+#include "ert/error.h"
+
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#include <linux/futex.h>
+
+/* -------------------------------------------------------------------------- */
+/* The futex word is shared between processes, so FUTEX_PRIVATE_FLAG
+ * must not be used. */
+
+static int
+waitSharedLatchFutex_(
+    int                   *aWord,
+    const struct timespec *aTimeout)
+{
+    return syscall(SYS_futex, aWord, FUTEX_WAIT, 0, aTimeout, 0, 0);
+}
+
+static int
+wakeSharedLatchFutex_(
+    int *aWord)
+{
+    return syscall(SYS_futex, aWord, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createSharedLatch(
+    struct Ert_SharedLatch      *self,
+    struct Ert_SharedLatchState *aState,
+    unsigned                     aFlags)
+{
+    int rc = -1;
+
+    self->mState     = 0;
+    self->mMap       = 0;
+    self->mEventFile = 0;
+
+    ERT_ERROR_IF(
+        aFlags & ~ ERT_SHAREDLATCH_EVENTFD,
+        {
+            errno = EINVAL;
+        });
+
+    if ( ! aState)
+    {
+        void *map = MAP_FAILED;
+
+        ERT_ERROR_IF(
+            (map = mmap(0,
+                        sizeof(*self->mMap),
+                        PROT_READ | PROT_WRITE,
+                        MAP_ANONYMOUS | MAP_SHARED, -1, 0),
+             MAP_FAILED == map));
+
+        self->mMap = map;
+        aState     = self->mMap;
+    }
+
+    aState->mWord    = 0;
+    aState->mWaiters = 0;
+
+    self->mState = aState;
+
+    /* The eventfd(2) is only drained when the latch is reset, so it
+     * must not block the caller if it is already empty. */
+
+    if (aFlags & ERT_SHAREDLATCH_EVENTFD)
+    {
+        ERT_ERROR_IF(
+            ert_createFile(
+                &self->mEventFile_,
+                eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)));
+        self->mEventFile = &self->mEventFile_;
+    }
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if (rc)
+            self = ert_closeSharedLatch(self);
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+struct Ert_SharedLatch *
+ert_closeSharedLatch(
+    struct Ert_SharedLatch *self)
+{
+    if (self)
+    {
+        self->mEventFile = ert_closeFile(self->mEventFile);
+        self->mState     = 0;
+
+        if (self->mMap)
+            ERT_ABORT_IF(
+                munmap(self->mMap, sizeof(*self->mMap)));
+        self->mMap = 0;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+enum Ert_EventLatchSetting
+ert_setSharedLatch(
+    struct Ert_SharedLatch *self)
+{
+    enum Ert_EventLatchSetting rc = Ert_EventLatchSettingError;
+
+    struct Ert_SharedLatchState *state = self->mState;
+
+    /* Only the setter that turns the latch on need wake the waiters,
+     * and the waiters need only be woken if there are any. The latch
+     * is never turned off again here, because other processes might
+     * already have observed it, so waking restarts if interrupted. */
+
+    enum Ert_EventLatchSetting setting = Ert_EventLatchSettingOn;
+
+    if ( ! __atomic_exchange_n(&state->mWord, 1, __ATOMIC_SEQ_CST))
+    {
+        setting = Ert_EventLatchSettingOff;
+
+        if (__atomic_load_n(&state->mWaiters, __ATOMIC_SEQ_CST))
+        {
+            int woken;
+
+            do
+            {
+                woken = -1;
+
+                ERT_ERROR_IF(
+                    (woken = wakeSharedLatchFutex_(&state->mWord),
+                     -1 == woken && EINTR != errno));
+
+            } while (-1 == woken);
+        }
+
+        if (self->mEventFile)
+        {
+            uint64_t count = 1;
+
+            ssize_t rv;
+
+            do
+            {
+                rv = -1;
+
+                ERT_ERROR_IF(
+                    (rv = write(self->mEventFile->mFd, &count, sizeof(count)),
+                     -1 == rv && EINTR != errno));
+
+            } while (-1 == rv);
+
+            ERT_ERROR_IF(
+                sizeof(count) != rv,
+                {
+                    errno = EIO;
+                });
+        }
+    }
+
+    rc = setting;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+enum Ert_EventLatchSetting
+ert_resetSharedLatch(
+    struct Ert_SharedLatch *self)
+{
+    enum Ert_EventLatchSetting rc = Ert_EventLatchSettingError;
+
+    struct Ert_SharedLatchState *state = self->mState;
+
+    /* Drain the eventfd before resetting the latch. A concurrent setter
+     * might leave the eventfd readable after the latch is reset, but
+     * this is only a spurious wakeup that is cleared by the next reset,
+     * whereas draining after resetting the latch could lose a wakeup. */
+
+    if (self->mEventFile)
+    {
+        uint64_t count;
+
+        ssize_t rv;
+
+        do
+        {
+            rv = -1;
+
+            ERT_ERROR_IF(
+                (rv = read(self->mEventFile->mFd, &count, sizeof(count)),
+                 -1 == rv && EINTR != errno && EAGAIN != errno));
+
+        } while (-1 == rv && EINTR == errno);
+
+        ERT_ERROR_IF(
+            -1 != rv && sizeof(count) != rv,
+            {
+                errno = EIO;
+            });
+    }
+
+    rc = __atomic_exchange_n(&state->mWord, 0, __ATOMIC_SEQ_CST)
+        ? Ert_EventLatchSettingOn
+        : Ert_EventLatchSettingOff;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+enum Ert_EventLatchSetting
+ert_ownSharedLatchSetting(
+    const struct Ert_SharedLatch *self)
+{
+    return __atomic_load_n(&self->mState->mWord, __ATOMIC_ACQUIRE)
+        ? Ert_EventLatchSettingOn
+        : Ert_EventLatchSettingOff;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_waitSharedLatch(
+    struct Ert_SharedLatch    *self,
+    const struct Ert_Duration *aTimeout)
+{
+    int rc = -1;
+
+    struct Ert_SharedLatchState *state = self->mState;
+
+    struct Ert_EventClockTime since = ERT_EVENTCLOCKTIME_INIT;
+    struct Ert_Duration       remaining;
+
+    const struct Ert_Duration timeout = aTimeout ? *aTimeout : Ert_ZeroDuration;
+
+    int set = 0;
+
+    while (1)
+    {
+        /* Announce the waiter before checking the latch, so that a
+         * setter that turns on the latch after the check will see
+         * the waiter and wake it. */
+
+        __atomic_add_fetch(&state->mWaiters, 1, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&state->mWord, __ATOMIC_SEQ_CST))
+        {
+            __atomic_sub_fetch(&state->mWaiters, 1, __ATOMIC_SEQ_CST);
+            set = 1;
+            break;
+        }
+
+        struct timespec  timeSpec_;
+        struct timespec *timeSpec = 0;
+
+        if (aTimeout)
+        {
+            struct Ert_EventClockTime tm = ert_eventclockTime();
+
+            if (ert_deadlineTimeExpired(&since, timeout, &remaining, &tm))
+            {
+                __atomic_sub_fetch(&state->mWaiters, 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+
+            timeSpec_ = ert_timeSpecFromNanoSeconds(remaining.duration);
+            timeSpec  = &timeSpec_;
+        }
+
+        int err = waitSharedLatchFutex_(&state->mWord, timeSpec);
+
+        __atomic_sub_fetch(&state->mWaiters, 1, __ATOMIC_SEQ_CST);
+
+        ERT_ERROR_IF(
+            -1 == err &&
+            EAGAIN != errno && EINTR != errno && ETIMEDOUT != errno);
+    }
+
+    rc = set;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
@@ -0,0 +1,564 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/slab.h"
+#include "ert/process.h"
+#include "ert/error.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#include <sys/mman.h>
+
+/* -------------------------------------------------------------------------- */
+/* Slabs are aligned to their size, so that the slab header can be found
+ * from the address of any object in the slab. Objects are identified
+ * by a 32 bit id comprising the index of the slab and the index of
+ * the object within the slab, offset by one so that an id of zero
+ * indicates no object.
+ *
+ * The shared free list is a lock-free stack that is linked using the
+ * object ids, and its head is tagged with a generation count to avoid
+ * the ABA problem. Slabs are never unmapped while the pool is open, so
+ * a popping thread can safely read the link of an object that has
+ * been concurrently allocated by another thread, knowing that the
+ * generation count will cause its compare-and-swap to fail. */
+
+#define SLAB_SIZE_       (64 * 1024)
+#define SLAB_HEADER_     64
+#define SLAB_OBJECT_MAX_ (SLAB_SIZE_ / 8)
+
+#define SLAB_MAGAZINES_     32
+#define SLAB_MAGAZINE_SIZE_ 32
+
+#define SLAB_UNREGISTERED_ UINT64_MAX
+
+struct SlabHeader_
+{
+    struct Ert_SlabPool *mPool;
+    unsigned             mIndex;
+};
+
+struct SlabMagazine_
+{
+    uint64_t mRegistration;
+    unsigned mBusy;
+    unsigned mCount;
+    uint32_t mObjects[SLAB_MAGAZINE_SIZE_];
+};
+
+static struct Ert_SlabPool *slabPools_[SLAB_MAGAZINES_];
+static uint64_t             slabPoolSerial_;
+
+static __thread struct
+{
+    bool                 mKey;
+    struct SlabMagazine_ mMagazine[SLAB_MAGAZINES_];
+
+} slabMagazines_;
+
+/* -------------------------------------------------------------------------- */
+static void *
+fetchSlabObject_(
+    struct Ert_SlabPool *self,
+    uint32_t             aId)
+{
+    uint32_t ix = aId - 1;
+
+    char *slab = __atomic_load_n(&self->mSlabs[ix >> 16], __ATOMIC_ACQUIRE);
+
+    return slab + SLAB_HEADER_ + (ix & 0xffff) * self->mSize;
+}
+
+static uint32_t
+fetchSlabObjectId_(
+    struct Ert_SlabPool *self,
+    void                *aObject)
+{
+    uintptr_t address = (uintptr_t) aObject;
+
+    struct SlabHeader_ *header =
+        (void *) (address & ~ (uintptr_t) (SLAB_SIZE_ - 1));
+
+    ert_ensure(self == header->mPool);
+
+    uintptr_t offset = address - (uintptr_t) header - SLAB_HEADER_;
+
+    ert_ensure( ! (offset % self->mSize));
+
+    return ((header->mIndex << 16) | (offset / self->mSize)) + 1;
+}
+
+static void
+linkSlabObject_(
+    struct Ert_SlabPool *self,
+    uint32_t             aId,
+    uint32_t             aNextId)
+{
+    uint32_t *link = fetchSlabObject_(self, aId);
+
+    __atomic_store_n(link, aNextId, __ATOMIC_RELAXED);
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+pushSlabFreeList_(
+    struct Ert_SlabPool *self,
+    uint32_t             aFirstId,
+    uint32_t             aLastId)
+{
+    uint64_t head = __atomic_load_n(&self->mFreeList, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    do
+    {
+        linkSlabObject_(self, aLastId, (uint32_t) head);
+
+        next = (((head >> 32) + 1) << 32) | aFirstId;
+    }
+    while ( ! __atomic_compare_exchange_n(
+                &self->mFreeList, &head, next,
+                true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static uint32_t
+popSlabFreeList_(
+    struct Ert_SlabPool *self)
+{
+    uint64_t head = __atomic_load_n(&self->mFreeList, __ATOMIC_ACQUIRE);
+    uint32_t id;
+
+    while ((id = (uint32_t) head))
+    {
+        uint32_t *link = fetchSlabObject_(self, id);
+
+        uint64_t next =
+            (((head >> 32) + 1) << 32) |
+            __atomic_load_n(link, __ATOMIC_RELAXED);
+
+        if (__atomic_compare_exchange_n(
+                &self->mFreeList, &head, next,
+                true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            break;
+    }
+
+    return id;
+}
+
+/* -------------------------------------------------------------------------- */
+static ERT_CHECKED int
+growSlabPool_(
+    struct Ert_SlabPool *self,
+    uint32_t            *aId)
+{
+    int rc = -1;
+
+    char *map = MAP_FAILED;
+
+    ert_ensure(SLAB_OBJECT_MAX_ >= self->mSize);
+
+    unsigned slabIndex =
+        __atomic_fetch_add(&self->mNumSlabs, 1, __ATOMIC_RELAXED);
+
+    ERT_ERROR_IF(
+        ERT_SLABPOOL_SLABS <= slabIndex,
+        {
+            __atomic_fetch_sub(&self->mNumSlabs, 1, __ATOMIC_RELAXED);
+            errno = ENOMEM;
+        });
+
+    /* Map twice the size of the slab so that a slab aligned to its
+     * size can be found within the mapping, then unmap the excess. */
+
+    ERT_ERROR_IF(
+        (map = mmap(0,
+                    2 * SLAB_SIZE_,
+                    PROT_READ | PROT_WRITE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0),
+         MAP_FAILED == map));
+
+    char *slab = (char *) (
+        ((uintptr_t) map + SLAB_SIZE_ - 1) & ~ (uintptr_t) (SLAB_SIZE_ - 1));
+
+    if (slab != map)
+        ERT_ABORT_IF(
+            munmap(map, slab - map));
+    if (slab + SLAB_SIZE_ != map + 2 * SLAB_SIZE_)
+        ERT_ABORT_IF(
+            munmap(slab + SLAB_SIZE_, map + SLAB_SIZE_ - slab));
+    map = MAP_FAILED;
+
+    struct SlabHeader_ *header = (void *) slab;
+
+    header->mPool  = self;
+    header->mIndex = slabIndex;
+
+    __atomic_store_n(&self->mSlabs[slabIndex], slab, __ATOMIC_RELEASE);
+
+    /* Return the first object in the slab to the caller, and link
+     * the remaining objects into the shared free list. */
+
+    uint32_t numObjects = (SLAB_SIZE_ - SLAB_HEADER_) / self->mSize;
+    uint32_t firstId    = (slabIndex << 16) + 1;
+
+    if (1 < numObjects)
+    {
+        for (uint32_t ix = 1; numObjects - 1 > ix; ++ix)
+            linkSlabObject_(self, firstId + ix, firstId + ix + 1);
+
+        pushSlabFreeList_(self, firstId + 1, firstId + numObjects - 1);
+    }
+
+    *aId = firstId;
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if (MAP_FAILED != map)
+            ERT_ABORT_IF(
+                munmap(map, 2 * SLAB_SIZE_));
+    });
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+/* Thread specific magazine cleanup
+ *
+ * Use the same approach as error.c to return the objects held in the
+ * magazines of a thread to their pools when the thread terminates. */
+
+struct SlabDtor_
+{
+    pthread_key_t  mKey;
+    pthread_once_t mOnce;
+};
+
+static struct SlabDtor_ slabDtor_ =
+{
+    .mOnce = PTHREAD_ONCE_INIT,
+};
+
+static void
+flushSlabMagazine_(
+    struct Ert_SlabPool  *self,
+    struct SlabMagazine_ *aMagazine,
+    unsigned              aCount)
+{
+    if (aCount)
+    {
+        uint32_t *objects = &aMagazine->mObjects[aMagazine->mCount - aCount];
+
+        for (unsigned ix = 0; aCount - 1 > ix; ++ix)
+            linkSlabObject_(self, objects[ix], objects[ix+1]);
+
+        pushSlabFreeList_(self, objects[0], objects[aCount-1]);
+
+        aMagazine->mCount -= aCount;
+    }
+}
+
+static void
+destroySlabKey_(void *aMagazines_)
+{
+    for (unsigned ix = 0; SLAB_MAGAZINES_ > ix; ++ix)
+    {
+        struct SlabMagazine_ *magazine = &slabMagazines_.mMagazine[ix];
+
+        struct Ert_SlabPool *pool =
+            __atomic_load_n(&slabPools_[ix], __ATOMIC_ACQUIRE);
+
+        if (pool &&
+            magazine->mRegistration == __atomic_load_n(
+                &pool->mRegistration, __ATOMIC_ACQUIRE))
+            flushSlabMagazine_(pool, magazine, magazine->mCount);
+
+        magazine->mRegistration = 0;
+        magazine->mCount        = 0;
+    }
+
+    slabMagazines_.mKey = false;
+}
+
+static void
+initSlabKey_(void)
+{
+    if (pthread_once(
+            &slabDtor_.mOnce,
+            ERT_LAMBDA(
+                void, (void),
+                {
+                    if (pthread_key_create(
+                            &slabDtor_.mKey, destroySlabKey_))
+                        ert_abortProcess();
+                })))
+        ert_abortProcess();
+}
+
+ERT_EARLY_INITIALISER(
+    slab_,
+    ({
+        initSlabKey_();
+    }),
+    ({ }));
+
+/* -------------------------------------------------------------------------- */
+static uint64_t
+registerSlabPool_(
+    struct Ert_SlabPool *self)
+{
+    /* Claim a magazine slot for the pool, and publish the slot together
+     * with a unique serial number, so that the magazines of each thread
+     * can discard objects left over from pools previously using the
+     * same slot. If there are no slots remaining, the pool uses only
+     * the shared free list. */
+
+    uint64_t registration = SLAB_UNREGISTERED_;
+
+    unsigned slot;
+
+    for (slot = 0; SLAB_MAGAZINES_ > slot; ++slot)
+    {
+        struct Ert_SlabPool *vacant = 0;
+
+        if (__atomic_compare_exchange_n(
+                &slabPools_[slot], &vacant, self,
+                false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        {
+            uint64_t serial =
+                __atomic_add_fetch(&slabPoolSerial_, 1, __ATOMIC_RELAXED);
+
+            registration = (serial << 8) | (slot + 1);
+            break;
+        }
+    }
+
+    uint64_t unregistered = 0;
+
+    if ( ! __atomic_compare_exchange_n(
+             &self->mRegistration, &unregistered, registration,
+             false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        if (SLAB_MAGAZINES_ > slot)
+            __atomic_store_n(&slabPools_[slot], 0, __ATOMIC_RELEASE);
+
+        registration = unregistered;
+    }
+
+    return registration;
+}
+
+static struct SlabMagazine_ *
+acquireSlabMagazine_(
+    struct Ert_SlabPool *self)
+{
+    struct SlabMagazine_ *magazine = 0;
+
+    uint64_t registration =
+        __atomic_load_n(&self->mRegistration, __ATOMIC_ACQUIRE);
+
+    if ( ! registration)
+        registration = registerSlabPool_(self);
+
+    if (SLAB_UNREGISTERED_ != registration)
+    {
+        /* The magazine might already be in use if a signal handler
+         * interrupted the thread while it was using the magazine, in
+         * which case the signal handler uses only the shared list.
+         * Registering the magazines for cleanup is not async signal
+         * safe, so a signal handler also uses only the shared list
+         * until the thread has registered its magazines. */
+
+        struct SlabMagazine_ *slotMagazine =
+            &slabMagazines_.mMagazine[(registration & 0xff) - 1];
+
+        if ( ! slotMagazine->mBusy &&
+             (slabMagazines_.mKey || ! ert_ownProcessSignalContext()))
+        {
+            magazine = slotMagazine;
+
+            magazine->mBusy = 1;
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+            if (magazine->mRegistration != registration)
+            {
+                if ( ! slabMagazines_.mKey)
+                {
+                    if (pthread_setspecific(slabDtor_.mKey, &slabMagazines_))
+                        ert_abortProcess();
+
+                    slabMagazines_.mKey = true;
+                }
+
+                magazine->mRegistration = registration;
+                magazine->mCount        = 0;
+            }
+        }
+    }
+
+    return magazine;
+}
+
+static void
+releaseSlabMagazine_(
+    struct SlabMagazine_ *aMagazine)
+{
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    aMagazine->mBusy = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_createSlabPool(
+    struct Ert_SlabPool *self,
+    size_t               aSize)
+{
+    int rc = -1;
+
+    *self = (struct Ert_SlabPool) ERT_SLABPOOL_INITIALIZER(aSize);
+
+    ERT_ERROR_IF(
+        SLAB_OBJECT_MAX_ < self->mSize,
+        {
+            errno = EINVAL;
+        });
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+struct Ert_SlabPool *
+ert_closeSlabPool(
+    struct Ert_SlabPool *self)
+{
+    if (self)
+    {
+        uint64_t registration = self->mRegistration;
+
+        if (registration && SLAB_UNREGISTERED_ != registration)
+            __atomic_store_n(
+                &slabPools_[(registration & 0xff) - 1], 0, __ATOMIC_RELEASE);
+
+        self->mRegistration = 0;
+
+        unsigned numSlabs = self->mNumSlabs;
+
+        if (ERT_SLABPOOL_SLABS < numSlabs)
+            numSlabs = ERT_SLABPOOL_SLABS;
+
+        for (unsigned ix = 0; numSlabs > ix; ++ix)
+        {
+            if (self->mSlabs[ix])
+                ERT_ABORT_IF(
+                    munmap(self->mSlabs[ix], SLAB_SIZE_));
+            self->mSlabs[ix] = 0;
+        }
+
+        self->mNumSlabs = 0;
+        self->mFreeList = 0;
+    }
+
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void *
+ert_allocSlab(
+    struct Ert_SlabPool *self)
+{
+    void *object = 0;
+
+    struct SlabMagazine_ *magazine = acquireSlabMagazine_(self);
+
+    uint32_t id = 0;
+
+    if (magazine && magazine->mCount)
+        id = magazine->mObjects[--magazine->mCount];
+
+    if ( ! id)
+        id = popSlabFreeList_(self);
+
+    if ( ! id)
+        ERT_ERROR_IF(
+            growSlabPool_(self, &id));
+
+    object = fetchSlabObject_(self, id);
+
+Ert_Finally:
+
+    ERT_FINALLY
+    ({
+        if (magazine)
+            releaseSlabMagazine_(magazine);
+    });
+
+    return object;
+}
+
+/* -------------------------------------------------------------------------- */
+void
+ert_freeSlab(
+    struct Ert_SlabPool *self,
+    void                *aObject)
+{
+    if (aObject)
+    {
+        uint32_t id = fetchSlabObjectId_(self, aObject);
+
+        struct SlabMagazine_ *magazine = acquireSlabMagazine_(self);
+
+        if ( ! magazine)
+            pushSlabFreeList_(self, id, id);
+        else
+        {
+            /* When the magazine is full, return half of the objects
+             * to the shared list so that objects freed by one thread
+             * are eventually available to other threads. */
+
+            if (SLAB_MAGAZINE_SIZE_ == magazine->mCount)
+                flushSlabMagazine_(self, magazine, SLAB_MAGAZINE_SIZE_ / 2);
+
+            magazine->mObjects[magazine->mCount++] = id;
+
+            releaseSlabMagazine_(magazine);
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
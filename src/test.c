@@ -39,26 +39,18 @@
 #include <valgrind/valgrind.h>
 
 /* -------------------------------------------------------------------------- */
-struct TestState
+struct Ert_TestState
 {
     uint64_t mError;
     uint64_t mTrigger;
 };
 
-static struct TestState *testState_;
+struct Ert_TestState *gErtTestState_;
 static unsigned          moduleInit_;
 
 /* -------------------------------------------------------------------------- */
 bool
-ert_testMode(
-    enum Ert_TestLevel aLevel)
-{
-    return aLevel <= gErtOptions_.mTest;
-}
-
-/* -------------------------------------------------------------------------- */
-bool
-ert_testAction(
+ert_testAction_(
     enum Ert_TestLevel aLevel)
 {
     /* If test mode has been enabled, choose to activate a test action
@@ -69,7 +61,7 @@ ert_testAction(
 
 /* -------------------------------------------------------------------------- */
 bool
-ert_testSleep(
+ert_testSleep_(
     enum Ert_TestLevel aLevel)
 {
     bool slept = false;
@@ -81,7 +73,7 @@ ert_testSleep(
 
     if ( ! RUNNING_ON_VALGRIND)
     {
-        if (ert_testAction(aLevel))
+        if (ert_testAction_(aLevel))
         {
             slept = true;
             ert_monotonicSleep(
@@ -98,21 +90,21 @@ ert_testSleep(
 uint64_t
 ert_testErrorLevel(void)
 {
-    return testState_ ? testState_->mError : 0;
+    return gErtTestState_ ? gErtTestState_->mError : 0;
 }
 
 /* -------------------------------------------------------------------------- */
 bool
-ert_testFinally(
-    const struct Ert_ErrorFrame *aFrame)
+ert_testFinally_(
+    const struct Ert_ErrorFrameSite *aSite)
 {
     bool inject = false;
 
-    if (testState_)
+    if (gErtTestState_)
     {
-        uint64_t errorLevel = __sync_add_and_fetch(&testState_->mError, 1);
+        uint64_t errorLevel = __sync_add_and_fetch(&gErtTestState_->mError, 1);
 
-        if (testState_->mTrigger && errorLevel == testState_->mTrigger)
+        if (gErtTestState_->mTrigger && errorLevel == gErtTestState_->mTrigger)
         {
             static const struct
             {
@@ -128,9 +120,9 @@ ert_testFinally(
             ert_debug(0,
                   "inject %s into %s %s %u",
                   errTable[choice].mText,
-                  aFrame->mName,
-                  aFrame->mFile,
-                  aFrame->mLine);
+                  aSite->mName,
+                  aSite->mFile,
+                  aSite->mLine);
 
             errno  = errTable[choice].mCode;
             inject = true;
@@ -148,7 +140,7 @@ Ert_Test_init(
 {
     int rc = -1;
 
-    struct TestState *state = MAP_FAILED;
+    struct Ert_TestState *state = MAP_FAILED;
 
     self->mModule = self;
 
@@ -162,17 +154,24 @@ Ert_Test_init(
                 ert_getEnvUInt64(aErrorEnv, &errorTrigger) && ENOENT != errno);
         }
 
-        ERT_ERROR_IF(
-            (state = mmap(0,
-                          sizeof(*testState_),
-                          PROT_READ | PROT_WRITE,
-                          MAP_ANONYMOUS | MAP_SHARED, -1, 0),
-             MAP_FAILED == state));
+        /* Only create the test state if test mode is enabled, or an
+         * error is to be injected, so that otherwise ert_testFinally()
+         * remains a predicted false branch. */
 
-        testState_ = state;
+        if (errorTrigger || ert_testMode(Ert_TestLevelRace))
+        {
+            ERT_ERROR_IF(
+                (state = mmap(0,
+                              sizeof(*gErtTestState_),
+                              PROT_READ | PROT_WRITE,
+                              MAP_ANONYMOUS | MAP_SHARED, -1, 0),
+                 MAP_FAILED == state));
 
-        testState_->mError   = 1;
-        testState_->mTrigger = errorTrigger;
+            gErtTestState_ = state;
+
+            gErtTestState_->mError   = 1;
+            gErtTestState_->mTrigger = errorTrigger;
+        }
     }
 
     ++moduleInit_;
@@ -201,11 +200,11 @@ Ert_Test_exit(
 {
     if (self)
     {
-        struct TestState *state = testState_;
+        struct Ert_TestState *state = gErtTestState_;
 
         if (state)
         {
-            testState_ = 0;
+            gErtTestState_ = 0;
             ERT_ABORT_IF(
                 munmap(state, sizeof(*state)));
         }
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ucontext.h>
 
 #include <sys/syscall.h>
 
@@ -767,6 +768,278 @@ ert_waitCond(
         });
 }
 
+/* -------------------------------------------------------------------------- */
+/* Signal Deferral
+ *
+ * When deferral is enabled, critical sections only count their depth
+ * in each thread, rather than blocking signals using pthread_sigmask().
+ * The signal dispatchers installed by the library check the depth, and
+ * queue the signal if the thread is in a critical section. The queued
+ * signals are replayed, with all signals blocked, when the outermost
+ * critical section ends.
+ *
+ * Like the signal mask, each standard signal is queued at most once.
+ * Signals that are raised synchronously by a fault cannot be deferred
+ * because returning from the handler would simply repeat the fault.
+ *
+ * A signal that might have been directed at the process is not queued
+ * in the thread, because the thread might remain in the critical
+ * section indefinitely. Instead the signal is queued to the process
+ * again, and remains blocked in the thread until the outermost critical
+ * section ends, so that another thread can receive it.
+ *
+ * Each instance of a real-time signal must be delivered, so a real-time
+ * signal directed at the thread is queued to the thread again by the
+ * kernel, and remains blocked until the outermost critical section
+ * ends. */
+
+static void (*threadSigMaskReplay_)(
+    int aSigNum, siginfo_t *aSigInfo, void *aSigContext);
+
+static __thread struct
+{
+    unsigned  mDepth;
+    uint64_t  mPending;
+    uint64_t  mBlocked;
+    siginfo_t mSigInfo[64];
+
+} threadSigMaskDefer_;
+
+void
+ert_enableThreadSigMaskDefer_(
+    void (*aReplay)(int aSigNum, siginfo_t *aSigInfo, void *aSigContext))
+{
+    __atomic_store_n(&threadSigMaskReplay_, aReplay, __ATOMIC_RELEASE);
+}
+
+void
+ert_clearThreadSigMaskDefer_(void)
+{
+    threadSigMaskDefer_.mPending = 0;
+}
+
+static bool
+requeueProcessSignal_(
+    int              aSigNum,
+    const siginfo_t *aSigInfo)
+{
+    /* The kernel only allows the main thread to queue the original
+     * signal information, so other threads use kill(2). */
+
+    int err = errno;
+
+    pid_t pid = getpid();
+
+    bool queued =
+        ! syscall(SYS_rt_sigqueueinfo, pid, aSigNum, aSigInfo) ||
+        ! kill(pid, aSigNum);
+
+    errno = err;
+
+    return queued;
+}
+
+static bool
+requeueThreadSignal_(
+    int              aSigNum,
+    const siginfo_t *aSigInfo)
+{
+    /* The kernel only allows the original signal information to be
+     * queued if it describes a signal sent from user space using
+     * sigqueue(3), or if the caller is the main thread, so fall back
+     * to tgkill(2) which preserves the instance but not the sender. */
+
+    int err = errno;
+
+    pid_t pid = getpid();
+    pid_t tid = syscall(SYS_gettid);
+
+    bool queued =
+        ! syscall(SYS_rt_tgsigqueueinfo, pid, tid, aSigNum, aSigInfo) ||
+        ! syscall(SYS_tgkill, pid, tid, aSigNum);
+
+    errno = err;
+
+    return queued;
+}
+
+static bool
+ownProcessSignal_(
+    int              aSigNum,
+    const siginfo_t *aSigInfo)
+{
+    /* Signals sent using tgkill(2), and SIGPIPE and SIGXFSZ raised by
+     * the kernel, are directed at the thread. Assume that the others
+     * might have been directed at the process. */
+
+    bool processSignal = false;
+
+    if (aSigInfo && SIGPIPE != aSigNum && SIGXFSZ != aSigNum)
+        processSignal =
+            SI_USER == aSigInfo->si_code ||
+            SI_QUEUE == aSigInfo->si_code ||
+            0 < aSigInfo->si_code;
+
+    return processSignal;
+}
+
+bool
+ert_deferThreadSigMaskSignal_(
+    int              aSigNum,
+    const siginfo_t *aSigInfo,
+    void            *aSigContext)
+{
+    bool deferred = false;
+
+    if (threadSigMaskDefer_.mDepth)
+    {
+        switch (aSigNum)
+        {
+        default:
+            if (0 < aSigNum &&
+                ERT_NUMBEROF(threadSigMaskDefer_.mSigInfo) >= aSigNum)
+            {
+                uint64_t sigBit = UINT64_C(1) << (aSigNum - 1);
+
+                /* Amending the signal mask in the signal context blocks
+                 * the signal in the thread once the dispatcher returns.
+                 * If the signal cannot be queued to the kernel again,
+                 * queue it in the thread instead. */
+
+                if (aSigContext && aSigInfo)
+                {
+                    ucontext_t *sigContext = aSigContext;
+
+                    bool queued = false;
+
+                    if (ownProcessSignal_(aSigNum, aSigInfo))
+                        queued = requeueProcessSignal_(aSigNum, aSigInfo);
+
+                    if ( ! queued &&
+                         SIGRTMIN <= aSigNum && SIGRTMAX >= aSigNum)
+                        queued = requeueThreadSignal_(aSigNum, aSigInfo);
+
+                    if (queued)
+                    {
+                        ERT_ABORT_IF(
+                            sigaddset(&sigContext->uc_sigmask, aSigNum));
+
+                        threadSigMaskDefer_.mBlocked |= sigBit;
+
+                        deferred = true;
+                        break;
+                    }
+                }
+
+                if ( ! (threadSigMaskDefer_.mPending & sigBit))
+                {
+                    if (aSigInfo)
+                        threadSigMaskDefer_.mSigInfo[aSigNum-1] = *aSigInfo;
+                    else
+                        memset(&threadSigMaskDefer_.mSigInfo[aSigNum-1],
+                               0,
+                               sizeof(threadSigMaskDefer_.mSigInfo[0]));
+
+                    threadSigMaskDefer_.mPending |= sigBit;
+                }
+
+                deferred = true;
+            }
+            break;
+
+        case SIGABRT: case SIGBUS:  case SIGFPE: case SIGILL:
+        case SIGSEGV: case SIGSYS:  case SIGTRAP:
+            break;
+        }
+    }
+
+    return deferred;
+}
+
+static void
+retainThreadSigMaskDeferBlocked_(
+    int       aMaskAction,
+    sigset_t *aSigSet)
+{
+    /* Signals that were blocked when they were deferred must remain
+     * blocked until the outermost critical section ends. */
+
+    uint64_t blocked = threadSigMaskDefer_.mBlocked;
+
+    while (blocked)
+    {
+        int sigNum = __builtin_ctzll(blocked) + 1;
+
+        blocked &= blocked - 1;
+
+        if (SIG_SETMASK == aMaskAction)
+            ERT_ABORT_IF(sigaddset(aSigSet, sigNum));
+        else if (SIG_UNBLOCK == aMaskAction)
+            ERT_ABORT_IF(sigdelset(aSigSet, sigNum));
+    }
+}
+
+static void
+replayThreadSigMaskDefer_(void)
+{
+    /* Replay the signals with all signals blocked, as would be the case
+     * for the dispatchers, and remain in a critical section so that
+     * any critical sections in the signal handlers do not themselves
+     * attempt to replay signals. The signal handlers receive the
+     * context of the replay, since the context in which the signal was
+     * delivered no longer exists. If deferral was disabled while in
+     * the critical section, raise the signals in the thread again so
+     * that they are delivered once the signal mask is restored. */
+
+    void (*replay)(int, siginfo_t *, void *) =
+        __atomic_load_n(&threadSigMaskReplay_, __ATOMIC_ACQUIRE);
+
+    sigset_t sigSet;
+    sigset_t filledSigSet;
+    ERT_ABORT_IF(sigfillset(&filledSigSet));
+    ERT_ABORT_IF(pthread_sigmask(SIG_BLOCK, &filledSigSet, &sigSet));
+
+    ucontext_t sigContext;
+    ERT_ABORT_IF(getcontext(&sigContext));
+
+    ++threadSigMaskDefer_.mDepth;
+
+    uint64_t pending;
+
+    while ((pending = threadSigMaskDefer_.mPending))
+    {
+        int sigNum = __builtin_ctzll(pending) + 1;
+
+        siginfo_t sigInfo = threadSigMaskDefer_.mSigInfo[sigNum-1];
+
+        threadSigMaskDefer_.mPending &= ~ (UINT64_C(1) << (sigNum - 1));
+
+        if (replay)
+            replay(sigNum, &sigInfo, &sigContext);
+        else
+        {
+            sigInfo.si_signo = sigNum;
+
+            if (syscall(SYS_rt_tgsigqueueinfo,
+                        getpid(), syscall(SYS_gettid), sigNum, &sigInfo))
+                ERT_ABORT_IF(
+                    (errno = pthread_kill(pthread_self(), sigNum)));
+        }
+    }
+
+    --threadSigMaskDefer_.mDepth;
+
+    /* Unblock the signals that were queued to the process again, so
+     * that they are delivered to this thread if no other thread has
+     * received them. */
+
+    retainThreadSigMaskDeferBlocked_(SIG_UNBLOCK, &sigSet);
+
+    threadSigMaskDefer_.mBlocked = 0;
+
+    ERT_ABORT_IF(pthread_sigmask(SIG_SETMASK, &sigSet, 0));
+}
+
 /* -------------------------------------------------------------------------- */
 struct Ert_ThreadSigMask *
 ert_pushThreadSigMask(
@@ -774,6 +1047,8 @@ ert_pushThreadSigMask(
     enum Ert_ThreadSigMaskAction  aAction,
     const int                    *aSigList)
 {
+    self->mDeferred = false;
+
     int maskAction;
     switch (aAction)
     {
@@ -786,6 +1061,24 @@ ert_pushThreadSigMask(
     case Ert_ThreadSigMaskUnblock: maskAction = SIG_UNBLOCK; break;
     case Ert_ThreadSigMaskSet:     maskAction = SIG_SETMASK; break;
     case Ert_ThreadSigMaskBlock:   maskAction = SIG_BLOCK;   break;
+
+    case Ert_ThreadSigMaskDefer:
+        ert_ensure( ! aSigList);
+
+        if (__atomic_load_n(&threadSigMaskReplay_, __ATOMIC_ACQUIRE))
+        {
+            /* Ensure that the compiler does not move accesses across
+             * the boundary of the critical section. */
+
+            ++threadSigMaskDefer_.mDepth;
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+            self->mDeferred = true;
+            return self;
+        }
+
+        maskAction = SIG_BLOCK;
+        break;
     }
 
     sigset_t sigSet;
@@ -799,6 +1092,8 @@ ert_pushThreadSigMask(
             ERT_ABORT_IF(sigaddset(&sigSet, aSigList[ix]));
     }
 
+    retainThreadSigMaskDeferBlocked_(maskAction, &sigSet);
+
     ERT_ABORT_IF(pthread_sigmask(maskAction, &sigSet, &self->mSigSet));
 
     return self;
@@ -886,7 +1181,31 @@ ert_popThreadSigMask(
     struct Ert_ThreadSigMask *self)
 {
     if (self)
-        ERT_ABORT_IF(pthread_sigmask(SIG_SETMASK, &self->mSigSet, 0));
+    {
+        if ( ! self->mDeferred)
+        {
+            sigset_t sigSet = self->mSigSet;
+
+            retainThreadSigMaskDeferBlocked_(SIG_SETMASK, &sigSet);
+
+            ERT_ABORT_IF(pthread_sigmask(SIG_SETMASK, &sigSet, 0));
+        }
+        else
+        {
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+            ert_ensure(threadSigMaskDefer_.mDepth);
+
+            if ( ! --threadSigMaskDefer_.mDepth)
+            {
+                __atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+                if (threadSigMaskDefer_.mPending ||
+                    threadSigMaskDefer_.mBlocked)
+                    replayThreadSigMaskDefer_();
+            }
+        }
+    }
 
     return 0;
 }
@@ -970,7 +1289,7 @@ ert_lockThreadSigMutex(
 
     struct Ert_ThreadSigMask  threadSigMask_;
     struct Ert_ThreadSigMask *threadSigMask =
-        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskBlock, 0);
+        ert_pushThreadSigMask(&threadSigMask_, Ert_ThreadSigMaskDefer, 0);
 
     pthread_mutex_t *lock;
     ERT_ABORT_UNLESS(
@@ -0,0 +1,186 @@
+/* -*- c-basic-offset:4; indent-tabs-mode:nil -*- vi: set sw=4 et: */
+/*
+// Copyright (c) 2016, Earl Chew
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the names of the authors of source code nor the names
+//       of the contributors to the source code may be used to endorse or
+//       promote products derived from this software without specific
+//       prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL EARL CHEW BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ert/threadstatistics.h"
+#include "ert/process.h"
+#include "ert/thread.h"
+#include "ert/error.h"
+
+#include <stddef.h>
+
+#include <sys/mman.h>
+
+/* -------------------------------------------------------------------------- */
+static struct Ert_ThreadStatisticsBlock_ *
+threadStatisticsBlock_(const void *aBlock)
+{
+    return (void *) ((char *) aBlock -
+                     offsetof(struct Ert_ThreadStatisticsBlock_, mData));
+}
+
+/* -------------------------------------------------------------------------- */
+static void
+destroyThreadStatisticsKey_(void *aBlock_)
+{
+    struct Ert_ThreadStatisticsBlock_ *block = aBlock_;
+
+    struct Ert_ThreadStatistics       *self   = block->mStatistics;
+    struct Ert_ThreadStatisticsThread *thread = block->mThread;
+
+    ++thread->mBusy;
+
+    pthread_mutex_t *lock = ert_lockMutex(&self->mMutex);
+    {
+        LIST_REMOVE(block, mList);
+
+        self->mMerge(self->mExited, block->mData);
+    }
+    lock = ert_unlockMutex(lock);
+
+    thread->mBlock = 0;
+
+    ERT_ABORT_IF(
+        munmap(block, sizeof(*block) + self->mSize));
+
+    --thread->mBusy;
+}
+
+/* -------------------------------------------------------------------------- */
+static void *
+fetchThreadStatistics_(
+    struct Ert_ThreadStatistics       *self,
+    struct Ert_ThreadStatisticsThread *aThread)
+{
+    /* Creating the block is not async signal safe, so a thread whose
+     * first record is made from a signal handler run by the library
+     * records nothing until it records outside a signal handler. */
+
+    if ( ! aThread->mBlock && ! ert_ownProcessSignalContext())
+    {
+        void *map = mmap(0, sizeof(struct Ert_ThreadStatisticsBlock_) +
+                            self->mSize,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (MAP_FAILED != map)
+        {
+            struct Ert_ThreadStatisticsBlock_ *block = map;
+
+            block->mStatistics = self;
+            block->mThread     = aThread;
+
+            pthread_mutex_t *lock = ert_lockMutex(&self->mMutex);
+            {
+                if ( ! self->mKeyed)
+                {
+                    if (pthread_key_create(
+                            &self->mKey, destroyThreadStatisticsKey_))
+                        ert_abortProcess();
+
+                    self->mKeyed = 1;
+                }
+
+                LIST_INSERT_HEAD(&self->mList, block, mList);
+            }
+            lock = ert_unlockMutex(lock);
+
+            if (pthread_setspecific(self->mKey, block))
+                ert_abortProcess();
+
+            aThread->mBlock = block->mData;
+        }
+    }
+
+    return aThread->mBlock;
+}
+
+void *
+ert_beginThreadStatistics(
+    struct Ert_ThreadStatistics       *self,
+    struct Ert_ThreadStatisticsThread *aThread)
+{
+    void *block = 0;
+
+    if ( ! aThread->mBusy)
+    {
+        ++aThread->mBusy;
+
+        block = fetchThreadStatistics_(self, aThread);
+
+        if ( ! block)
+            --aThread->mBusy;
+    }
+
+    return block;
+}
+
+void
+ert_endThreadStatistics(
+    struct Ert_ThreadStatisticsThread *aThread)
+{
+    --aThread->mBusy;
+}
+
+/* -------------------------------------------------------------------------- */
+pthread_mutex_t *
+ert_lockThreadStatistics(
+    struct Ert_ThreadStatistics       *self,
+    struct Ert_ThreadStatisticsThread *aThread)
+{
+    ++aThread->mBusy;
+
+    return ert_lockMutex(&self->mMutex);
+}
+
+pthread_mutex_t *
+ert_unlockThreadStatistics(
+    struct Ert_ThreadStatisticsThread *aThread,
+    pthread_mutex_t                   *aLock)
+{
+    pthread_mutex_t *lock = ert_unlockMutex(aLock);
+
+    --aThread->mBusy;
+
+    return lock;
+}
+
+const void *
+ert_nextThreadStatistics(
+    struct Ert_ThreadStatistics *self,
+    const void                  *aBlock)
+{
+    struct Ert_ThreadStatisticsBlock_ *block =
+        aBlock
+        ? LIST_NEXT(threadStatisticsBlock_(aBlock), mList)
+        : LIST_FIRST(&self->mList);
+
+    return block ? block->mData : 0;
+}
+
+/* -------------------------------------------------------------------------- */
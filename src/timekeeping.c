@@ -36,6 +36,12 @@
 #include <string.h>
 #include <stdlib.h>
 
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+
 #ifdef __linux__
 #ifndef CLOCK_BOOTTIME
 #define CLOCK_BOOTTIME 7 /* Since 2.6.39 */
@@ -473,6 +479,67 @@ ert_monotonicSleep(
     ert_ensure( ! rc);
 }
 
+/* -------------------------------------------------------------------------- */
+#ifdef __linux__
+int
+ert_setTimerSlack(struct Ert_Duration aSlack)
+{
+    int rc = -1;
+
+    /* The timer slack determines how much later than requested
+     * the kernel may wake a thread sleeping with a timeout, so that
+     * wake ups can be coalesced. The setting applies to the calling
+     * thread, and is inherited by threads that it creates. A zero
+     * slack restores the default for the thread. */
+
+    unsigned long slack = aSlack.duration.ns;
+
+    ERT_ERROR_IF(
+        slack != aSlack.duration.ns,
+        {
+            errno = EINVAL;
+        });
+
+    ERT_ERROR_IF(
+        prctl(PR_SET_TIMERSLACK, slack));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+
+/* -------------------------------------------------------------------------- */
+int
+ert_fetchTimerSlack(struct Ert_Duration *aSlack)
+{
+    int rc = -1;
+
+    /* The timer slack is returned as the result of the system call,
+     * which prctl(2) would truncate to int, so issue the system call
+     * directly to retrieve the full unsigned long value. */
+
+    long slack;
+
+    ERT_ERROR_IF(
+        (slack = syscall(SYS_prctl, PR_GET_TIMERSLACK, 0, 0, 0, 0),
+         -1 == slack));
+
+    *aSlack = Ert_Duration(Ert_NanoSeconds((unsigned long) slack));
+
+    rc = 0;
+
+Ert_Finally:
+
+    ERT_FINALLY({});
+
+    return rc;
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 int
 Ert_Timekeeping_init(